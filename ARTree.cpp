@@ -0,0 +1,634 @@
+/*
+Adaptive radix tree map with the same interface as AVLTree.
+Keys that end inside the tree (a key that is a prefix of another) are stored
+on the inner node itself (hasValue), so no terminator byte is needed and
+binary keys work unchanged.
+ */
+
+#include "ARTree.h"
+
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+ARTree::Node48::Node48(KeyType p) : ARTNode(NodeType::Node48, std::move(p)) {
+    for (size_t i = 0; i < 256; ++i) {
+        index[i] = 0;
+    }
+    for (size_t i = 0; i < 48; ++i) {
+        children[i] = nullptr;
+    }
+}
+
+ARTree::Node256::Node256(KeyType p) : ARTNode(NodeType::Node256, std::move(p)) {
+    for (size_t i = 0; i < 256; ++i) {
+        children[i] = nullptr;
+    }
+}
+
+// Default constructor: start with an empty tree.
+ARTree::ARTree() : root(nullptr), treeSize(0) {}
+
+// Copy constructor: deep-copy the other tree.
+ARTree::ARTree(const ARTree& other) : root(nullptr), treeSize(0) {
+    root = copyTree(other.root);
+    treeSize = other.treeSize;
+}
+
+// Assignment operator: clear current tree, then deep-copy other.
+ARTree& ARTree::operator=(const ARTree& other) {
+    if (this != &other) {
+        clearTree(root);
+        root = copyTree(other.root);
+        treeSize = other.treeSize;
+    }
+    return *this;
+}
+
+// Destructor: free all nodes.
+ARTree::~ARTree() {
+    clearTree(root);
+}
+
+ARTree::ARTNode* ARTree::makeNode(NodeType type, KeyType prefix) {
+    switch (type) {
+    case NodeType::Leaf:    return new ARTNode(NodeType::Leaf, std::move(prefix));
+    case NodeType::Node4:   return new Node4(std::move(prefix));
+    case NodeType::Node16:  return new Node16(std::move(prefix));
+    case NodeType::Node48:  return new Node48(std::move(prefix));
+    case NodeType::Node256: return new Node256(std::move(prefix));
+    }
+    return nullptr;
+}
+
+void ARTree::destroyNode(ARTNode* node) {
+    switch (node->type) {
+    case NodeType::Leaf:    delete node; break;
+    case NodeType::Node4:   delete static_cast<Node4*>(node); break;
+    case NodeType::Node16:  delete static_cast<Node16*>(node); break;
+    case NodeType::Node48:  delete static_cast<Node48*>(node); break;
+    case NodeType::Node256: delete static_cast<Node256*>(node); break;
+    }
+}
+
+template <class Visit>
+void ARTree::forEachChild(const ARTNode* node, Visit visit) {
+    switch (node->type) {
+    case NodeType::Leaf:
+        break;
+    case NodeType::Node4: {
+        auto n = static_cast<const Node4*>(node);
+        for (size_t i = 0; i < n->count; ++i) {
+            visit(n->keys[i], n->children[i]);
+        }
+        break;
+    }
+    case NodeType::Node16: {
+        auto n = static_cast<const Node16*>(node);
+        for (size_t i = 0; i < n->count; ++i) {
+            visit(n->keys[i], n->children[i]);
+        }
+        break;
+    }
+    case NodeType::Node48: {
+        auto n = static_cast<const Node48*>(node);
+        for (size_t b = 0; b < 256; ++b) {
+            if (n->index[b]) {
+                visit(static_cast<uint8_t>(b), n->children[n->index[b] - 1]);
+            }
+        }
+        break;
+    }
+    case NodeType::Node256: {
+        auto n = static_cast<const Node256*>(node);
+        for (size_t b = 0; b < 256; ++b) {
+            if (n->children[b]) {
+                visit(static_cast<uint8_t>(b), n->children[b]);
+            }
+        }
+        break;
+    }
+    }
+}
+
+ARTree::ARTNode** ARTree::findChild(ARTNode* node, uint8_t byte) {
+    switch (node->type) {
+    case NodeType::Leaf:
+        return nullptr;
+    case NodeType::Node4: {
+        auto n = static_cast<Node4*>(node);
+        for (size_t i = 0; i < n->count; ++i) {
+            if (n->keys[i] == byte) {
+                return &n->children[i];
+            }
+        }
+        return nullptr;
+    }
+    case NodeType::Node16: {
+        auto n = static_cast<Node16*>(node);
+#if defined(__SSE2__)
+        // Compare all 16 key bytes at once, ignoring unused slots.
+        __m128i hits = _mm_cmpeq_epi8(_mm_set1_epi8(static_cast<char>(byte)),
+                                      _mm_loadu_si128(reinterpret_cast<const __m128i*>(n->keys)));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hits)) & ((1u << n->count) - 1);
+        return mask ? &n->children[__builtin_ctz(mask)] : nullptr;
+#else
+        for (size_t i = 0; i < n->count; ++i) {
+            if (n->keys[i] == byte) {
+                return &n->children[i];
+            }
+        }
+        return nullptr;
+#endif
+    }
+    case NodeType::Node48: {
+        auto n = static_cast<Node48*>(node);
+        return n->index[byte] ? &n->children[n->index[byte] - 1] : nullptr;
+    }
+    case NodeType::Node256: {
+        auto n = static_cast<Node256*>(node);
+        return n->children[byte] ? &n->children[byte] : nullptr;
+    }
+    }
+    return nullptr;
+}
+
+// Sorted insert into the key/child arrays of a Node4 or Node16.
+template <class Node>
+static void insertSorted(Node* n, uint8_t byte, typename Node::ARTNode* child) {
+    size_t pos = 0;
+    while (pos < n->count && n->keys[pos] < byte) {
+        ++pos;
+    }
+    for (size_t i = n->count; i > pos; --i) {
+        n->keys[i] = n->keys[i - 1];
+        n->children[i] = n->children[i - 1];
+    }
+    n->keys[pos] = byte;
+    n->children[pos] = child;
+}
+
+void ARTree::placeChild(ARTNode* node, uint8_t byte, ARTNode* child) {
+    switch (node->type) {
+    case NodeType::Leaf:
+        return;
+    case NodeType::Node4:
+        insertSorted(static_cast<Node4*>(node), byte, child);
+        break;
+    case NodeType::Node16:
+        insertSorted(static_cast<Node16*>(node), byte, child);
+        break;
+    case NodeType::Node48: {
+        auto n = static_cast<Node48*>(node);
+        size_t slot = 0;
+        while (n->children[slot]) {
+            ++slot;
+        }
+        n->children[slot] = child;
+        n->index[byte] = static_cast<uint8_t>(slot + 1);
+        break;
+    }
+    case NodeType::Node256:
+        static_cast<Node256*>(node)->children[byte] = child;
+        break;
+    }
+    ++node->count;
+}
+
+ARTree::ARTNode* ARTree::resize(ARTNode* from, NodeType type) {
+    ARTNode* to = makeNode(type, std::move(from->prefix));
+    to->hasValue = from->hasValue;
+    to->value = from->value;
+    forEachChild(from, [to](uint8_t byte, ARTNode* child) {
+        placeChild(to, byte, child);
+    });
+    destroyNode(from);
+    return to;
+}
+
+void ARTree::addChild(ARTNode*& node, uint8_t byte, ARTNode* child) {
+    switch (node->type) {
+    case NodeType::Leaf:
+        node = resize(node, NodeType::Node4);
+        break;
+    case NodeType::Node4:
+        if (node->count == 4) {
+            node = resize(node, NodeType::Node16);
+        }
+        break;
+    case NodeType::Node16:
+        if (node->count == 16) {
+            node = resize(node, NodeType::Node48);
+        }
+        break;
+    case NodeType::Node48:
+        if (node->count == 48) {
+            node = resize(node, NodeType::Node256);
+        }
+        break;
+    case NodeType::Node256:
+        break;
+    }
+    placeChild(node, byte, child);
+}
+
+void ARTree::removeChild(ARTNode*& node, uint8_t byte) {
+    switch (node->type) {
+    case NodeType::Leaf:
+        return;
+    case NodeType::Node4:
+    case NodeType::Node16: {
+        // Same sorted-array layout for both sizes.
+        uint8_t* keys = node->type == NodeType::Node4 ? static_cast<Node4*>(node)->keys
+                                                     : static_cast<Node16*>(node)->keys;
+        ARTNode** children = node->type == NodeType::Node4 ? static_cast<Node4*>(node)->children
+                                                          : static_cast<Node16*>(node)->children;
+        size_t pos = 0;
+        while (keys[pos] != byte) {
+            ++pos;
+        }
+        for (size_t i = pos; i + 1 < node->count; ++i) {
+            keys[i] = keys[i + 1];
+            children[i] = children[i + 1];
+        }
+        break;
+    }
+    case NodeType::Node48: {
+        auto n = static_cast<Node48*>(node);
+        n->children[n->index[byte] - 1] = nullptr;
+        n->index[byte] = 0;
+        break;
+    }
+    case NodeType::Node256:
+        static_cast<Node256*>(node)->children[byte] = nullptr;
+        break;
+    }
+    --node->count;
+
+    // Shrink with some hysteresis so add/remove at a boundary does not thrash.
+    if (node->type == NodeType::Node256 && node->count <= 37) {
+        node = resize(node, NodeType::Node48);
+    } else if (node->type == NodeType::Node48 && node->count <= 12) {
+        node = resize(node, NodeType::Node16);
+    } else if (node->type == NodeType::Node16 && node->count <= 3) {
+        node = resize(node, NodeType::Node4);
+    }
+}
+
+void ARTree::compress(ARTNode*& node) {
+    if (node->hasValue) {
+        if (node->count == 0 && node->type != NodeType::Leaf) {
+            node = resize(node, NodeType::Leaf);
+        }
+        return;
+    }
+    if (node->count == 0) {
+        destroyNode(node);
+        node = nullptr;
+        return;
+    }
+    if (node->count == 1) {
+        // Fold this node's prefix and edge byte into its only child.
+        uint8_t byte = 0;
+        ARTNode* child = nullptr;
+        forEachChild(node, [&](uint8_t b, ARTNode* c) {
+            byte = b;
+            child = c;
+        });
+        child->prefix = node->prefix + static_cast<char>(byte) + child->prefix;
+        destroyNode(node);
+        node = child;
+    }
+}
+
+//  insert: inserts (key, value) starting from root.
+bool ARTree::insert(const KeyType& key, ValueType value) {
+    bool inserted = insert(root, key, 0, value);
+    if (inserted) {
+        ++treeSize;
+    }
+    return inserted;
+}
+
+bool ARTree::insert(ARTNode*& node, const KeyType& key, size_t depth, ValueType value) {
+    // if an empty place is found then it creates a new leaf holding the rest of the key.
+    if (!node) {
+        node = makeNode(NodeType::Leaf, key.substr(depth));
+        node->hasValue = true;
+        node->value = value;
+        return true;
+    }
+
+    const KeyType& prefix = node->prefix;
+    size_t match = 0;
+    while (match < prefix.size() && depth + match < key.size()
+           && prefix[match] == key[depth + match]) {
+        ++match;
+    }
+
+    if (match < prefix.size()) {
+        // The key leaves the compressed path: split it at the first mismatch.
+        ARTNode* parent = makeNode(NodeType::Node4, prefix.substr(0, match));
+        uint8_t oldByte = static_cast<uint8_t>(prefix[match]);
+        node->prefix.erase(0, match + 1);
+        placeChild(parent, oldByte, node);
+
+        if (depth + match == key.size()) {
+            parent->hasValue = true;
+            parent->value = value;
+        } else {
+            ARTNode* leaf = makeNode(NodeType::Leaf, key.substr(depth + match + 1));
+            leaf->hasValue = true;
+            leaf->value = value;
+            addChild(parent, static_cast<uint8_t>(key[depth + match]), leaf);
+        }
+        node = parent;
+        return true;
+    }
+
+    depth += prefix.size();
+    if (depth == key.size()) {
+        if (node->hasValue) {
+            return false;                     // key already exists
+        }
+        node->hasValue = true;
+        node->value = value;
+        return true;
+    }
+
+    uint8_t byte = static_cast<uint8_t>(key[depth]);
+    ARTNode** child = findChild(node, byte);
+    if (child) {
+        return insert(*child, key, depth + 1, value);
+    }
+    ARTNode* leaf = makeNode(NodeType::Leaf, key.substr(depth + 1));
+    leaf->hasValue = true;
+    leaf->value = value;
+    addChild(node, byte, leaf);
+    return true;
+}
+
+//  remove: remove given key from the tree, starting from root.
+bool ARTree::remove(const KeyType& key) {
+    bool removed = remove(root, key, 0);
+    if (removed) {
+        --treeSize;
+    }
+    return removed;
+}
+
+bool ARTree::remove(ARTNode*& node, const KeyType& key, size_t depth) {
+    if (!node) {
+        return false;
+    }
+    const KeyType& prefix = node->prefix;
+    if (key.size() - depth < prefix.size() || key.compare(depth, prefix.size(), prefix) != 0) {
+        return false;                         // key not found
+    }
+    depth += prefix.size();
+
+    if (depth == key.size()) {
+        if (!node->hasValue) {
+            return false;
+        }
+        node->hasValue = false;
+        compress(node);
+        return true;
+    }
+
+    uint8_t byte = static_cast<uint8_t>(key[depth]);
+    ARTNode** child = findChild(node, byte);
+    if (!child || !remove(*child, key, depth + 1)) {
+        return false;
+    }
+    if (!*child) {
+        removeChild(node, byte);
+    }
+    compress(node);
+    return true;
+}
+
+ARTree::ARTNode* ARTree::getNode(const KeyType& key) const {
+    ARTNode* node = root;
+    size_t depth = 0;
+    while (node) {
+        const KeyType& prefix = node->prefix;
+        if (key.size() - depth < prefix.size() || key.compare(depth, prefix.size(), prefix) != 0) {
+            return nullptr;
+        }
+        depth += prefix.size();
+        if (depth == key.size()) {
+            return node;
+        }
+        ARTNode** child = findChild(node, static_cast<uint8_t>(key[depth]));
+        if (!child) {
+            return nullptr;
+        }
+        node = *child;
+        ++depth;
+    }
+    return nullptr;
+}
+
+// contains: tells if 'key' is in the tree.
+bool ARTree::contains(const KeyType& key) const {
+    ARTNode* node = getNode(key);
+    return node && node->hasValue;
+}
+
+// Returns the value for 'key'. If key not found, returns std::nullopt.
+std::optional<ARTree::ValueType> ARTree::get(const KeyType& key) const {
+    ARTNode* node = getNode(key);
+    return node && node->hasValue ? std::optional<ValueType>(node->value) : std::nullopt;
+}
+
+// returns reference to value for 'key', inserting 0 first if needed.
+ARTree::ValueType& ARTree::operator[](const KeyType& key) {
+    ARTNode* node = getNode(key);
+    if (!node || !node->hasValue) {
+        insert(key, 0);
+        node = getNode(key);
+    }
+    return node->value;
+}
+
+// Returns vector of VALUES whose keys lie between [lowKey, highKey] (inclusive).
+std::vector<ARTree::ValueType> ARTree::findRange(const KeyType& lowKey,
+                                                 const KeyType& highKey) const {
+    std::vector<ValueType> out;
+    if (root) {
+        std::string path;
+        findRange(root, path, lowKey, highKey, out);
+    }
+    return out;
+}
+
+void ARTree::findRange(const ARTNode* node, std::string& path,
+                       const KeyType& lowKey, const KeyType& highKey,
+                       std::vector<ValueType>& result) const {
+    size_t mark = path.size();
+    path += node->prefix;
+
+    // Every key below starts with 'path'. If path > highKey they are all too
+    // large; if path < lowKey without being a prefix of it, they are all too small.
+    bool tooLarge = path > highKey;
+    bool tooSmall = path < lowKey && lowKey.compare(0, path.size(), path) != 0;
+    if (!tooLarge && !tooSmall) {
+        if (node->hasValue && path >= lowKey) {
+            result.push_back(node->value);
+        }
+        forEachChild(node, [&](uint8_t byte, const ARTNode* child) {
+            path.push_back(static_cast<char>(byte));
+            findRange(child, path, lowKey, highKey, result);
+            path.pop_back();
+        });
+    }
+    path.resize(mark);
+}
+
+void ARTree::collect(const ARTNode* node, std::string& path,
+                     std::vector<KeyType>* keys, std::vector<ValueType>* values) const {
+    size_t mark = path.size();
+    path += node->prefix;
+    if (node->hasValue) {
+        if (keys) {
+            keys->push_back(path);
+        }
+        if (values) {
+            values->push_back(node->value);
+        }
+    }
+    forEachChild(node, [&](uint8_t byte, const ARTNode* child) {
+        path.push_back(static_cast<char>(byte));
+        collect(child, path, keys, values);
+        path.pop_back();
+    });
+    path.resize(mark);
+}
+
+const ARTree::ARTNode* ARTree::findPrefixNode(const KeyType& prefix, std::string& path) const {
+    ARTNode* node = root;
+    size_t depth = 0;
+    while (node) {
+        // Compare as much of the node's prefix as the wanted prefix still covers.
+        size_t n = std::min(node->prefix.size(), prefix.size() - depth);
+        if (prefix.compare(depth, n, node->prefix, 0, n) != 0) {
+            return nullptr;
+        }
+        if (depth + node->prefix.size() >= prefix.size()) {
+            return node;                      // every key below starts with 'prefix'
+        }
+        depth += node->prefix.size();
+        path += node->prefix;
+
+        ARTNode** child = findChild(node, static_cast<uint8_t>(prefix[depth]));
+        if (!child) {
+            return nullptr;
+        }
+        path.push_back(prefix[depth]);
+        node = *child;
+        ++depth;
+    }
+    return nullptr;
+}
+
+std::vector<ARTree::ValueType> ARTree::findPrefix(const KeyType& prefix) const {
+    std::vector<ValueType> out;
+    std::string path;
+    if (const ARTNode* node = findPrefixNode(prefix, path)) {
+        collect(node, path, nullptr, &out);
+    }
+    return out;
+}
+
+std::vector<ARTree::KeyType> ARTree::keysWithPrefix(const KeyType& prefix) const {
+    std::vector<KeyType> out;
+    std::string path;
+    if (const ARTNode* node = findPrefixNode(prefix, path)) {
+        collect(node, path, &out, nullptr);
+    }
+    return out;
+}
+
+// Returns all keys currently stored, in sorted order
+std::vector<ARTree::KeyType> ARTree::keys() const {
+    std::vector<KeyType> result;
+    result.reserve(treeSize);
+    if (root) {
+        std::string path;
+        collect(root, path, &result, nullptr);
+    }
+    return result;
+}
+
+// Returns how many keys are in the tree.
+size_t ARTree::size() const {
+    return treeSize;
+}
+
+size_t ARTree::getHeight() const {
+    return root ? getHeight(root) : 0;
+}
+
+size_t ARTree::getHeight(const ARTNode* node) const {
+    size_t deepest = 0;
+    forEachChild(node, [&](uint8_t, const ARTNode* child) {
+        deepest = std::max(deepest, getHeight(child));
+    });
+    return 1 + deepest;
+}
+
+// copies the subtree rooted at 'other' and returns new root.
+ARTree::ARTNode* ARTree::copyTree(const ARTNode* other) {
+    if (!other) {
+        return nullptr;
+    }
+    ARTNode* n = makeNode(other->type, other->prefix);
+    n->hasValue = other->hasValue;
+    n->value = other->value;
+    forEachChild(other, [&](uint8_t byte, const ARTNode* child) {
+        placeChild(n, byte, copyTree(child));
+    });
+    return n;
+}
+
+//  deletes all nodes in subtree rooted at 'node'.
+void ARTree::clearTree(ARTNode* node) {
+    if (!node) {
+        return;
+    }
+    forEachChild(node, [this](uint8_t, ARTNode* child) {
+        clearTree(child);
+    });
+    destroyNode(node);
+}
+
+std::ostream& operator<<(std::ostream& os, const ARTree& tree) {
+    tree.printTree(os, tree.root);
+    return os;
+}
+
+// One line per node: compressed prefix, then ":value" if a key ends there.
+void ARTree::printTree(std::ostream& os, const ARTNode* node, size_t depth) const {
+    if (!node) {
+        return;
+    }
+    for (size_t i = 0; i < depth; ++i) {
+        os << "    ";
+    }
+    os << "\"" << node->prefix << "\"";
+    if (node->hasValue) {
+        os << ":" << node->value;
+    }
+    os << "\n";
+
+    forEachChild(node, [&](uint8_t byte, const ARTNode* child) {
+        for (size_t i = 0; i <= depth; ++i) {
+            os << "    ";
+        }
+        os << "'" << static_cast<char>(byte) << "'\n";
+        printTree(os, child, depth + 1);
+    });
+}
@@ -0,0 +1,187 @@
+#ifndef ARTREE_H
+#define ARTREE_H
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <iostream>
+#include <cstdint>
+#include <utility>
+
+// Adaptive radix tree (Leis et al., ICDE 2013) over string keys, with the same
+// interface as AVLTree. Lookups cost O(key length) byte steps instead of
+// O(log n) full string compares, and shared prefixes (URLs, paths) are stored
+// once thanks to path compression. Inner nodes come in four sizes (4, 16, 48,
+// 256 children) and grow / shrink as children are added and removed.
+// Iterating children in byte order visits keys in std::string order.
+class ARTree {
+public:
+    using KeyType   = std::string; // Keys stored in the tree
+    using ValueType = size_t;      // Values stored in the tree
+
+private:
+    enum class NodeType : uint8_t { Leaf, Node4, Node16, Node48, Node256 };
+
+    // Fields shared by all node types. A node stands for the key formed by
+    // the bytes on the path to it (each edge adds one byte) plus 'prefix'.
+    class ARTNode {
+    public:
+        NodeType  type;
+        uint16_t  count;     // Number of children
+        bool      hasValue;  // True if a key ends at this node
+        ValueType value;     // Value of that key
+        KeyType   prefix;    // Compressed path: bytes shared by everything below
+
+        ARTNode(NodeType t, KeyType p)
+            : type(t), count(0), hasValue(false), value(0), prefix(std::move(p)) {}
+    };
+
+    // Up to 4 / 16 children: sorted key bytes and matching child pointers.
+    class Node4 : public ARTNode {
+    public:
+        uint8_t  keys[4];
+        ARTNode* children[4];
+        explicit Node4(KeyType p) : ARTNode(NodeType::Node4, std::move(p)) {}
+    };
+
+    class Node16 : public ARTNode {
+    public:
+        uint8_t  keys[16];
+        ARTNode* children[16];
+        explicit Node16(KeyType p) : ARTNode(NodeType::Node16, std::move(p)) {}
+    };
+
+    // Up to 48 children: index[byte] is 1 + slot in 'children', 0 if absent.
+    class Node48 : public ARTNode {
+    public:
+        uint8_t  index[256];
+        ARTNode* children[48];
+        explicit Node48(KeyType p);
+    };
+
+    // One slot per byte.
+    class Node256 : public ARTNode {
+    public:
+        ARTNode* children[256];
+        explicit Node256(KeyType p);
+    };
+
+    // Pointer to the root node (nullptr if empty)
+    ARTNode* root;
+
+    // Number of key-value pairs stored in the tree
+    size_t treeSize;
+
+    // Child slot for 'byte', or nullptr if there is no such child.
+    static ARTNode** findChild(ARTNode* node, uint8_t byte);
+
+    // Adds 'child' under 'byte', replacing 'node' by a larger type if full.
+    static void addChild(ARTNode*& node, uint8_t byte, ARTNode* child);
+
+    // Removes the child under 'byte', replacing 'node' by a smaller type if sparse.
+    static void removeChild(ARTNode*& node, uint8_t byte);
+
+    // Stores 'child' under 'byte' in a node known to have room for it.
+    static void placeChild(ARTNode* node, uint8_t byte, ARTNode* child);
+
+    // Allocates an empty node of the given type.
+    static ARTNode* makeNode(NodeType type, KeyType prefix);
+
+    // Moves the shared fields and children of 'from' into a new node of 'type'
+    // and frees 'from'.
+    static ARTNode* resize(ARTNode* from, NodeType type);
+
+    // Calls visit(byte, child) for every child in byte order.
+    template <class Visit>
+    static void forEachChild(const ARTNode* node, Visit visit);
+
+    // Frees a single node (not its children).
+    static void destroyNode(ARTNode* node);
+
+    // After a removal: drops a node with no key and no children, and merges a
+    // keyless node with its only child (restoring path compression).
+    static void compress(ARTNode*& node);
+
+    // insert / remove below 'node', which matches key[0, depth).
+    bool insert(ARTNode*& node, const KeyType& key, size_t depth, ValueType value);
+    bool remove(ARTNode*& node, const KeyType& key, size_t depth);
+
+    // Returns the node where 'key' ends (with or without a value), or nullptr.
+    ARTNode* getNode(const KeyType& key) const;
+
+    //  adds all VALUES whose keys are in [lowKey, highKey] to 'result';
+    // 'path' is the key of 'node' without its prefix.
+    void findRange(const ARTNode* node, std::string& path,
+                   const KeyType& lowKey, const KeyType& highKey,
+                   std::vector<ValueType>& result) const;
+
+    // Appends every key (if 'keys') and value (if 'values') below 'node' in order.
+    void collect(const ARTNode* node, std::string& path,
+                 std::vector<KeyType>* keys, std::vector<ValueType>* values) const;
+
+    // Finds the node whose key starts with 'prefix' and is the shortest such;
+    // 'path' receives that node's key without its own prefix.
+    const ARTNode* findPrefixNode(const KeyType& prefix, std::string& path) const;
+
+    size_t getHeight(const ARTNode* node) const;
+
+    // Creates a deep copy of the subtree rooted at 'other' and returns the new root.
+    ARTNode* copyTree(const ARTNode* other);
+
+    //  deletes all nodes in subtree rooted at 'node'.
+    void clearTree(ARTNode* node);
+
+    void printTree(std::ostream& os, const ARTNode* node, size_t depth = 0) const;
+
+public:
+    //  constructor: creates an empty tree.
+    ARTree();
+
+    // Copy constructor: creates a copy of 'other'.
+    ARTree(const ARTree& other);
+
+    // Assignment operator: clears current tree, then copies 'other'.
+    ARTree& operator=(const ARTree& other);
+
+    // Destructor: frees all nodes.
+    ~ARTree();
+
+    // Inserts (key, value) into the tree.
+    // Returns true if a new entry is inserted, false if key already exists.
+    bool insert(const KeyType& key, ValueType value);
+
+    // Removes the given key from the tree.
+    // Returns true if an entry was removed, false if key not found.
+    bool remove(const KeyType& key);
+
+    // Returns true if the key exists in the tree; false otherwise.
+    bool contains(const KeyType& key) const;
+
+    // Returns the value associated with 'key', or std::nullopt.
+    std::optional<ValueType> get(const KeyType& key) const;
+
+    // Returns reference to value for 'key', inserting 0 if it is missing.
+    ValueType& operator[](const KeyType& key);
+
+    // Returns a vector of all VALUES whose keys lie between [lowKey, highKey].
+    std::vector<ValueType> findRange(const KeyType& lowKey,
+                                     const KeyType& highKey) const;
+
+    // Prefix scans: values / keys of every key starting with 'prefix', in key order.
+    std::vector<ValueType> findPrefix(const KeyType& prefix) const;
+    std::vector<KeyType> keysWithPrefix(const KeyType& prefix) const;
+
+    // Returns a vector of all keys currently stored in the tree, in sorted order.
+    std::vector<KeyType> keys() const;
+
+    // Returns how many key-value pairs are in the tree (O(1)).
+    size_t size() const;
+
+    // Returns the number of nodes on the longest root-to-leaf path.
+    size_t getHeight() const;
+
+    // printing using: std::cout << tree;
+    friend std::ostream& operator<<(std::ostream& os, const ARTree& tree);
+};
+
+#endif
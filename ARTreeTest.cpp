@@ -0,0 +1,150 @@
+/*
+Behaviour tests for ARTree, against a std::map holding what it should hold.
+ */
+#include "ARTree.h"
+#include "TestCheck.h"
+
+#include <cstdio>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+using Model = map<string, size_t>;
+
+static bool matches(const ARTree& tree, const Model& model) {
+    if (tree.size() != model.size()) {
+        return false;
+    }
+    vector<string> keys = tree.keys();
+    if (keys.size() != model.size()) {
+        return false;
+    }
+    size_t i = 0;
+    for (const auto& [k, v] : model) {
+        if (keys[i++] != k || tree.get(k) != optional<size_t>(v) || !tree.contains(k)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static vector<size_t> modelRange(const Model& model, const string& low, const string& high) {
+    vector<size_t> values;
+    for (auto it = model.lower_bound(low); it != model.end() && it->first <= high; ++it) {
+        values.push_back(it->second);
+    }
+    return values;
+}
+
+static vector<string> modelPrefix(const Model& model, const string& prefix) {
+    vector<string> keys;
+    for (auto it = model.lower_bound(prefix);
+         it != model.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it) {
+        keys.push_back(it->first);
+    }
+    return keys;
+}
+
+// Path-like keys from a small alphabet, so they share long prefixes and many
+// are prefixes of others.
+static string pathKey(mt19937& rng) {
+    static const char* parts[] = {"/", "usr", "lib", "a", "ab", "abc", "x", "share", "."};
+    string key;
+    size_t length = rng() % 6;
+    for (size_t i = 0; i < length; ++i) {
+        key += parts[rng() % 9];
+    }
+    return key;
+}
+
+static void testChurn() {
+    ARTree tree;
+    Model model;
+    mt19937 rng(56);
+    for (size_t i = 0; i < 40000; ++i) {
+        string k = pathKey(rng);
+        if (rng() % 3 == 0) {
+            CHECK(tree.remove(k) == (model.erase(k) == 1));
+        } else {
+            CHECK(tree.insert(k, i) == model.emplace(k, i).second);
+        }
+    }
+    CHECK(matches(tree, model));
+
+    for (const string prefix : {"", "/", "/usr", "abc", "ab", "x.", "zzz"}) {
+        vector<string> expected = modelPrefix(model, prefix);
+        CHECK(tree.keysWithPrefix(prefix) == expected);
+        vector<size_t> values;
+        for (const string& k : expected) {
+            values.push_back(model[k]);
+        }
+        CHECK(tree.findPrefix(prefix) == values);
+    }
+    CHECK(tree.findRange("/lib", "abc/") == modelRange(model, "/lib", "abc/"));
+    CHECK(tree.findRange("", "\xff") == modelRange(model, "", "\xff"));
+    CHECK(tree.findRange("x", "a").empty());
+
+    for (const auto& [k, v] : model) {
+        CHECK(tree.remove(k));
+    }
+    CHECK(tree.size() == 0);
+    CHECK(tree.keys().empty());
+}
+
+// One inner node goes through every size (4, 16, 48, 256 children) and back.
+static void testNodeGrowth() {
+    ARTree tree;
+    Model model;
+    for (int i = 255; i >= 0; --i) {
+        string k = "node" + string(1, static_cast<char>(i));
+        tree.insert(k, i);
+        model[k] = i;
+        CHECK(tree.get(k) == optional<size_t>(i));
+    }
+    tree.insert("node", 1000);
+    model["node"] = 1000;
+    CHECK(matches(tree, model));
+
+    for (int i = 0; i < 256; i += 2) {
+        string k = "node" + string(1, static_cast<char>(i));
+        CHECK(tree.remove(k));
+        model.erase(k);
+    }
+    CHECK(matches(tree, model));
+    for (int i = 1; i < 256; i += 2) {
+        string k = "node" + string(1, static_cast<char>(i));
+        CHECK(tree.remove(k));
+        model.erase(k);
+    }
+    CHECK(matches(tree, model));
+    CHECK(tree.getHeight() == 1);
+}
+
+static void testIndexAndCopy() {
+    ARTree tree;
+    tree["a"] += 2;
+    tree["ab"] += 3;
+    tree["a"] += 4;
+    CHECK(tree.get("a") == optional<size_t>(6));
+    CHECK(tree.get("ab") == optional<size_t>(3));
+    CHECK(!tree.contains("abc"));
+
+    ARTree copy(tree);
+    copy.remove("a");
+    CHECK(tree.get("a") == optional<size_t>(6));
+    CHECK(!copy.contains("a"));
+    CHECK(copy.contains("ab"));
+
+    tree = copy;
+    CHECK(tree.keys() == copy.keys());
+    CHECK(tree.size() == 1);
+}
+
+int main() {
+    testChurn();
+    testNodeGrowth();
+    testIndexAndCopy();
+    return testResult();
+}
@@ -6,56 +6,308 @@ AVL tree remains balanced by implementing single and double and triple rotations
 
 
 #include "AVLTree.h"
+#include "KeyCompare.h"
+#include "KeyPrefix.h"
+
+#include <new>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 
 // Default constructor: start with an empty tree.
-AVLTree::AVLTree() : root(nullptr), treeSize(0) {}
+template <class Balance>
+BalancedTree<Balance>::BalancedTree()
+    : root(nullptr), treeSize(0), rebalanceSlack(0),
+      arena(std::make_shared<NodeArena>(sizeof(AVLNode), alignof(AVLNode))) {}
 
-// Copy constructor: deep-copy the other tree.
-AVLTree::AVLTree(const AVLTree& other) : root(nullptr), treeSize(0) {
-    root = copyTree(other.root);      // copy the whole structure
+// Copy constructor: share the other tree's nodes (copy-on-write).
+template <class Balance>
+BalancedTree<Balance>::BalancedTree(const BalancedTree& other)
+    : root(nullptr), treeSize(0), rebalanceSlack(other.rebalanceSlack), arena(other.arena),
+      reclaimer(other.reclaimer) {
+    if (other.compactTarget) {
+        // Halfway through compactStep the nodes sit in two arenas: deep-copy.
+        arena = std::make_shared<NodeArena>(sizeof(AVLNode), alignof(AVLNode));
+        root = copyTree(other.root);
+    } else {
+        root = other.root;
+        if (root) {
+            root->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
     treeSize = other.treeSize;        // copy the size
 }
 
-// Assignment operator: clear current tree, then deep-copy other.
-AVLTree& AVLTree::operator=(const AVLTree& other) {
+// Assignment operator: drop the current tree, then share other's.
+template <class Balance>
+BalancedTree<Balance>& BalancedTree<Balance>::operator=(const BalancedTree& other) {
     if (this != &other) {
-        clearTree(root);              // delete current tree
-        root = copyTree(other.root);  // copies other's tree
-        treeSize = other.treeSize;
+        BalancedTree copy(other);
+        swap(copy);                   // the old tree is released with 'copy'
     }
     return *this;
 }
 
+// Move constructor: start empty, then trade places with 'other'.
+template <class Balance>
+BalancedTree<Balance>::BalancedTree(BalancedTree&& other) noexcept : BalancedTree() {
+    swap(other);
+}
+
+// Move assignment: the old contents go to 'other' and are freed with it.
+template <class Balance>
+BalancedTree<Balance>& BalancedTree<Balance>::operator=(BalancedTree&& other) noexcept {
+    swap(other);
+    return *this;
+}
+
+template <class Balance>
+void BalancedTree<Balance>::swap(BalancedTree& other) noexcept {
+    swapNodes(other);
+    reclaimer.swap(other.reclaimer);
+    sequence.swap(other.sequence);
+}
+
+template <class Balance>
+void BalancedTree<Balance>::swapNodes(BalancedTree& other) noexcept {
+    AVLNode* mine = root;
+    storeLink(root, other.root);
+    storeLink(other.root, mine);
+    std::swap(treeSize, other.treeSize);
+    std::swap(rebalanceSlack, other.rebalanceSlack);
+    std::swap(policy, other.policy);
+    arena.swap(other.arena);
+    compactTarget.swap(other.compactTarget);
+    compactCursor.swap(other.compactCursor);
+    frozenTop.swap(other.frozenTop);
+}
+
 // Destructor: free all nodes.
-AVLTree::~AVLTree() {
-    clearTree(root);
+template <class Balance>
+BalancedTree<Balance>::~BalancedTree() {
+    quiesce();
+    // An arena used by this tree alone frees the memory itself.
+    clearTree(root, isShared() ? arena.get() : nullptr, compactTarget.get());
+}
+
+template <class Balance>
+void BalancedTree<Balance>::clear() {
+    WriteSection write(*this);
+    releaseAll();
+}
+
+// The detached nodes and their memory, destroyed on another thread.
+template <class Balance>
+void BalancedTree<Balance>::clearAsync() {
+    WriteSection write(*this);
+    struct Detached {
+        AVLNode* root;
+        std::shared_ptr<NodeArena> arena;
+        std::unique_ptr<NodeArena> compactTarget;
+        std::shared_ptr<EpochReclaimer> reclaimer;
+    };
+
+    auto detached = std::make_unique<Detached>(
+        Detached{root, std::move(arena), std::move(compactTarget), reclaimer});
+    arena = std::make_shared<NodeArena>(sizeof(AVLNode), alignof(AVLNode));
+    arena->setNumaNode(detached->arena->getNumaNode());
+
+    storeLink(root, nullptr);
+    treeSize = 0;
+    compactCursor.reset();
+    frozenTop.clear();
+
+    std::thread([garbage = std::move(detached)] {
+        if (garbage->reclaimer) {
+            garbage->reclaimer->flush();      // readers may still be on the old nodes
+        }
+        NodeArena* shared = garbage->arena.use_count() > 1 ? garbage->arena.get() : nullptr;
+        clearTree(garbage->root, shared, garbage->compactTarget.get());
+    }).detach();
+}
+
+template <class Balance>
+void BalancedTree<Balance>::releaseAll() {
+    AVLNode* old = root;
+    storeLink(root, nullptr);
+    quiesce();                        // readers may still be on the old nodes
+    if (isShared()) {
+        clearTree(old, arena.get(), compactTarget.get());
+        int numaNode = arena->getNumaNode();
+        arena = std::make_shared<NodeArena>(sizeof(AVLNode), alignof(AVLNode));
+        arena->setNumaNode(numaNode);
+    } else {
+        clearTree(old, nullptr, nullptr);
+        arena->clear();
+    }
+    compactTarget.reset();
+    compactCursor.reset();
+    frozenTop.clear();
+    treeSize = 0;
+}
+
+template <class Balance>
+typename BalancedTree<Balance>::AVLNode*
+BalancedTree<Balance>::loadLink(AVLNode* const& link) {
+    return std::atomic_ref<AVLNode*>(const_cast<AVLNode*&>(link)).load(std::memory_order_acquire);
+}
+
+template <class Balance>
+void BalancedTree<Balance>::storeLink(AVLNode*& link, AVLNode* node) {
+    std::atomic_ref<AVLNode*>(link).store(node, std::memory_order_release);
+}
+
+// Nodes live in the tree's arena instead of the general heap.
+template <class Balance>
+typename BalancedTree<Balance>::AVLNode*
+BalancedTree<Balance>::newNode(const KeyType& key, ValueType value) {
+    // During an incremental compaction new nodes go straight to the new arena.
+    NodeArena& from = compactTarget ? *compactTarget : *arena;
+    return new (from.allocate()) AVLNode(key, value);
+}
+
+template <class Balance>
+void BalancedTree<Balance>::deleteNode(AVLNode* node) {
+    NodeArena* from = compactTarget && compactTarget->owns(node) ? compactTarget.get() : arena.get();
+    if (reclaimer) {
+        reclaimer->retire(node, &destroyRetired, from);
+        return;
+    }
+    node->~AVLNode();
+    from->release(node);
+}
+
+template <class Balance>
+void BalancedTree<Balance>::destroyRetired(void* node, void* arena) {
+    static_cast<AVLNode*>(node)->~AVLNode();
+    static_cast<NodeArena*>(arena)->release(node);
+}
+
+template <class Balance>
+void BalancedTree<Balance>::releaseRetired(void* node, void* arena) {
+    clearTree(static_cast<AVLNode*>(node), static_cast<NodeArena*>(arena), nullptr);
+}
+
+template <class Balance>
+void BalancedTree<Balance>::quiesce() {
+    if (reclaimer) {
+        reclaimer->flush();
+    }
+}
+
+template <class Balance>
+typename BalancedTree<Balance>::AVLNode*
+BalancedTree<Balance>::relocate(AVLNode* node, NodeArena& to, bool steal) {
+    AVLNode* copy = new (to.allocate())
+        AVLNode(steal ? std::move(node->key) : node->key, node->value);
+    copy->height = node->height;
+    copy->meta = node->meta;
+    copy->left = node->left;
+    copy->right = node->right;
+    return copy;
+}
+
+// ---------------------------------------------------------------------------
+// Copy-on-write. Copies share the arena, so isShared() is false exactly when
+// every node belongs to this tree alone. Nodes are unshared top-down: the
+// link being replaced always sits in a node (or root) this tree owns.
+
+template <class Balance>
+bool BalancedTree<Balance>::isShared() const {
+    return arena.use_count() > 1;
+}
+
+template <class Balance>
+void BalancedTree<Balance>::unshare(AVLNode*& link) {
+    if (!link || link->refs.load(std::memory_order_acquire) == 1) {
+        return;
+    }
+    NodeArena& to = compactTarget ? *compactTarget : *arena;
+    AVLNode* copy = relocate(link, to, false);
+    if (copy->left) {
+        copy->left->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (copy->right) {
+        copy->right->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    releaseNode(link);
+    storeLink(link, copy);
+    frozenTop.clear();                // it may point at the node just released
 }
 
+template <class Balance>
+void BalancedTree<Balance>::unshareSubtree(AVLNode*& link) {
+    if (!link) {
+        return;
+    }
+    unshare(link);
+    unshareSubtree(link->left);
+    unshareSubtree(link->right);
+}
+
+// Shared nodes only ever live in 'arena': a tree in the middle of
+// compactStep is deep-copied, so nodes in compactTarget are never shared.
+template <class Balance>
+void BalancedTree<Balance>::releaseNode(AVLNode* node) {
+    if (reclaimer) {
+        reclaimer->retire(node, &releaseRetired, arena.get());
+        return;
+    }
+    clearTree(node, arena.get(), compactTarget.get());
+}
+
+template <class Balance>
+typename BalancedTree<Balance>::AVLNode*
+BalancedTree<Balance>::getUniqueNode(AVLNode*& node, const KeyType& key) {
+    if (!node) {
+        return nullptr;
+    }
+    unshare(node);
+    int cmp = compareKeys(key, node->key);
+    if (cmp < 0) {
+        return getUniqueNode(node->left, key);
+    }
+    if (cmp > 0) {
+        return getUniqueNode(node->right, key);
+    }
+    return node;
+}
+
+// ---------------------------------------------------------------------------
+
 //  insert: inserts (key, value) starting from root.
-bool AVLTree::insert(const KeyType& key, ValueType value) {
+template <class Balance>
+bool BalancedTree<Balance>::insert(const KeyType& key, ValueType value) {
+    WriteSection write(*this);
     bool inserted = insert(root, key, value);
     if (inserted) {
         ++treeSize;                            // count new nodes
+        frozenTop.clear();                     // rotations may have changed the top levels
     }
     return inserted;
 }
 
-bool AVLTree::insert(AVLNode*& node, const KeyType& key, ValueType value) {
+template <class Balance>
+bool BalancedTree<Balance>::insert(AVLNode*& node, const KeyType& key, ValueType value,
+                                   AVLNode* fresh) {
     // if an empty place is found then it creates a new node.
     if (!node) {
-        node = new AVLNode(key, value);
+        storeLink(node, fresh ? fresh : newNode(key, value));
         return true;
     }
+    unshare(node);
 
     // Decides whether to go to the left or right subtree:
-    if (key < node->key) {
+    int cmp = compareKeys(key, node->key);
+    if (cmp < 0) {
         // Insert into the left subtree.
-        if (!insert(node->left, key, value)) {
+        if (!insert(node->left, key, value, fresh)) {
             return false;
         }
-    } else if (key > node->key) {
+    } else if (cmp > 0) {
         // Insert into the right subtree.
-        if (!insert(node->right, key, value)) {
+        if (!insert(node->right, key, value, fresh)) {
             return false;
         }
     } else {
@@ -64,32 +316,74 @@ bool AVLTree::insert(AVLNode*& node, const KeyType& key, ValueType value) {
     }
 
     //  update height and rebalance.
-    node->updateHeight();
-    balanceNode(node);
+    rebalanceAfterInsert(node);
     return true;
 }
 
+// append: fast path for keys arriving in increasing order (log-style ingestion).
+template <class Balance>
+bool BalancedTree<Balance>::append(const KeyType& key, ValueType value) {
+    {
+        WriteSection write(*this);
+        if (appendRight(root, key, value)) {
+            ++treeSize;
+            frozenTop.clear();
+            return true;
+        }
+    }
+    return insert(key, value);                // not a new maximum → normal insert
+}
+
+template <class Balance>
+bool BalancedTree<Balance>::appendRight(AVLNode*& node, const KeyType& key, ValueType value) {
+    if (!node) {
+        // Only reached for an empty tree; otherwise we stop at the rightmost node.
+        storeLink(node, newNode(key, value));
+        return true;
+    }
+    unshare(node);
+
+    if (!node->right) {
+        // node is the current maximum: this is the only key comparison.
+        if (compareKeys(node->key, key) >= 0) {
+            return false;
+        }
+        storeLink(node->right, newNode(key, value));
+    } else if (!appendRight(node->right, key, value)) {
+        return false;
+    }
+
+    //  update height and rebalance the spine node.
+    rebalanceAfterInsert(node);
+    return true;
+}
 
 //  remove: remove given key from the tree, starting from root.
-bool AVLTree::remove(const KeyType& key) {
+template <class Balance>
+bool BalancedTree<Balance>::remove(const KeyType& key) {
+    WriteSection write(*this);
     bool removed = remove(root, key);
     if (removed) {
         --treeSize;                   // decrease count if something is removed
+        frozenTop.clear();
     }
     return removed;
 }
 
-bool AVLTree::remove(AVLNode*& node, const KeyType& key) {
+template <class Balance>
+bool BalancedTree<Balance>::remove(AVLNode*& node, const KeyType& key) {
     if (!node) {
         return false;                 // key not found
     }
+    unshare(node);
 
     bool removed;
+    int cmp = compareKeys(key, node->key);
 
-    if (key < node->key) {
+    if (cmp < 0) {
         // Search and remove in left subtree.
         removed = remove(node->left, key);
-    } else if (key > node->key) {
+    } else if (cmp > 0) {
         // Search and remove in right subtree.
         removed = remove(node->right, key);
     } else {
@@ -99,13 +393,13 @@ bool AVLTree::remove(AVLNode*& node, const KeyType& key) {
 
     // If after removal the node still exists, update its height and rebalance.
     if (node) {
-        node->updateHeight();
-        balanceNode(node);
+        rebalanceAfterRemove(node);
     }
     return removed;
 }
 
-bool AVLTree::removeNode(AVLNode*& node) {
+template <class Balance>
+bool BalancedTree<Balance>::removeNode(AVLNode*& node) {
     if (!node) {
         return false;
     }
@@ -115,31 +409,65 @@ bool AVLTree::removeNode(AVLNode*& node) {
 
     if (children == 0) {
         // Case 1: leaf node → just delete it.
-        node = nullptr;
-        delete old;
+        storeLink(node, nullptr);
+        rebalanceAfterUnlink(old, node);
+        deleteNode(old);
     }
     else if (children == 1) {
         // Case 2: one child → replace node with its single child.
-        node = (node->left ? node->left : node->right);
-        delete old;
+        storeLink(node, node->left ? node->left : node->right);
+        unshare(node);                // rebalanced in place from here on
+        rebalanceAfterUnlink(old, node);
+        deleteNode(old);
     }
     else {
         // Case 3: two children.
         // Find inorder successor (smallest in right subtree).
         AVLNode* succ = findMin(node->right);
 
-        // Copy successor's key/value into current node.
-        node->key = succ->key;
-        node->value = succ->value;
+        if (reclaimer) {
+            // Lock-free readers may be comparing against node->key: the
+            // successor's key goes into a node of its own instead.
+            AVLNode* copy = newNode(succ->key, succ->value);
+            copy->height = node->height;
+            copy->meta = node->meta;
+            copy->left = node->left;
+            copy->right = node->right;
+            storeLink(node, copy);
+            deleteNode(old);
+        } else if (isShared()) {
+            // Copy successor's key/value into current node.
+            node->key = succ->key;
+            node->value = succ->value;
+        } else {
+            // 'succ' is ours alone and goes next: take its key, no copy.
+            std::swap(node->key, succ->key);
+            node->value = succ->value;
+        }
 
-        // Now delete the successor node from the right subtree.
-        return remove(node->right, succ->key);
+        // Now delete the successor, the leftmost node of the right subtree.
+        removeMin(node->right);
     }
     return true;
 }
 
+template <class Balance>
+void BalancedTree<Balance>::removeMin(AVLNode*& node) {
+    unshare(node);
+    if (node->left) {
+        removeMin(node->left);
+    } else {
+        removeNode(node);
+    }
+    if (node) {
+        rebalanceAfterRemove(node);
+    }
+}
+
 // Finds node with smallest key in a subtree (left-most node).
-AVLTree::AVLNode* AVLTree::findMin(AVLNode* node) const {
+template <class Balance>
+typename BalancedTree<Balance>::AVLNode*
+BalancedTree<Balance>::findMin(AVLNode* node) const {
     if (!node) {
         return nullptr;
     }
@@ -151,102 +479,233 @@ AVLTree::AVLNode* AVLTree::findMin(AVLNode* node) const {
 
 
 // contains: tells if 'key' is in the tree.
-bool AVLTree::contains(const KeyType& key) const {
-    return contains(root, key);
+template <class Balance>
+bool BalancedTree<Balance>::contains(const KeyType& key) const {
+    if (sequence) {
+        return getOptimistic(key).has_value();
+    }
+    return contains(frozenDescend(key), key);
 }
 
 //  contains: checks subtree rooted at 'node'.
-bool AVLTree::contains(const AVLNode* node, const KeyType& key) const {
+template <class Balance>
+bool BalancedTree<Balance>::contains(const AVLNode* node, const KeyType& key) const {
     if (!node) {
         return false;
     }
-    if (key < node->key) {
+    int cmp = compareKeys(key, node->key);
+    if (cmp < 0) {
         return contains(node->left, key);
     }
-    if (key > node->key) {
+    if (cmp > 0) {
         return contains(node->right, key);
     }
     return true;
 }
 
 // Returns the value for 'key' . If key not found, returns std::nullopt.
-std::optional<AVLTree::ValueType>
-AVLTree::get(const KeyType& key) const {
-    AVLNode* found = getNode(root, key);
+template <class Balance>
+std::optional<typename BalancedTree<Balance>::ValueType>
+BalancedTree<Balance>::get(const KeyType& key) const {
+    if (sequence) {
+        return getOptimistic(key);
+    }
+    AVLNode* found = getNode(frozenDescend(key), key);
     return found ? std::optional<ValueType>(found->value) : std::nullopt;
 }
 
 // finds and returns the node pointer for 'key' in subtree.
-AVLTree::AVLNode*
-AVLTree::getNode(AVLNode* node, const KeyType& key) const {
+template <class Balance>
+typename BalancedTree<Balance>::AVLNode*
+BalancedTree<Balance>::getNode(AVLNode* node, const KeyType& key) const {
     if (!node) {
         return nullptr;
     }
-    if (key < node->key) {
+    int cmp = compareKeys(key, node->key);
+    if (cmp < 0) {
         return getNode(node->left, key);
     }
-    if (key > node->key) {
+    if (cmp > 0) {
         return getNode(node->right, key);
     }
     return node;
 }
 
+// Steps between checks of the counter during an optimistic walk. A walk that
+// races a writer can follow links in any state, even around a cycle; the
+// check makes it give up once the counter has moved.
+static constexpr size_t OptimisticCheckSteps = 64;
+
+// Everything read between the two counter loads is thrown away unless they
+// match. The nodes seen stay valid while pinned: nothing is freed, and keys
+// are never rewritten, while a reclaimer is set.
+template <class Balance>
+std::optional<typename BalancedTree<Balance>::ValueType>
+BalancedTree<Balance>::getOptimistic(const KeyType& key) const {
+    for (;;) {
+        {
+            EpochReclaimer::Guard pin(*reclaimer);
+            uint64_t before = sequence->load(std::memory_order_acquire);
+            if (!(before & 1)) {
+                const AVLNode* node = loadLink(root);
+                bool moved = false;
+                for (size_t steps = 1; node; ++steps) {
+                    int cmp = compareKeys(key, node->key);
+                    if (cmp == 0) {
+                        break;
+                    }
+                    node = loadLink(cmp < 0 ? node->left : node->right);
+                    if (steps % OptimisticCheckSteps == 0
+                        && sequence->load(std::memory_order_acquire) != before) {
+                        moved = true;
+                        break;
+                    }
+                }
+                std::optional<ValueType> found;
+                if (node) {
+                    // Kept only if the counter has not moved (checked below).
+                    found = std::atomic_ref<ValueType>(const_cast<ValueType&>(node->value))
+                                .load(std::memory_order_relaxed);
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (!moved && sequence->load(std::memory_order_relaxed) == before) {
+                    return found;
+                }
+            }
+        }
+        std::this_thread::yield();            // a writer is inside: let it finish
+    }
+}
+
+// Writers take the counter from even to odd, so they also exclude each other.
+template <class Balance>
+BalancedTree<Balance>::WriteSection::WriteSection(const BalancedTree& tree)
+    : sequence(tree.sequence.get()) {
+    if (!sequence) {
+        return;
+    }
+    uint64_t current = sequence->load(std::memory_order_relaxed);
+    while ((current & 1)
+           || !sequence->compare_exchange_weak(current, current + 1, std::memory_order_acquire,
+                                               std::memory_order_relaxed)) {
+        if (current & 1) {
+            std::this_thread::yield();
+            current = sequence->load(std::memory_order_relaxed);
+        }
+    }
+    std::atomic_thread_fence(std::memory_order_release);  // odd before any change
+}
+
+template <class Balance>
+BalancedTree<Balance>::WriteSection::~WriteSection() {
+    if (sequence) {
+        sequence->fetch_add(1, std::memory_order_release);
+    }
+}
+
 
 // returns reference to value for 'key'.
-AVLTree::ValueType&
-AVLTree::operator[](const KeyType& key) {
-    AVLNode* node = getNode(root, key);
-    //if (!node) {
-        // Key not found → insert with default value 0.
-       // insert(key, 0);
-     //   node = getNode(root, key);
- //   }
-    return node->value;
+template <class Balance>
+typename BalancedTree<Balance>::ValueType&
+BalancedTree<Balance>::operator[](const KeyType& key) {
+    if (!isShared() && isFrozen()) {
+        // Read-mostly: the index finds an existing key faster.
+        if (AVLNode* node = getNode(frozenDescend(key), key)) {
+            return node->value;
+        }
+    }
+    // Key not found → insert with default value 0.
+    return findOrInsert(key, 0).first;
+}
+
+template <class Balance>
+std::pair<typename BalancedTree<Balance>::ValueType&, bool>
+BalancedTree<Balance>::findOrInsert(const KeyType& key, ValueType value) {
+    WriteSection write(*this);
+    bool inserted = false;
+    AVLNode* node = findOrInsert(root, key, value, inserted);
+    if (inserted) {
+        ++treeSize;
+        frozenTop.clear();
+    }
+    return {node->value, inserted};
+}
+
+// Like insert, but an existing key ends the descent with its node. Only the
+// path is unshared, and the new node is ours alone, so nothing on the way
+// back up moves it.
+template <class Balance>
+typename BalancedTree<Balance>::AVLNode*
+BalancedTree<Balance>::findOrInsert(AVLNode*& node, const KeyType& key, ValueType value,
+                                    bool& inserted) {
+    if (!node) {
+        storeLink(node, newNode(key, value));
+        inserted = true;
+        return node;
+    }
+    unshare(node);
+
+    int cmp = compareKeys(key, node->key);
+    if (cmp == 0) {
+        return node;
+    }
+    AVLNode* found = findOrInsert(cmp < 0 ? node->left : node->right, key, value, inserted);
+    if (inserted) {
+        rebalanceAfterInsert(node);
+    }
+    return found;
 }
 
 // Returns vector of VALUES whose keys lie between [lowKey, highKey] (inclusive).
-std::vector<AVLTree::ValueType>
-AVLTree::findRange(const KeyType& lowKey,
-                   const KeyType& highKey) const {
+template <class Balance>
+std::vector<typename BalancedTree<Balance>::ValueType>
+BalancedTree<Balance>::findRange(const KeyType& lowKey,
+                                 const KeyType& highKey) const {
     std::vector<ValueType> out;
     findRange(root, lowKey, highKey, out);
     return out;
 }
 
-void AVLTree::findRange(const AVLNode* node,
-                        const KeyType& lowKey,
-                        const KeyType& highKey,
-                        std::vector<ValueType>& result) const {
+template <class Balance>
+void BalancedTree<Balance>::findRange(const AVLNode* node,
+                                      const KeyType& lowKey,
+                                      const KeyType& highKey,
+                                      std::vector<ValueType>& result) const {
     if (!node) {
         return;
     }
 
+    int cmpLow  = compareKeys(node->key, lowKey);
+    int cmpHigh = compareKeys(node->key, highKey);
+
     // If node's key is greater than lowKey,  left subtree.
-    if (node->key > lowKey) {
+    if (cmpLow > 0) {
         findRange(node->left, lowKey, highKey, result);
     }
 
     // If node's key lies within [lowKey, highKey], include its value.
-    if (node->key >= lowKey && node->key <= highKey) {
+    if (cmpLow >= 0 && cmpHigh <= 0) {
         result.push_back(node->value);
     }
 
     // If node's key is less than highKey,  right subtree.
-    if (node->key < highKey) {
+    if (cmpHigh < 0) {
         findRange(node->right, lowKey, highKey, result);
     }
 }
 
 // Returns all keys currently stored, in sorted order
-std::vector<AVLTree::KeyType>
-AVLTree::keys() const {
+template <class Balance>
+std::vector<typename BalancedTree<Balance>::KeyType>
+BalancedTree<Balance>::keys() const {
     std::vector<KeyType> result;
     getKeys(root, result);
     return result;
 }
 
-void AVLTree::getKeys(const AVLNode* node,
-                      std::vector<KeyType>& result) const {
+template <class Balance>
+void BalancedTree<Balance>::getKeys(const AVLNode* node,
+                                    std::vector<KeyType>& result) const {
     if (!node) {
         return;
     }
@@ -256,42 +715,96 @@ void AVLTree::getKeys(const AVLNode* node,
 }
 
 // Returns how many nodes are in the tree.
-size_t AVLTree::size() const {
+template <class Balance>
+size_t BalancedTree<Balance>::size() const {
     return treeSize;
 }
 
+template <class Balance>
+size_t BalancedTree<Balance>::reservedBytes() const {
+    return arena->reservedBytes() + (compactTarget ? compactTarget->reservedBytes() : 0);
+}
+
+template <class Balance>
+size_t BalancedTree<Balance>::hugePageBytes() const {
+    return arena->hugePageBytes() + (compactTarget ? compactTarget->hugePageBytes() : 0);
+}
+
+template <class Balance>
+void BalancedTree<Balance>::setNumaNode(int node) {
+    arena->setNumaNode(node);
+}
+
+template <class Balance>
+void BalancedTree<Balance>::setReclaimer(std::shared_ptr<EpochReclaimer> r) {
+    quiesce();                        // nothing retired to the old one stays behind
+    reclaimer = std::move(r);
+}
+
+template <class Balance>
+const std::shared_ptr<EpochReclaimer>& BalancedTree<Balance>::getReclaimer() const {
+    return reclaimer;
+}
+
+template <class Balance>
+void BalancedTree<Balance>::setSeqlock(bool on) {
+    if (!on) {
+        sequence.reset();
+        return;
+    }
+    if (!reclaimer) {
+        reclaimer = std::make_shared<EpochReclaimer>();
+    }
+    if (!sequence) {
+        sequence = std::make_unique<std::atomic<uint64_t>>(0);
+    }
+}
+
+template <class Balance>
+bool BalancedTree<Balance>::isSeqlocked() const {
+    return sequence != nullptr;
+}
+
 // Returns height of the tree (height of root, or 0 if empty).
-size_t AVLTree::getHeight() const {
+template <class Balance>
+size_t BalancedTree<Balance>::getHeight() const {
     return root ? root->height : 0;
 }
 // Left rotation around 'node'
-void AVLTree::rotateLeft(AVLNode*& node) {
+template <class Balance>
+void BalancedTree<Balance>::rotateLeft(AVLNode*& node) {
+    unshare(node);
+    unshare(node->right);
     AVLNode* newRoot = node->right;   // right child becomes new root of this subtree
 
-    node->right = newRoot->left;      // move newRoot's left subtree over
-    newRoot->left = node;             // current node becomes left child
+    storeLink(node->right, newRoot->left);   // move newRoot's left subtree over
+    storeLink(newRoot->left, node);          // current node becomes left child
 
     node->updateHeight();             // update heights after  change
     newRoot->updateHeight();
 
-    node = newRoot;                   // update the reference to point to new root
+    storeLink(node, newRoot);                // update the reference to point to new root
 }
 
 // Right rotation around 'node'.
-void AVLTree::rotateRight(AVLNode*& node) {
+template <class Balance>
+void BalancedTree<Balance>::rotateRight(AVLNode*& node) {
+    unshare(node);
+    unshare(node->left);
     AVLNode* newRoot = node->left;    // left child becomes new root
 
-    node->left = newRoot->right;      // move newRoot's right subtree over
-    newRoot->right = node;            // current node becomes right child
+    storeLink(node->left, newRoot->right);   // move newRoot's right subtree over
+    storeLink(newRoot->right, node);         // current node becomes right child
 
     node->updateHeight();
     newRoot->updateHeight();
 
-    node = newRoot;
+    storeLink(node, newRoot);
 }
 
 // Checks node's balance factor and performs necessary  rotation.
-void AVLTree::balanceNode(AVLNode*& node) {
+template <class Balance>
+void BalancedTree<Balance>::balanceNode(AVLNode*& node) {
     if (!node) {
         return;
     }
@@ -318,38 +831,943 @@ void AVLTree::balanceNode(AVLNode*& node) {
     }
 }
 
+// ---------------------------------------------------------------------------
+// AVL: recompute the height from the children and rotate if |balance| > 1
+// (or, in relaxed mode, only once the slack is exceeded).
+
+// Only AVL trees defer rebalancing; other policies have nothing to mark.
+template <class Balance>
+void BalancedTree<Balance>::markDirty(AVLNode*) {}
+
+template <>
+void BalancedTree<AVLBalance>::markDirty(AVLNode* node) {
+    node->meta.dirty = std::abs(node->getBalance()) > 1
+                       || (node->left  && node->left->meta.dirty)
+                       || (node->right && node->right->meta.dirty);
+}
+
+// An insert or remove moves the balance of each node on its path by at most
+// one (a rotation below changes a subtree's height by at most one too), so a
+// node leaves the slack at exactly 2 + slack. One single or double rotation,
+// the same one strict mode does, then brings it and the nodes it moves back
+// within 1 + slack: a bounded amount of work, like strict mode.
+template <>
+void BalancedTree<AVLBalance>::balanceWithSlack(AVLNode*& node) {
+    if (rebalanceSlack == 0) {
+        balanceNode(node);
+        return;
+    }
+    // Within the slack: keep the node as is, only mark it dirty.
+    // A child the rotation brought up still shared is unchanged below, so
+    // its flag still holds; being shared, it must not be written anyway.
+    if (static_cast<size_t>(std::abs(node->getBalance())) > 1 + rebalanceSlack) {
+        balanceNode(node);
+        for (AVLNode* child : {node->left, node->right}) {
+            if (child && child->refs.load(std::memory_order_acquire) == 1) {
+                markDirty(child);
+            }
+        }
+    }
+    markDirty(node);
+}
+
+template <>
+void BalancedTree<AVLBalance>::rebalanceAfterInsert(AVLNode*& node) {
+    node->updateHeight();
+    balanceWithSlack(node);
+}
+
+template <>
+void BalancedTree<AVLBalance>::rebalanceAfterRemove(AVLNode*& node) {
+    node->updateHeight();
+    balanceWithSlack(node);
+}
+
+template <>
+void BalancedTree<AVLBalance>::rebalanceAfterUnlink(const AVLNode*, AVLNode*&) {}
+
+// ---------------------------------------------------------------------------
+// WAVL (weak AVL, Haeupler-Sen-Tarjan). A null child has rank 0 and a leaf
+// has rank 1; every rank difference (parent rank - child rank) must be 1 or 2,
+// and leaves must be 1,1 nodes. Rotations keep 'height' up to date; ranks are
+// set explicitly afterwards.
+
+// Called after a node was added below 'node'. The child we came from may
+// now have the same rank as 'node' (a 0-child): promote, or rotate and stop.
+template <>
+void BalancedTree<WAVLBalance>::rebalanceAfterInsert(AVLNode*& node) {
+    node->updateHeight();
+
+    size_t r = node->meta.rank;
+    bool leftIsZero = node->left && node->left->meta.rank == r;
+    bool rightIsZero = node->right && node->right->meta.rank == r;
+
+    if (leftIsZero) {
+        size_t siblingRank = node->right ? node->right->meta.rank : 0;
+        if (r - siblingRank == 1) {
+            ++node->meta.rank;                // promote; parent checks next
+            return;
+        }
+        unshare(node->left);
+        AVLNode* x = node->left;
+        AVLNode* y = x->right;
+        size_t yRank = y ? y->meta.rank : 0;
+        if (r - yRank == 2) {
+            // Single rotation: x moves up keeping rank r, node drops to r - 1.
+            AVLNode* old = node;
+            rotateRight(node);
+            node->meta.rank = r;
+            old->meta.rank = r - 1;
+        } else {
+            // Double rotation: y moves up to rank r, x and node drop to r - 1.
+            AVLNode* old = node;
+            rotateLeft(node->left);
+            rotateRight(node);
+            node->meta.rank = r;
+            x->meta.rank = r - 1;
+            old->meta.rank = r - 1;
+        }
+    } else if (rightIsZero) {
+        size_t siblingRank = node->left ? node->left->meta.rank : 0;
+        if (r - siblingRank == 1) {
+            ++node->meta.rank;
+            return;
+        }
+        unshare(node->right);
+        AVLNode* x = node->right;
+        AVLNode* y = x->left;
+        size_t yRank = y ? y->meta.rank : 0;
+        if (r - yRank == 2) {
+            AVLNode* old = node;
+            rotateLeft(node);
+            node->meta.rank = r;
+            old->meta.rank = r - 1;
+        } else {
+            AVLNode* old = node;
+            rotateRight(node->right);
+            rotateLeft(node);
+            node->meta.rank = r;
+            x->meta.rank = r - 1;
+            old->meta.rank = r - 1;
+        }
+    }
+}
+
+// Called after a node was removed below 'node'. Fixes a 2,2 leaf or a
+// 3-child with demotions (parent checks next) or at most one (double) rotation.
+template <>
+void BalancedTree<WAVLBalance>::rebalanceAfterRemove(AVLNode*& node) {
+    node->updateHeight();
+
+    size_t r = node->meta.rank;
+
+    if (node->isLeaf()) {
+        node->meta.rank = 1;                  // 2,2 leaf → demote
+        return;
+    }
+
+    size_t leftRank  = node->left  ? node->left->meta.rank  : 0;
+    size_t rightRank = node->right ? node->right->meta.rank : 0;
+
+    if (r - leftRank == 3) {
+        unshare(node->right);
+        AVLNode* s = node->right;             // sibling of the 3-child
+        if (r - rightRank == 2) {
+            --node->meta.rank;                // demote
+            return;
+        }
+        size_t tRank = s->left  ? s->left->meta.rank  : 0;
+        size_t uRank = s->right ? s->right->meta.rank : 0;
+        if (s->meta.rank - tRank == 2 && s->meta.rank - uRank == 2) {
+            --node->meta.rank;                // demote node and its 2,2 sibling
+            --s->meta.rank;
+            return;
+        }
+        AVLNode* old = node;
+        if (s->meta.rank - uRank == 1) {
+            // Single rotation: s moves up to rank r, node drops to r - 1
+            // (r - 2 if it became a leaf).
+            rotateLeft(node);
+            node->meta.rank = r;
+            old->meta.rank = old->isLeaf() ? r - 2 : r - 1;
+        } else {
+            // Double rotation: t moves up to rank r, s and node drop to r - 2.
+            rotateRight(node->right);
+            rotateLeft(node);
+            node->meta.rank = r;
+            s->meta.rank = r - 2;
+            old->meta.rank = r - 2;
+        }
+    } else if (r - rightRank == 3) {
+        unshare(node->left);
+        AVLNode* s = node->left;
+        if (r - leftRank == 2) {
+            --node->meta.rank;
+            return;
+        }
+        size_t tRank = s->right ? s->right->meta.rank : 0;
+        size_t uRank = s->left  ? s->left->meta.rank  : 0;
+        if (s->meta.rank - tRank == 2 && s->meta.rank - uRank == 2) {
+            --node->meta.rank;
+            --s->meta.rank;
+            return;
+        }
+        AVLNode* old = node;
+        if (s->meta.rank - uRank == 1) {
+            rotateRight(node);
+            node->meta.rank = r;
+            old->meta.rank = old->isLeaf() ? r - 2 : r - 1;
+        } else {
+            rotateLeft(node->left);
+            rotateRight(node);
+            node->meta.rank = r;
+            s->meta.rank = r - 2;
+            old->meta.rank = r - 2;
+        }
+    }
+}
+
+template <>
+void BalancedTree<WAVLBalance>::rebalanceAfterUnlink(const AVLNode*, AVLNode*&) {}
+
+// ---------------------------------------------------------------------------
+// Red-black, fixed bottom-up on the way back from the recursion. A null
+// child counts as black.
+
+template <class Node>
+static bool isRed(const Node* node) {
+    return node && node->meta.red;
+}
+
+// Called after a node was added below 'node': if a red child has a red
+// child, recolour (pushing the problem two levels up) or rotate and stop.
+template <>
+void BalancedTree<RedBlackBalance>::rebalanceAfterInsert(AVLNode*& node) {
+    node->updateHeight();
+
+    AVLNode* l = node->left;
+    AVLNode* r = node->right;
+
+    if (isRed(l) && (isRed(l->left) || isRed(l->right))) {
+        if (isRed(r)) {
+            unshare(node->left);
+            unshare(node->right);
+            node->meta.red = true;
+            node->left->meta.red = false;
+            node->right->meta.red = false;
+        } else {
+            // Left-right case: rotate the child first, then as left-left.
+            if (isRed(l->right)) {
+                rotateLeft(node->left);
+            }
+            rotateRight(node);
+            unshare(node->left);      // the outer grandchild came up shared
+            node->meta.red = false;
+            node->left->meta.red = true;
+            node->right->meta.red = true;
+        }
+    } else if (isRed(r) && (isRed(r->left) || isRed(r->right))) {
+        if (isRed(l)) {
+            unshare(node->left);
+            unshare(node->right);
+            node->meta.red = true;
+            node->left->meta.red = false;
+            node->right->meta.red = false;
+        } else {
+            if (isRed(r->left)) {
+                rotateRight(node->right);
+            }
+            rotateLeft(node);
+            unshare(node->right);
+            node->meta.red = false;
+            node->left->meta.red = true;
+            node->right->meta.red = true;
+        }
+    }
+
+    if (&node == &root) {
+        node->meta.red = false;               // the root is always black
+    }
+}
+
+// Unlinking a black node with no red replacement leaves that spot one black
+// node short; rebalanceAfterRemove repairs it on the way up.
+template <>
+void BalancedTree<RedBlackBalance>::rebalanceAfterUnlink(const AVLNode* old,
+                                                         AVLNode*& node) {
+    if (old->meta.red || &node == &root) {
+        return;
+    }
+    if (isRed(node)) {
+        node->meta.red = false;
+        return;
+    }
+    policy.deficit = true;
+    policy.deficitAt = node;
+}
+
+// Repairs a subtree whose left (or right) side is one black node short.
+// Returns true if the whole subtree is now short and the parent must go on.
+template <>
+bool BalancedTree<RedBlackBalance>::fixBlackDeficit(AVLNode*& node, bool leftShort) {
+    unshare(node->left);              // the sibling and its children get recoloured
+    unshare(node->right);
+    if (leftShort) {
+        AVLNode* s = node->right;
+        if (isRed(s)) {
+            // Red sibling: rotate it up so the short side gets a black sibling
+            // under a red parent; one more step there always finishes.
+            rotateLeft(node);
+            node->meta.red = false;
+            node->left->meta.red = true;
+            fixBlackDeficit(node->left, true);
+            node->updateHeight();
+            return false;
+        }
+        if (!isRed(s->left) && !isRed(s->right)) {
+            // Black sibling with black children: recolour and move up.
+            s->meta.red = true;
+            if (node->meta.red) {
+                node->meta.red = false;
+                return false;
+            }
+            return true;
+        }
+        if (!isRed(s->right)) {
+            // Only the inner nephew is red: rotate it to the outside.
+            rotateRight(node->right);
+            node->right->meta.red = false;
+            node->right->right->meta.red = true;
+        }
+        // Outer nephew red: rotate the sibling up, it takes the parent's colour.
+        bool parentRed = node->meta.red;
+        rotateLeft(node);
+        unshare(node->right);         // the outer nephew came up shared
+        node->meta.red = parentRed;
+        node->left->meta.red = false;
+        node->right->meta.red = false;
+        return false;
+    }
+
+    AVLNode* s = node->left;
+    if (isRed(s)) {
+        rotateRight(node);
+        node->meta.red = false;
+        node->right->meta.red = true;
+        fixBlackDeficit(node->right, false);
+        node->updateHeight();
+        return false;
+    }
+    if (!isRed(s->left) && !isRed(s->right)) {
+        s->meta.red = true;
+        if (node->meta.red) {
+            node->meta.red = false;
+            return false;
+        }
+        return true;
+    }
+    if (!isRed(s->left)) {
+        rotateLeft(node->left);
+        node->left->meta.red = false;
+        node->left->left->meta.red = true;
+    }
+    bool parentRed = node->meta.red;
+    rotateRight(node);
+    unshare(node->left);
+    node->meta.red = parentRed;
+    node->left->meta.red = false;
+    node->right->meta.red = false;
+    return false;
+}
+
+template <>
+void BalancedTree<RedBlackBalance>::rebalanceAfterRemove(AVLNode*& node) {
+    node->updateHeight();
+
+    if (policy.deficit && node != policy.deficitAt) {
+        bool leftShort = node->left == policy.deficitAt;
+        policy.deficit = fixBlackDeficit(node, leftShort);
+        policy.deficitAt = node;
+    }
+
+    if (&node == &root) {
+        policy.deficit = false;               // a short root is still valid
+        node->meta.red = false;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Treap: a child whose priority beats its parent's is rotated above it.
+// Removal needs no fix-up: splicing out a node keeps the heap order.
+
+uint32_t TreapBalance::randomPriority() {
+    thread_local std::mt19937 rng(std::random_device{}());
+    return static_cast<uint32_t>(rng());
+}
+
+template <>
+void BalancedTree<TreapBalance>::rebalanceAfterInsert(AVLNode*& node) {
+    node->updateHeight();
+    if (node->left && node->left->meta.priority > node->meta.priority) {
+        rotateRight(node);
+    } else if (node->right && node->right->meta.priority > node->meta.priority) {
+        rotateLeft(node);
+    }
+}
+
+template <>
+void BalancedTree<TreapBalance>::rebalanceAfterRemove(AVLNode*& node) {
+    node->updateHeight();
+}
+
+template <>
+void BalancedTree<TreapBalance>::rebalanceAfterUnlink(const AVLNode*, AVLNode*&) {}
+
+// ---------------------------------------------------------------------------
+
+// Post-order over dirty subtrees only: once both children are AVL trees, a
+// node that is still unbalanced has its subtree rebuilt.
+template <>
+void BalancedTree<AVLBalance>::rebalanceDirty(AVLNode*& node) {
+    if (!node || !node->meta.dirty) {
+        return;
+    }
+    unshare(node);
+    rebalanceDirty(node->left);
+    rebalanceDirty(node->right);
+    node->updateHeight();
+    markDirty(node);
+    if (node->meta.dirty) {
+        rebuildSubtree(node);
+    }
+}
+
+// Only AVL trees defer rebalancing, so there is never anything to fix otherwise.
+template <class Balance>
+void BalancedTree<Balance>::rebalanceNow() {}
+
+template <>
+void BalancedTree<AVLBalance>::rebalanceNow() {
+    WriteSection write(*this);
+    if (root && root->meta.dirty) {
+        frozenTop.clear();
+    }
+    rebalanceDirty(root);
+}
+
+// Only AVL trees defer rebalancing; the other policies keep the slack at 0.
+template <class Balance>
+void BalancedTree<Balance>::setRebalanceSlack(size_t) {}
+
+template <>
+void BalancedTree<AVLBalance>::setRebalanceSlack(size_t slack) {
+    if (slack < rebalanceSlack) {
+        rebalanceNow();               // existing nodes may exceed the new bound
+    }
+    rebalanceSlack = slack;
+}
+
+template <class Balance>
+size_t BalancedTree<Balance>::getRebalanceSlack() const {
+    return rebalanceSlack;
+}
+
+template <class Balance>
+void BalancedTree<Balance>::rebuildSubtree(AVLNode*& node) {
+    unshareSubtree(node);             // every node gets relinked
+    std::vector<AVLNode*> nodes;
+    collectNodes(node, nodes);
+    storeLink(node, buildBalanced(nodes, 0, nodes.size()));
+}
+
+// in-order list of the nodes in subtree rooted at 'node'.
+template <class Balance>
+void BalancedTree<Balance>::collectNodes(AVLNode* node, std::vector<AVLNode*>& result) {
+    if (!node) {
+        return;
+    }
+    collectNodes(node->left, result);
+    result.push_back(node);
+    collectNodes(node->right, result);
+}
+
+// Links nodes[lo, hi) into a balanced subtree around the middle element.
+template <class Balance>
+typename BalancedTree<Balance>::AVLNode*
+BalancedTree<Balance>::buildBalanced(const std::vector<AVLNode*>& nodes, size_t lo, size_t hi) {
+    if (lo >= hi) {
+        return nullptr;
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    AVLNode* n = nodes[mid];
+    storeLink(n->left, buildBalanced(nodes, lo, mid));
+    storeLink(n->right, buildBalanced(nodes, mid + 1, hi));
+    n->updateHeight();
+    markDirty(n);
+    return n;
+}
+
+// ---------------------------------------------------------------------------
+// Frozen top levels. Each block holds a node and both of its children, so
+// their three prefixes split the keys into the four grandchild subtrees, and
+// prefixRank counts how many of them are below the probe in one compare.
+// A prefix that is not strictly below or above the probe can hide either
+// order, so the search then continues with full compares from the block's
+// node. Blocks are only built where both children exist.
+
+template <class Balance>
+void BalancedTree<Balance>::freezeTop(size_t levels) {
+    frozenTop.clear();
+    freezeBlock(root, levels);
+}
+
+template <class Balance>
+void BalancedTree<Balance>::unfreeze() {
+    frozenTop.clear();
+    frozenTop.shrink_to_fit();
+}
+
+template <class Balance>
+bool BalancedTree<Balance>::isFrozen() const {
+    return !frozenTop.empty();
+}
+
+template <class Balance>
+uint32_t BalancedTree<Balance>::freezeBlock(AVLNode* node, size_t levels) {
+    if (levels < 2 || !node || !node->left || !node->right) {
+        return 0;
+    }
+
+    uint32_t index = static_cast<uint32_t>(frozenTop.size());
+    frozenTop.emplace_back();
+
+    FrozenBlock& block = frozenTop.back();
+    block.prefixes[0] = keyPrefix(node->left->key);
+    block.prefixes[1] = keyPrefix(node->key);
+    block.prefixes[2] = keyPrefix(node->right->key);
+    block.prefixes[3] = kPrefixPad;
+    block.node = node;
+    block.exits[0] = node->left->left;
+    block.exits[1] = node->left->right;
+    block.exits[2] = node->right->left;
+    block.exits[3] = node->right->right;
+
+    // Children are appended after this block; 'block' may move meanwhile.
+    for (size_t i = 0; i < 4; ++i) {
+        uint32_t child = freezeBlock(frozenTop[index].exits[i], levels - 2);
+        frozenTop[index].next[i] = child;
+    }
+    return index;
+}
+
+template <class Balance>
+typename BalancedTree<Balance>::AVLNode*
+BalancedTree<Balance>::frozenDescend(const KeyType& key) const {
+    if (frozenTop.empty()) {
+        return root;
+    }
+
+    int64_t probe = keyPrefix(key);
+    const FrozenBlock* block = &frozenTop[0];
+    for (;;) {
+        size_t less, lessEqual;
+        prefixRank(block->prefixes, 3, probe, less, lessEqual);
+        if (less != lessEqual) {
+            return block->node;               // prefix tie: compare whole keys
+        }
+        if (!block->next[less]) {
+            return block->exits[less];
+        }
+        block = &frozenTop[block->next[less]];
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Compaction. Nodes are moved by value into slots allocated in the wanted
+// order; the AVLNode pointers are then fixed up through forwarding pointers.
+
+template <class Balance>
+void BalancedTree<Balance>::compact(CompactOrder order) {
+    WriteSection write(*this);
+    std::vector<AVLNode*> nodes;
+    nodes.reserve(treeSize);
+    if (order == CompactOrder::InOrder) {
+        collectNodes(root, nodes);
+    } else {
+        collectVEB(root, root ? root->height : 0, nodes);
+    }
+
+    auto fresh = std::make_shared<NodeArena>(sizeof(AVLNode), alignof(AVLNode));
+    fresh->setNumaNode(arena->getNumaNode());
+
+    if (isShared()) {
+        // Other trees still use these nodes: copy them instead, and find the
+        // copies through a map since the originals may not be written.
+        std::unordered_map<const AVLNode*, AVLNode*> copies;
+        copies.reserve(nodes.size());
+        for (AVLNode* node : nodes) {
+            copies[node] = relocate(node, *fresh, false);
+        }
+        for (AVLNode* node : nodes) {
+            AVLNode* copy = copies[node];
+            copy->left  = node->left  ? copies[node->left]  : nullptr;
+            copy->right = node->right ? copies[node->right] : nullptr;
+        }
+        AVLNode* copiedRoot = root ? copies[root] : nullptr;
+        releaseNode(root);
+        storeLink(root, copiedRoot);
+        quiesce();
+    } else {
+        // Move each node; its old copy keeps the new address in 'left'.
+        for (AVLNode* node : nodes) {
+            storeLink(node->left, relocate(node, *fresh, !sequence));
+        }
+        // The moved nodes still point at old children: follow their forwarding pointers.
+        for (AVLNode* node : nodes) {
+            AVLNode* moved = node->left;
+            storeLink(moved->left, moved->left ? moved->left->left : nullptr);
+            storeLink(moved->right, moved->right ? moved->right->left : nullptr);
+        }
+        storeLink(root, root ? root->left : nullptr);
+        quiesce();
+
+        // Destroy the moved-from nodes.
+        for (AVLNode* node : nodes) {
+            node->~AVLNode();
+        }
+    }
+
+    // Drop the old memory (and any incremental pass, which this one completes).
+    arena = std::move(fresh);
+    compactTarget.reset();
+    compactCursor.reset();
+    frozenTop.clear();
+}
+
+template <class Balance>
+bool BalancedTree<Balance>::compactStep(size_t maxNodes) {
+    WriteSection write(*this);
+    if (!compactTarget) {
+        compactTarget = std::make_unique<NodeArena>(sizeof(AVLNode), alignof(AVLNode));
+        compactTarget->setNumaNode(arena->getNumaNode());
+        compactCursor.reset();
+    }
+    frozenTop.clear();
+
+    for (size_t moved = 0; moved < maxNodes; ++moved) {
+        // Find the link to the smallest key after the cursor.
+        AVLNode** next = nullptr;
+        AVLNode** link = &root;
+        while (*link) {
+            unshare(*link);           // 'next' must be a link of our own
+            if (!compactCursor || compareKeys((*link)->key, *compactCursor) > 0) {
+                next = link;
+                link = &(*link)->left;
+            } else {
+                link = &(*link)->right;
+            }
+        }
+
+        if (!next) {
+            // Every node is in the new arena now.
+            quiesce();
+            arena = std::move(compactTarget);
+            compactCursor.reset();
+            return true;
+        }
+
+        AVLNode* old = *next;
+        if (!compactTarget->owns(old)) {      // not already copied by unshare
+            storeLink(*next, relocate(old, *compactTarget, !sequence));
+            deleteNode(old);
+        }
+        compactCursor = (*next)->key;
+    }
+    return false;
+}
+
+template <class Balance>
+void BalancedTree<Balance>::collectVEB(AVLNode* node, size_t levels,
+                                       std::vector<AVLNode*>& result) {
+    if (!node || levels == 0) {
+        return;
+    }
+    if (levels == 1) {
+        result.push_back(node);
+        return;
+    }
+    size_t top = levels / 2;
+    collectVEB(node, top, result);
+
+    std::vector<AVLNode*> bottoms;
+    collectAtDepth(node, top, bottoms);
+    for (AVLNode* bottom : bottoms) {
+        collectVEB(bottom, levels - top, result);
+    }
+}
+
+// Nodes exactly 'depth' levels below 'node', left to right.
+template <class Balance>
+void BalancedTree<Balance>::collectAtDepth(AVLNode* node, size_t depth,
+                                           std::vector<AVLNode*>& result) {
+    if (!node) {
+        return;
+    }
+    if (depth == 0) {
+        result.push_back(node);
+        return;
+    }
+    collectAtDepth(node->left, depth - 1, result);
+    collectAtDepth(node->right, depth - 1, result);
+}
+
+// ---------------------------------------------------------------------------
+// Transactions. A key in 'writes' is decided by its entry there; any other key
+// is as the tree has it.
+
+template <class Balance>
+BalancedTree<Balance>::Transaction::Transaction(BalancedTree& t) : tree(&t) {}
+
+template <class Balance>
+BalancedTree<Balance>::Transaction::~Transaction() {
+    rollback();
+}
+
+template <class Balance>
+bool BalancedTree<Balance>::Transaction::insert(const KeyType& key, ValueType value) {
+    if (!tree) {
+        return false;
+    }
+    auto it = writes.find(key);
+    if (it != writes.end()) {
+        if (it->second.value) {
+            return false;                     // inserted earlier in this transaction
+        }
+        it->second.value = value;
+        return true;
+    }
+    if (tree->contains(key)) {
+        return false;
+    }
+    writes.emplace(key, Write{value, false});
+    return true;
+}
+
+template <class Balance>
+bool BalancedTree<Balance>::Transaction::remove(const KeyType& key) {
+    if (!tree) {
+        return false;
+    }
+    auto it = writes.find(key);
+    if (it != writes.end()) {
+        if (!it->second.value) {
+            return false;                     // removed earlier in this transaction
+        }
+        it->second.value.reset();
+        return true;
+    }
+    if (!tree->contains(key)) {
+        return false;
+    }
+    writes.emplace(key, Write{std::nullopt, true});
+    return true;
+}
+
+template <class Balance>
+bool BalancedTree<Balance>::Transaction::assign(const KeyType& key, ValueType value) {
+    if (!tree) {
+        return false;
+    }
+    auto it = writes.find(key);
+    if (it != writes.end()) {
+        if (!it->second.value) {
+            return false;
+        }
+        it->second.value = value;
+        return true;
+    }
+    if (!tree->contains(key)) {
+        return false;
+    }
+    writes.emplace(key, Write{value, true});
+    return true;
+}
+
+template <class Balance>
+bool BalancedTree<Balance>::Transaction::contains(const KeyType& key) const {
+    return get(key).has_value();
+}
+
+template <class Balance>
+std::optional<typename BalancedTree<Balance>::ValueType>
+BalancedTree<Balance>::Transaction::get(const KeyType& key) const {
+    if (!tree) {
+        return std::nullopt;
+    }
+    auto it = writes.find(key);
+    if (it != writes.end()) {
+        return it->second.value;
+    }
+    return tree->get(key);
+}
+
+// Writing in place on a tree that shares no nodes and has no reclaimer
+// allocates nothing but the new nodes, so applyInPlace() is enough;
+// otherwise unsharing paths and removing under a reclaimer allocate as they
+// go, and applyStaged() keeps the tree out of it until the end.
+template <class Balance>
+void BalancedTree<Balance>::Transaction::commit() {
+    if (!tree) {
+        return;
+    }
+    if (!writes.empty()) {
+        if (!tree->isShared() && !tree->reclaimer) {
+            applyInPlace();
+        } else {
+            applyStaged();
+        }
+    }
+    writes.clear();
+    tree = nullptr;
+}
+
+// The new nodes are built before the write section; if building one throws,
+// those built so far are freed and the tree was never touched. Inside it,
+// links, removals (which swap keys rather than copy them) and value updates
+// cannot fail.
+template <class Balance>
+void BalancedTree<Balance>::Transaction::applyInPlace() {
+    struct Fresh {
+        BalancedTree& tree;
+        std::vector<AVLNode*> nodes;
+        size_t linked = 0;
+        ~Fresh() {
+            for (size_t i = linked; i < nodes.size(); ++i) {
+                tree.deleteNode(nodes[i]);
+            }
+        }
+    } fresh{*tree, {}};
+    fresh.nodes.reserve(writes.size());
+    for (const auto& [key, write] : writes) {
+        if (write.value && !write.present) {
+            fresh.nodes.push_back(tree->newNode(key, *write.value));
+        }
+    }
+
+    WriteSection section(*tree);
+    for (const auto& [key, write] : writes) {
+        if (!write.value) {
+            if (write.present) {
+                tree->remove(tree->root, key);
+                --tree->treeSize;
+            }
+        } else if (write.present) {
+            tree->getUniqueNode(tree->root, key)->value = *write.value;
+        } else {
+            tree->insert(tree->root, key, *write.value, fresh.nodes[fresh.linked++]);
+            ++tree->treeSize;
+        }
+    }
+    tree->frozenTop.clear();
+}
+
+// The writes go to a copy sharing the tree's nodes, so a throw (out of
+// memory) leaves the tree alone. The copy's reclaimer is the tree's, so the
+// nodes the tree drops in the swap are retired, not freed under a lock-free
+// reader.
+template <class Balance>
+void BalancedTree<Balance>::Transaction::applyStaged() {
+    BalancedTree staged(*tree);
+    for (const auto& [key, write] : writes) {
+        if (!write.value) {
+            staged.remove(key);
+        } else if (write.present) {
+            staged[key] = *write.value;
+        } else {
+            staged.insert(key, *write.value);
+        }
+    }
+    WriteSection section(*tree);
+    tree->swapNodes(staged);
+}
+
+template <class Balance>
+void BalancedTree<Balance>::Transaction::rollback() {
+    writes.clear();
+    tree = nullptr;
+}
+
+template <class Balance>
+bool BalancedTree<Balance>::Transaction::isOpen() const {
+    return tree != nullptr;
+}
+
+// ---------------------------------------------------------------------------
+
 // copies the subtree rooted at 'other' and returns new root.
-AVLTree::AVLNode*
-AVLTree::copyTree(const AVLNode* other) {
+template <class Balance>
+typename BalancedTree<Balance>::AVLNode*
+BalancedTree<Balance>::copyTree(const AVLNode* other) {
     if (!other) {
         return nullptr;
     }
 
-    AVLNode* n = new AVLNode(other->key, other->value);
+    AVLNode* n = newNode(other->key, other->value);
     n->height = other->height;          // copy stored height
+    n->meta = other->meta;              // copy balancing data
     n->left  = copyTree(other->left);   // copy left subtree
     n->right = copyTree(other->right);  // copy right subtree
     return n;
 }
 
-//  deletes all nodes in subtree rooted at 'node'.
-void AVLTree::clearTree(AVLNode* node) {
+// Takes over one reference to 'node'. Returns the node if this tree now owns
+// it alone (refs 0 marks nodes already taken over), nullptr otherwise.
+template <class Node>
+static Node* claimNode(Node* node) {
     if (!node) {
-        return;
+        return nullptr;
+    }
+    if (node->refs.load(std::memory_order_acquire) == 0
+        || node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        return node;
     }
-    clearTree(node->left);
-    clearTree(node->right);
-    delete node;
+    return nullptr;
 }
 
-std::ostream& operator<<(std::ostream& os, const AVLTree& tree) {
+//  deletes all nodes in subtree rooted at 'node', without recursion: a node
+// with a left child is rotated right (pushing it down the right spine), so the
+// node at the top never has a left child once destroyed. O(n) time, O(1) space.
+// Subtrees still referenced by another tree are left alone.
+template <class Balance>
+void BalancedTree<Balance>::clearTree(AVLNode* node, NodeArena* shared, const NodeArena* skip) {
+    node = claimNode(node);
+    while (node) {
+        AVLNode* left = claimNode(node->left);
+        if (left) {
+            node->left = left->right;
+            left->right = node;
+            node = left;
+        } else {
+            AVLNode* next = claimNode(node->right);
+            node->~AVLNode();
+            if (shared && !(skip && skip->owns(node))) {
+                shared->release(node);
+            }
+            node = next;
+        }
+    }
+}
+
+template <class Balance>
+std::ostream& operator<<(std::ostream& os, const BalancedTree<Balance>& tree) {
     tree.printTree(os, tree.root);
     return os;
 }
 
-void AVLTree::printTree(std::ostream& os,
-                        const AVLNode* node,
-                        size_t depth) const {
+template <class Balance>
+void BalancedTree<Balance>::printTree(std::ostream& os,
+                                      const AVLNode* node,
+                                      size_t depth) const {
     if (!node) {
         return;
     }
@@ -371,3 +1789,14 @@ void AVLTree::printTree(std::ostream& os,
     // Print left subtree.
     printTree(os, node->left, depth + 1);
 }
+
+// The balancing policies this tree is built with (see AVLTree.h).
+template class BalancedTree<AVLBalance>;
+template class BalancedTree<WAVLBalance>;
+template class BalancedTree<RedBlackBalance>;
+template class BalancedTree<TreapBalance>;
+
+template std::ostream& operator<<(std::ostream&, const BalancedTree<AVLBalance>&);
+template std::ostream& operator<<(std::ostream&, const BalancedTree<WAVLBalance>&);
+template std::ostream& operator<<(std::ostream&, const BalancedTree<RedBlackBalance>&);
+template std::ostream& operator<<(std::ostream&, const BalancedTree<TreapBalance>&);
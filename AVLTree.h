@@ -6,8 +6,58 @@
 #include <optional>
 #include <iostream>
 #include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include <memory>
+#include <atomic>
+#include <map>
+
+#include "EpochReclaimer.h"
+#include "NodeArena.h"
+
+// Balancing policies for BalancedTree. A policy supplies the data each node
+// carries for it (NodeData) plus any per-tree state its rebalancing needs;
+// the rebalancing itself (rebalanceAfterInsert / rebalanceAfterRemove /
+// rebalanceAfterUnlink) is specialised per policy in AVLTree.cpp.
+
+// AVL: heights of the two subtrees differ by at most 1.
+struct AVLBalance {
+    struct NodeData {
+        bool dirty = false; // Subtree holds a node left unbalanced (relaxed mode)
+    };
+};
+
+// Weak AVL (Haeupler-Sen-Tarjan): rank differences of 1 or 2.
+// Same shape as AVL for insert-only use, O(1) amortized rotations per remove.
+struct WAVLBalance {
+    struct NodeData {
+        size_t rank = 1;    // Null children have rank 0, leaves rank 1
+    };
+};
 
-class AVLTree {
+// Red-black: no red node has a red child, equal black count on every path.
+struct RedBlackBalance {
+    struct NodeData {
+        bool red = true;    // New nodes start red
+    };
+
+    // Set on remove when a black node was unlinked: 'deficitAt' is the subtree
+    // that is now one black node short, repaired on the way back up.
+    bool deficit = false;
+    const void* deficitAt = nullptr;
+};
+
+// Treap: BST on keys, max-heap on random priorities.
+struct TreapBalance {
+    struct NodeData {
+        uint32_t priority = randomPriority();
+    };
+
+    static uint32_t randomPriority();
+};
+
+template <class Balance>
+class BalancedTree {
 public:
     using KeyType   = std::string; // Keys stored in the tree
     using ValueType = size_t;      // Values stored in the tree
@@ -20,12 +70,19 @@ private:
         ValueType value;  // Value associated with the key
         size_t height;    // Height of this node in the tree
 
+        // Balancing data of the policy (takes no space for policies without any).
+        [[no_unique_address]] typename Balance::NodeData meta;
+
+        // Number of links (tree roots and parents) to this node. Copies of a
+        // tree share nodes; a node with refs > 1 is never modified in place.
+        std::atomic<uint32_t> refs;
+
         AVLNode* left;    // Pointer to left child
         AVLNode* right;   // Pointer to right child
 
         // Constructor: new node starts(height = 1)
-        AVLNode(const KeyType& k, ValueType v)
-            : key(k), value(v), height(1), left(nullptr), right(nullptr) {}
+        AVLNode(KeyType k, ValueType v)
+            : key(std::move(k)), value(v), height(1), refs(1), left(nullptr), right(nullptr) {}
 
         // Returns number of children this node has
         size_t numChildren() const {
@@ -62,22 +119,129 @@ private:
 
     // Number of key-value pairs stored in the tree
     size_t treeSize;
+
+    // Extra height difference insert/remove may leave behind (0 = strict AVL).
+    size_t rebalanceSlack;
+
+    // Per-tree state of the balancing policy.
+    [[no_unique_address]] Balance policy;
+
+    // Storage for this tree's nodes (huge-page backed chunks, see NodeArena.h),
+    // shared with the copies of this tree that may still share nodes with it.
+    std::shared_ptr<NodeArena> arena;
+
+    // Where unlinked nodes go instead of being freed (null: freed at once).
+    std::shared_ptr<EpochReclaimer> reclaimer;
+
+    // Seqlock mode: odd while a writer is inside (null: mode off).
+    std::unique_ptr<std::atomic<uint64_t>> sequence;
+
+    // Holds the seqlock (if on) for the lifetime of a write.
+    class WriteSection {
+    public:
+        explicit WriteSection(const BalancedTree& tree);
+        ~WriteSection();
+
+        WriteSection(const WriteSection&) = delete;
+        WriteSection& operator=(const WriteSection&) = delete;
+
+    private:
+        std::atomic<uint64_t>* sequence;
+    };
+
+    // Incremental compaction in progress: nodes are moved into 'compactTarget'
+    // in key order; every key up to 'compactCursor' has been moved.
+    std::unique_ptr<NodeArena> compactTarget;
+    std::optional<KeyType> compactCursor;
+
+    // One block of the frozen top levels: a node and its two children, stored
+    // as sorted 8-byte key prefixes so a single SIMD compare picks one of the
+    // four subtrees below them.
+    struct FrozenBlock {
+        alignas(32) int64_t prefixes[4]; // left child, node, right child, padding
+        AVLNode* node;                   // Pointer search resumes here on a prefix tie
+        AVLNode* exits[4];               // Subtrees below the block, in key order
+        uint32_t next[4];                // Block index of exits[i] (0: not frozen)
+    };
+
+    // Frozen top levels in pre-order, root block first (empty if not frozen).
+    std::vector<FrozenBlock> frozenTop;
+
+    // Links (root, left, right) as seqlock readers see them: loaded with
+    // acquire and stored with release, so a reader that races a writer reads
+    // a whole pointer, and a node is built before the store that links it in.
+    // Every store to a link that may be reachable goes through storeLink.
+    static AVLNode* loadLink(AVLNode* const& link);
+    static void storeLink(AVLNode*& link, AVLNode* node);
+
+    // Construct / destroy a node in the arena.
+    AVLNode* newNode(const KeyType& key, ValueType value);
+    void deleteNode(AVLNode* node);
+
+    // Constructs a copy of 'node' (same links) in 'to'; 'steal' moves the key.
+    static AVLNode* relocate(AVLNode* node, NodeArena& to, bool steal);
+
+    // Exchanges the nodes and everything describing them with 'other'; the
+    // seqlock and the reclaimer stay with their trees.
+    void swapNodes(BalancedTree& other) noexcept;
+
+    // Copy-on-write. True if another tree may share nodes with this one.
+    bool isShared() const;
+
+    // Makes the node behind 'link' private to this tree before it is modified:
+    // a shared node is replaced by a copy that shares its children.
+    void unshare(AVLNode*& link);
+    void unshareSubtree(AVLNode*& link);
+
+    // Drops one reference to the subtree 'node' on behalf of this tree.
+    void releaseNode(AVLNode* node);
+
+    // Deleters for the reclaimer: destroy one node / drop one subtree
+    // reference, giving slots back to the arena passed as 'arena'.
+    static void destroyRetired(void* node, void* arena);
+    static void releaseRetired(void* node, void* arena);
+
+    // Frees everything retired so far once the readers pinned now are gone;
+    // called before an arena the retired nodes live in is dropped.
+    void quiesce();
+
+    // Like getNode, but unshares every node on the path so the result may be
+    // modified.
+    AVLNode* getUniqueNode(AVLNode*& node, const KeyType& key);
+
     // insert : inserts (key, value) into subtree rooted at 'node'.
     // Returns true if a new node is inserted, false if the key already exists.
-    bool insert(AVLNode*& node, const KeyType& key, ValueType value);
+    // 'fresh', if given, is the node to link in, already built for the key.
+    bool insert(AVLNode*& node, const KeyType& key, ValueType value, AVLNode* fresh = nullptr);
+
+    // appendRight : walks the right spine of 'node' and hangs (key, value) off the
+    // rightmost node. Only the maximum key is compared; returns false (tree unchanged)
+    // if 'key' is not greater than it.
+    bool appendRight(AVLNode*& node, const KeyType& key, ValueType value);
 
     //  remove : removes 'key' from subtree rooted at 'node'.
     // Returns true if a node was removed, false if key not found.
     bool remove(AVLNode*& node, const KeyType& key);
 
+    // Node of 'key' in the subtree rooted at 'node', unshared; if missing, it
+    // is inserted with 'value' and 'inserted' is set.
+    AVLNode* findOrInsert(AVLNode*& node, const KeyType& key, ValueType value, bool& inserted);
+
     // Handles the node deletion logic.
     bool removeNode(AVLNode*& node);
 
+    // Removes the leftmost node of the (non-empty) subtree rooted at 'node'.
+    void removeMin(AVLNode*& node);
+
     //  contains : returns true if key exists in subtree rooted at 'node'.
     bool contains(const AVLNode* node, const KeyType& key) const;
     // Returns nullptr if not found.
     AVLNode* getNode(AVLNode* node, const KeyType& key) const;
 
+    // Seqlock-mode lookup: walks from the root without a lock and retries
+    // until no writer ran meanwhile.
+    std::optional<ValueType> getOptimistic(const KeyType& key) const;
+
     //  adds all VALUES whose keys are in [lowKey, highKey] to 'result'.
     void findRange(const AVLNode* node,
                    const KeyType& lowKey,
@@ -91,8 +255,13 @@ private:
     // Creates a  deep copy of the subtree rooted at 'other' and returns the new root.
     AVLNode* copyTree(const AVLNode* other);
 
-    //  deletes all nodes in subtree rooted at 'node'.
-    void clearTree(AVLNode* node);
+    //  drops one reference to the subtree rooted at 'node' and destroys every
+    // node that was only referenced from it. Slots are given back to 'shared'
+    // unless it is null or 'skip' holds them: those arenas are freed whole.
+    static void clearTree(AVLNode* node, NodeArena* shared, const NodeArena* skip);
+
+    // Drops all nodes and arena memory of this tree.
+    void releaseAll();
 
     // Finds the node with the smallest key in subtree rooted at 'node'.
     AVLNode* findMin(AVLNode* node) const;
@@ -104,6 +273,46 @@ private:
     // Checks balance factor of 'node' and performs the necessary rotation.
     void balanceNode(AVLNode*& node);
 
+    // Restore the balance invariant at 'node' on the way back up from an
+    // insert / remove below it (specialised per balancing policy).
+    void rebalanceAfterInsert(AVLNode*& node);
+    void rebalanceAfterRemove(AVLNode*& node);
+
+    // Called by removeNode when 'old' is unlinked and 'node' (possibly null)
+    // takes its place, before 'old' is deleted.
+    void rebalanceAfterUnlink(const AVLNode* old, AVLNode*& node);
+
+    // Red-black remove: repairs 'node' whose left (leftShort) or right side is
+    // one black node short. Returns true if the whole subtree is now short.
+    bool fixBlackDeficit(AVLNode*& node, bool leftShort);
+
+    // AVL relaxed mode: leaves 'node' alone while |balance| <= 1 + rebalanceSlack,
+    // otherwise rotates it back within that bound.
+    void balanceWithSlack(AVLNode*& node);
+    static void markDirty(AVLNode* node);
+
+    // Restores AVL balance in every dirty subtree below 'node'.
+    void rebalanceDirty(AVLNode*& node);
+
+    // Rebuilds the subtree rooted at 'node' into a perfectly balanced one
+    // (reuses the existing nodes, no allocation besides a temporary vector).
+    void rebuildSubtree(AVLNode*& node);
+    void collectNodes(AVLNode* node, std::vector<AVLNode*>& result);
+
+    // van Emde Boas order of the top 'levels' levels below 'node': the upper
+    // half of the levels first, then each subtree hanging below it.
+    void collectVEB(AVLNode* node, size_t levels, std::vector<AVLNode*>& result);
+    void collectAtDepth(AVLNode* node, size_t depth, std::vector<AVLNode*>& result);
+    AVLNode* buildBalanced(const std::vector<AVLNode*>& nodes, size_t lo, size_t hi);
+
+
+    // Appends the blocks for 'levels' levels of the subtree rooted at 'node'.
+    // Returns the index of its block, or 0 if that subtree is left unfrozen.
+    uint32_t freezeBlock(AVLNode* node, size_t levels);
+
+    // Walks the frozen blocks for 'key' and returns the subtree where the
+    // pointer search continues (the root if the tree is not frozen).
+    AVLNode* frozenDescend(const KeyType& key) const;
 
     void printTree(std::ostream& os,
                    const AVLNode* node,
@@ -111,21 +320,48 @@ private:
 
 public:
     //  constructor: creates an empty AVL tree.
-    AVLTree();
+    BalancedTree();
 
-    // Copy constructor: creates a  copy of 'other'.
-    AVLTree(const AVLTree& other);
+    // Copy constructor: creates a  copy of 'other' in O(1). The two trees share
+    // their nodes (copy-on-write); the first insert / remove on either one
+    // copies only the nodes on the path it changes. Copies may be read and
+    // modified from different threads.
+    BalancedTree(const BalancedTree& other);
 
     // Assignment operator: clears current tree, then copies 'other'.
-    AVLTree& operator=(const AVLTree& other);
+    BalancedTree& operator=(const BalancedTree& other);
+
+    // Move constructor / assignment: take over the nodes of 'other' in O(1),
+    // without copying or allocating. 'other' is left empty (construction) or
+    // holding this tree's previous contents (assignment).
+    BalancedTree(BalancedTree&& other) noexcept;
+    BalancedTree& operator=(BalancedTree&& other) noexcept;
+
+    // Exchanges the contents of two trees in O(1).
+    void swap(BalancedTree& other) noexcept;
+
+    friend void swap(BalancedTree& a, BalancedTree& b) noexcept {
+        a.swap(b);
+    }
 
     // Destructor: frees all dynamically allocated nodes.
-    ~AVLTree();
+    ~BalancedTree();
+
+    // Removes every key. clearAsync() detaches the nodes and hands them to a
+    // background thread for destruction, so it returns in constant time; the
+    // tree is empty and usable right away.
+    void clear();
+    void clearAsync();
 
     // Inserts (key, value) into the tree.
     // Returns true if a new node is inserted, false if key already exists.
     bool insert(const KeyType& key, ValueType value);
 
+    // Inserts (key, value) when 'key' is larger than every key in the tree,
+    // descending and rebalancing only along the rightmost spine.
+    // Falls back to insert() otherwise, so the result is the same as insert().
+    bool append(const KeyType& key, ValueType value);
+
     // Removes the given key from the tree.
     // Returns true if a node was removed, false if key not found.
     bool remove(const KeyType& key);
@@ -138,9 +374,14 @@ public:
     std::optional<ValueType> get(const KeyType& key) const;
 
     //  operator: returns reference to value for 'key'.
-    //
+    // A missing key is inserted first with value 0 (counters start at zero).
     ValueType& operator[](const KeyType& key);
 
+    // Find-or-insert in one descent: the value of 'key', inserted first with
+    // 'value' if missing, and whether it was. The reference is valid as long
+    // as one from operator[] would be.
+    std::pair<ValueType&, bool> findOrInsert(const KeyType& key, ValueType value);
+
     // Returns a vector of all VALUES whose keys lie between [lowKey, highKey].
     std::vector<ValueType> findRange(const KeyType& lowKey,
                                      const KeyType& highKey) const;
@@ -148,16 +389,168 @@ public:
     // Returns a vector of all keys currently stored in the tree, in sorted order.
     std::vector<KeyType> keys() const;
 
+    // Relaxed (deferred) rebalancing for write bursts. With slack > 0, insert and
+    // remove only update heights and mark nodes whose |balance| is at most
+    // 1 + slack; a node is rotated only once it exceeds that bound (at most
+    // two rotations per level, as in strict mode), so the height stays within
+    // O((slack + 1) log n). 0 restores strict AVL behaviour.
+    // Only AVLTree supports slack: WAVLTree, RedBlackTree and Treap always
+    // rebalance in full, so for them this is a no-op and the slack stays 0.
+    void setRebalanceSlack(size_t slack);
+    size_t getRebalanceSlack() const;
+
+    // Fixes every node marked by relaxed mode so the tree satisfies the full AVL
+    // invariants again. Only visits marked subtrees; a no-op for a balanced tree.
+    void rebalanceNow();
+
+    // Read-mostly mode: packs the top 'levels' levels of the tree into an
+    // array of 8-byte key prefixes, a node and its two children per block, so
+    // contains / get / operator[] search each block with one SIMD compare
+    // (k-ary search as in FAST) before following the AVLNode pointers below.
+    // A probe whose prefix ties a key in a block finishes with full compares.
+    // The next insert or remove drops the index, as does any write that copies
+    // nodes shared with a copy of the tree; freeze again after the writes.
+    void freezeTop(size_t levels = 12);
+    void unfreeze();
+    bool isFrozen() const;
+
+    // Defragmentation after long insert / remove churn. compact() moves every
+    // node into a fresh arena, laid out in key order (fast in-order scans) or
+    // van Emde Boas order (fewer cache misses per lookup), and frees the old
+    // memory. compactStep() does the same in key order but moves at most
+    // 'maxNodes' nodes per call, and returns true once the pass is complete;
+    // the tree may be used and modified between steps. Both invalidate
+    // references returned by operator[] and drop the frozen index.
+    enum class CompactOrder { InOrder, VanEmdeBoas };
+    void compact(CompactOrder order = CompactOrder::InOrder);
+    bool compactStep(size_t maxNodes);
+
+    // All-or-nothing group of writes. insert / remove / assign only record the
+    // final state of their key in a write set, so the tree is untouched until
+    // commit(), which applies the set in key order in one write section.
+    // It first builds the nodes of the keys it adds, then links them in and
+    // removes and updates in place: about the cost of the same plain inserts
+    // and removes. A tree with a live copy or a reclaimer, where writing in
+    // place allocates as it goes, gets the writes applied to a copy-on-write
+    // copy instead, which then takes the tree's place. Either way, if
+    // commit() throws (out of memory), the tree is as it was and the
+    // transaction stays open. rollback() just drops the set. Results are what
+    // the same calls on the tree would return at that point of the
+    // transaction; get() sees its own writes, other readers see none of them
+    // before commit(). While a transaction is open the tree may be read but
+    // must not be written to by anything else. An open transaction rolls back
+    // when destroyed.
+    class Transaction {
+    public:
+        explicit Transaction(BalancedTree& tree);
+        ~Transaction();
+
+        Transaction(const Transaction&) = delete;
+        Transaction& operator=(const Transaction&) = delete;
+
+        bool insert(const KeyType& key, ValueType value);
+        bool remove(const KeyType& key);
+
+        // Gives an existing key a new value; false if the key is missing.
+        bool assign(const KeyType& key, ValueType value);
+
+        bool contains(const KeyType& key) const;
+        std::optional<ValueType> get(const KeyType& key) const;
+
+        // Applies every write and closes the transaction.
+        void commit();
+
+        // Drops every write and closes the transaction.
+        void rollback();
+
+        // False once committed or rolled back; further writes are ignored.
+        bool isOpen() const;
+
+    private:
+        // Final state of a key written: a value, or nullopt for a key that
+        // must be absent; and whether the tree holds the key.
+        struct Write {
+            std::optional<ValueType> value;
+            bool present;
+        };
+
+        BalancedTree* tree;
+        std::map<KeyType, Write> writes;
+
+        void applyInPlace();
+        void applyStaged();
+    };
+
+    // Deferred freeing for readers that walk the tree without a lock. With a
+    // reclaimer set, nodes unlinked by remove, replaced by copy-on-write or
+    // dropped by clear go to reclaimer->retire() instead of being freed, and
+    // operations that give up an arena (clear, compact, the destructor) first
+    // wait for the reclaimer's readers to leave (EpochReclaimer::flush). A
+    // reader pins the reclaimer around its walk; reclaimer->pending() counts
+    // what is retired but not yet freed. Copies share the reclaimer.
+    void setReclaimer(std::shared_ptr<EpochReclaimer> r);
+    const std::shared_ptr<EpochReclaimer>& getReclaimer() const;
+
+    // Seqlock mode, for small trees read far more often than written. Writers
+    // (insert, append, remove, clear, compaction, rebalanceNow) make the
+    // sequence counter odd while they run, one at a time; contains / get walk
+    // the tree without a lock and retry if the counter was odd or moved. The
+    // tree gets a reclaimer if it has none, so readers never see a node freed
+    // under them. Besides the counter loads and an acquire fence, each read
+    // pins it: a thread-local lookup, a seq_cst store to the reader's own
+    // record between two loads of the global epoch (a full fence on x86), and
+    // a release store to unpin. A thread making many reads in a row can pin
+    // once around all of them with an EpochReclaimer::Guard on getReclaimer()
+    // (the reads' own pins then only count); writers that drop an arena
+    // (clear, compact) wait for it to let go, so that thread must not call
+    // them meanwhile. Keys
+    // are never rewritten in place while a reclaimer is set, and every link
+    // is loaded and stored atomically (loadLink / storeLink). Other reads
+    // (findRange, keys, size, operator[]) must not overlap a write, and
+    // neither may a value written through the reference operator[] returns
+    // overlap contains / get.
+    void setSeqlock(bool on);
+    bool isSeqlocked() const;
+
     // Returns how many key-value pairs are in the tree (O(1)).
     size_t size() const;
 
+    // Bytes reserved for nodes, and how many of them sit in huge-page chunks.
+    // Key bytes beyond the std::string inline buffer live on the heap.
+    size_t reservedBytes() const;
+    size_t hugePageBytes() const;
+
+    // Nodes allocated from now on are placed on NUMA node 'node' (-1: no
+    // preference). Existing nodes stay where they are.
+    void setNumaNode(int node);
+
     // Returns the height of the tree (height of the root).
     // Empty tree has height 0.
     size_t getHeight() const;
 
     // printing using: std::cout << tree;
+    template <class B>
     friend std::ostream& operator<<(std::ostream& os,
-                                    const AVLTree& tree);
+                                    const BalancedTree<B>& tree);
 };
 
+template <class Balance>
+std::ostream& operator<<(std::ostream& os, const BalancedTree<Balance>& tree);
+
+// The tree is instantiated for these policies in AVLTree.cpp; all of them
+// share the public API above.
+using AVLTree      = BalancedTree<AVLBalance>;
+using WAVLTree     = BalancedTree<WAVLBalance>;
+using RedBlackTree = BalancedTree<RedBlackBalance>;
+using Treap        = BalancedTree<TreapBalance>;
+
+// Instantiates a class template that takes the tree as its parameter (the
+// wrappers: ReplicatedTree, VersionedTree, ...) for every tree above. Used
+// once, at the end of the .cpp file that defines its members.
+#define INSTANTIATE_FOR_EACH_TREE(Wrapper) \
+    template class Wrapper<AVLTree>;       \
+    template class Wrapper<WAVLTree>;      \
+    template class Wrapper<RedBlackTree>;  \
+    template class Wrapper<Treap>
+
 #endif
@@ -0,0 +1,548 @@
+/*
+Benchmark harness for the containers. Each workload is a template over the
+container, so every class with the tree API (insert, remove, get, ...) runs
+the same code.
+
+    AVLTreeBench [workload] [keys]
+
+Workloads:
+    policies   insert, lookups, churn and height for each balancing policy
+    btree      random contains() throughput, AVLTree against BTree
+    art        insert, lookups and memory on URL and path keys, AVLTree against ARTree
+    hugepages  get / findRange throughput and dTLB misses, with and without THP
+    txn        plain inserts against transactions of 1, 16 and 256 inserts
+    combining  3:1 insert:get from 1-64 threads, FlatCombiningTree against a mutex
+    seqlock    lock-free get() from 1-8 threads, pinning per read or per 256 reads
+    lsm        put latency and findRange over a large compacted LSMTree
+
+Times are wall-clock seconds; build with optimisations on.
+ */
+#include "ARTree.h"
+#include "AVLTree.h"
+#include "BTree.h"
+#include "EpochReclaimer.h"
+#include "FlatCombiningTree.h"
+#include "LSMTree.h"
+
+#include <fstream>
+#include <malloc.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Lookup results are summed in here so the compiler cannot drop them.
+static volatile size_t sink = 0;
+
+// 'count' random lower-case keys of 'length' letters.
+static vector<string> randomKeys(size_t count, size_t length, uint64_t seed) {
+    mt19937_64 rng(seed);
+    vector<string> keys(count, string(length, 'a'));
+    for (string& key : keys) {
+        for (char& c : key) {
+            c = static_cast<char>('a' + rng() % 26);
+        }
+    }
+    return keys;
+}
+
+// Indices of 'count' random elements of a vector of 'size'.
+static vector<size_t> randomPicks(size_t count, size_t size, uint64_t seed) {
+    mt19937_64 rng(seed);
+    vector<size_t> picks(count);
+    for (size_t& pick : picks) {
+        pick = rng() % size;
+    }
+    return picks;
+}
+
+template <class Run>
+static double seconds(Run run) {
+    auto start = chrono::steady_clock::now();
+    run();
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+template <class Tree>
+static double insertAll(Tree& tree, const vector<string>& keys) {
+    return seconds([&] {
+        for (size_t i = 0; i < keys.size(); ++i) {
+            tree.insert(keys[i], i);
+        }
+    });
+}
+
+// get() of the keys at 'picks'.
+template <class Tree>
+static double lookups(const Tree& tree, const vector<string>& keys, const vector<size_t>& picks) {
+    return seconds([&] {
+        size_t found = 0;
+        for (size_t pick : picks) {
+            found += tree.get(keys[pick]).value_or(0);
+        }
+        sink = sink + found;
+    });
+}
+
+// Removes the key at each of 'picks' and inserts a fresh key in its place.
+template <class Tree>
+static double churn(Tree& tree, vector<string>& keys, const vector<size_t>& picks,
+                    const vector<string>& fresh) {
+    return seconds([&] {
+        for (size_t i = 0; i < picks.size(); ++i) {
+            string& slot = keys[picks[i]];
+            tree.remove(slot);
+            slot = fresh[i];
+            tree.insert(slot, i);
+        }
+    });
+}
+
+// ---------------------------------------------------------------------------
+// policies: the same random keys, lookups and remove + insert pairs against
+// every balancing policy. Lookups and churn run 2 * keys operations each.
+
+template <class Tree>
+static void benchPolicy(const char* name, const vector<string>& keys) {
+    vector<size_t> picks = randomPicks(2 * keys.size(), keys.size(), 2);
+    vector<string> fresh = randomKeys(2 * keys.size(), keys.front().size(), 3);
+    vector<string> live = keys;
+
+    Tree tree;
+    double insert = insertAll(tree, keys);
+    double lookup = lookups(tree, keys, picks);
+    double churned = churn(tree, live, picks, fresh);
+    printf("%-8s %8.2f %9.2f %8.2f %7zu\n", name, insert, lookup, churned, tree.getHeight());
+}
+
+static void benchPolicies(size_t count) {
+    vector<string> keys = randomKeys(count, 15, 1);
+    printf("%zu keys\npolicy     insert   lookups    churn  height\n", count);
+    benchPolicy<AVLTree>("AVL", keys);
+    benchPolicy<WAVLTree>("WAVL", keys);
+    benchPolicy<RedBlackTree>("RB", keys);
+    benchPolicy<Treap>("treap", keys);
+}
+
+// ---------------------------------------------------------------------------
+// btree: 1e6 random contains() on a tree of 'keys' entries, in M ops/s.
+
+template <class Tree>
+static double containsRate(const vector<string>& keys, const vector<size_t>& picks) {
+    Tree tree;
+    insertAll(tree, keys);
+    double elapsed = seconds([&] {
+        size_t found = 0;
+        for (size_t pick : picks) {
+            found += tree.contains(keys[pick]);
+        }
+        sink = sink + found;
+    });
+    return picks.size() / elapsed / 1e6;
+}
+
+static void benchBTree(size_t count) {
+    vector<string> keys = randomKeys(count, 15, 1);
+    vector<size_t> picks = randomPicks(1000000, count, 2);
+    printf("%zu keys\ntree      contains M ops/s\n", count);
+    printf("%-9s %8.2f\n", "AVLTree", containsRate<AVLTree>(keys, picks));
+    printf("%-9s %8.2f\n", "BTree", containsRate<BTree>(keys, picks));
+}
+
+// ---------------------------------------------------------------------------
+// art: generated URL and path keys, which share long prefixes. Memory is the
+// heap growth while the tree is built, plus the node arena for BalancedTree.
+
+static vector<string> urlKeys(size_t count, uint64_t seed) {
+    static const char* hosts[] = {"www.example.com", "shop.example.com", "api.example.org",
+                                  "cdn.example.net", "docs.example.io", "m.example.com"};
+    static const char* segments[] = {"products", "users", "images", "search", "v1", "v2",
+                                     "items", "category", "reviews", "assets", "en", "de"};
+    mt19937_64 rng(seed);
+    vector<string> keys(count);
+    for (string& key : keys) {
+        key = string("https://") + hosts[rng() % 6] + "/" + segments[rng() % 12] + "/"
+              + segments[rng() % 12] + "/" + to_string(rng() % 10000000);
+    }
+    return keys;
+}
+
+static vector<string> pathKeys(size_t count, uint64_t seed) {
+    static const char* dirs[] = {"src", "include", "lib", "test", "docs", "build", "tools",
+                                 "core", "util", "net", "io", "ui"};
+    static const char* extensions[] = {"cpp", "h", "py", "txt", "md", "json"};
+    mt19937_64 rng(seed);
+    vector<string> keys(count);
+    for (string& key : keys) {
+        key = "/home/user" + to_string(rng() % 50) + "/projects/" + dirs[rng() % 12] + "/"
+              + dirs[rng() % 12] + "/" + dirs[rng() % 12] + "/file" + to_string(rng() % 100000)
+              + "." + extensions[rng() % 6];
+    }
+    return keys;
+}
+
+static size_t heapBytes() {
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+template <class Tree>
+static void benchKeys(const char* keyName, const char* treeName, const vector<string>& keys,
+                      const vector<size_t>& picks) {
+    size_t heapBefore = heapBytes();
+    Tree tree;
+    double insert = insertAll(tree, keys);
+    size_t bytes = heapBytes() - heapBefore;
+    if constexpr (requires { tree.reservedBytes(); }) {
+        bytes += tree.reservedBytes();
+    }
+    double lookup = lookups(tree, keys, picks);
+    printf("%-6s %-8s %7.2f %9.2f %7zu MB\n", keyName, treeName, insert, lookup, bytes >> 20);
+}
+
+static void benchART(size_t count) {
+    vector<size_t> picks = randomPicks(1000000, count, 2);
+    vector<string> urls = urlKeys(count, 1);
+    vector<string> paths = pathKeys(count, 1);
+    printf("%zu keys, 1e6 lookups\nkeys   tree      insert   lookups   memory\n", count);
+    benchKeys<AVLTree>("URLs", "AVLTree", urls, picks);
+    benchKeys<ARTree>("URLs", "ARTree", urls, picks);
+    benchKeys<AVLTree>("paths", "AVLTree", paths, picks);
+    benchKeys<ARTree>("paths", "ARTree", paths, picks);
+}
+
+// ---------------------------------------------------------------------------
+// hugepages: get() and findRange() on a tree whose node arena is backed by
+// transparent huge pages, then on the same keys with THP disabled for the
+// process (prctl(PR_SET_THP_DISABLE)). dTLB load misses are counted with a
+// perf event where the kernel allows it, and reported as n/a otherwise.
+
+// dTLB load misses of the calling thread between start() and stop().
+class TLBMissCounter {
+public:
+    TLBMissCounter() : fd(-1) {
+#ifdef __linux__
+        perf_event_attr attr{};
+        attr.size = sizeof attr;
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                      | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+
+    ~TLBMissCounter() {
+#ifdef __linux__
+        if (fd >= 0) {
+            close(fd);
+        }
+#endif
+    }
+
+    void start() {
+#ifdef __linux__
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    // Misses counted since start(), or -1 if they cannot be counted.
+    long long stop() {
+#ifdef __linux__
+        long long count = 0;
+        if (fd >= 0 && ioctl(fd, PERF_EVENT_IOC_DISABLE, 0) == 0
+            && read(fd, &count, sizeof count) == sizeof count) {
+            return count;
+        }
+#endif
+        return -1;
+    }
+
+private:
+    int fd;
+};
+
+// Huge pages actually backing anonymous memory, from /proc/self/smaps_rollup.
+static size_t anonHugePagesMB() {
+    ifstream in("/proc/self/smaps_rollup");
+    string field;
+    size_t kb;
+    while (in >> field) {
+        if (field == "AnonHugePages:" && in >> kb) {
+            return kb >> 10;
+        }
+    }
+    return 0;
+}
+
+static string perOperation(long long misses, size_t operations) {
+    if (misses < 0) {
+        return "n/a";
+    }
+    char buf[32];
+    snprintf(buf, sizeof buf, "%.2f", static_cast<double>(misses) / operations);
+    return buf;
+}
+
+static void benchArena(const char* name, const vector<string>& keys, const vector<size_t>& picks) {
+    AVLTree tree;
+    insertAll(tree, keys);
+    TLBMissCounter counter;
+
+    counter.start();
+    double getTime = lookups(tree, keys, picks);
+    long long getMisses = counter.stop();
+
+    // Ranges of about keys / 26^4 keys: the first 4 letters of a key.
+    size_t ranges = picks.size() / 10;
+    counter.start();
+    double rangeTime = seconds([&] {
+        size_t found = 0;
+        for (size_t i = 0; i < ranges; ++i) {
+            const string& low = keys[picks[i]];
+            string high = low;
+            ++high[3];
+            found += tree.findRange(low, high).size();
+        }
+        sink = sink + found;
+    });
+    long long rangeMisses = counter.stop();
+
+    printf("%-13s %7zu %7zu %8.2f %9s %9.1f %11s\n", name, tree.hugePageBytes() >> 20,
+           anonHugePagesMB(), picks.size() / getTime / 1e6,
+           perOperation(getMisses, picks.size()).c_str(), ranges / rangeTime / 1e3,
+           perOperation(rangeMisses, ranges).c_str());
+}
+
+static void benchHugePages(size_t count) {
+    vector<string> keys = randomKeys(count, 15, 1);
+    vector<size_t> picks = randomPicks(1000000, count, 2);
+    printf("%zu keys, 1e6 get, 1e5 findRange\n"
+           "arena         advised   THP MB  get M/s  dTLB/get  range k/s  dTLB/range\n", count);
+    benchArena("huge pages", keys, picks);
+#ifdef __linux__
+    prctl(PR_SET_THP_DISABLE, 1, 0, 0, 0);
+    benchArena("THP disabled", keys, picks);
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// txn: the same random keys inserted into an empty AVLTree with plain
+// insert(), then in committed transactions of 1, 16 and 256 inserts.
+
+static void benchTransaction(size_t count) {
+    vector<string> keys = randomKeys(count, 15, 1);
+    printf("%zu keys\nbatch   seconds\n", count);
+    AVLTree plain;
+    printf("plain %9.2f\n", insertAll(plain, keys));
+    for (size_t batch : {1, 16, 256}) {
+        AVLTree tree;
+        double time = seconds([&] {
+            for (size_t i = 0; i < keys.size(); i += batch) {
+                AVLTree::Transaction transaction(tree);
+                for (size_t j = i; j < min(i + batch, keys.size()); ++j) {
+                    transaction.insert(keys[j], j);
+                }
+                transaction.commit();
+            }
+        });
+        printf("%5zu %9.2f\n", batch, time);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// combining: 2^19 operations split over the threads, three inserts to every
+// get, on random keys out of 'keys', in M ops/s.
+
+// The baseline: every call takes one lock.
+class LockedTree {
+public:
+    bool insert(const string& key, size_t value) {
+        lock_guard<mutex> guard(lock);
+        return tree.insert(key, value);
+    }
+
+    optional<size_t> get(const string& key) {
+        lock_guard<mutex> guard(lock);
+        return tree.get(key);
+    }
+
+private:
+    mutex lock;
+    AVLTree tree;
+};
+
+template <class Tree>
+static double sharedRate(const vector<string>& keys, size_t threadCount) {
+    const size_t operations = size_t{1} << 19;
+    Tree tree;
+    vector<vector<size_t>> picks;
+    for (size_t t = 0; t < threadCount; ++t) {
+        picks.push_back(randomPicks(operations / threadCount, keys.size(), 10 + t));
+    }
+    double elapsed = seconds([&] {
+        vector<thread> threads;
+        for (size_t t = 0; t < threadCount; ++t) {
+            threads.emplace_back([&tree, &keys, &mine = picks[t]] {
+                size_t found = 0;
+                for (size_t i = 0; i < mine.size(); ++i) {
+                    if (i % 4 == 3) {
+                        found += tree.get(keys[mine[i]]).has_value();
+                    } else {
+                        tree.insert(keys[mine[i]], i);
+                    }
+                }
+                sink = sink + found;
+            });
+        }
+        for (thread& t : threads) {
+            t.join();
+        }
+    });
+    return operations / elapsed / 1e6;
+}
+
+static void benchCombining(size_t count) {
+    vector<string> keys = randomKeys(count, 15, 1);
+    printf("%zu keys, 2^19 operations, %u hardware threads\n"
+           "threads      mutex  combining\n", count, thread::hardware_concurrency());
+    for (size_t threads = 1; threads <= 64; threads *= 2) {
+        printf("%7zu %10.2f %10.2f\n", threads, sharedRate<LockedTree>(keys, threads),
+               sharedRate<FlatCombiningTree<AVLTree>>(keys, threads));
+    }
+}
+
+// ---------------------------------------------------------------------------
+// seqlock: 2^22 random get() calls on a seqlocked AVLTree, split over the
+// threads, each read pinning the reclaimer itself or inside a Guard the
+// thread holds over 256 reads. M reads per second.
+
+static double seqlockRate(const AVLTree& tree, const vector<string>& keys, size_t threadCount,
+                          size_t readsPerPin) {
+    const size_t total = size_t{1} << 22;
+    vector<thread> threads;
+    double time = seconds([&] {
+        for (size_t t = 0; t < threadCount; ++t) {
+            threads.emplace_back([&, t] {
+                vector<size_t> picks = randomPicks(total / threadCount, keys.size(), t + 1);
+                size_t found = 0;
+                for (size_t i = 0; i < picks.size(); i += readsPerPin) {
+                    optional<EpochReclaimer::Guard> pin;
+                    if (readsPerPin > 1) {
+                        pin.emplace(*tree.getReclaimer());
+                    }
+                    for (size_t j = i; j < min(i + readsPerPin, picks.size()); ++j) {
+                        found += tree.get(keys[picks[j]]).has_value();
+                    }
+                }
+                sink = sink + found;
+            });
+        }
+        for (thread& t : threads) {
+            t.join();
+        }
+    });
+    return total / time / 1e6;
+}
+
+static void benchSeqlock(size_t count) {
+    vector<string> keys = randomKeys(count, 15, 1);
+    AVLTree tree;
+    insertAll(tree, keys);
+    tree.setSeqlock(true);
+    printf("%zu keys, 2^22 reads, %u hardware threads\n"
+           "threads   per read   per 256\n", count, thread::hardware_concurrency());
+    for (size_t threads = 1; threads <= 8; threads *= 2) {
+        printf("%7zu %10.2f %9.2f\n", threads, seqlockRate(tree, keys, threads, 1),
+               seqlockRate(tree, keys, threads, 256));
+    }
+}
+
+// ---------------------------------------------------------------------------
+// lsm: 'keys' puts compacted into one run, then 200000 more puts timed one
+// by one (every memtable freeze builds a level over that run), then 1e5
+// findRange calls of about 100 keys each.
+
+static void benchLSM(size_t count) {
+    vector<string> keys = randomKeys(count, 15, 1);
+    LSMTree<AVLTree> lsm;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        lsm.put(keys[i], i);
+    }
+    lsm.compact();
+
+    vector<string> fresh = randomKeys(200000, 15, 2);
+    double worst = 0;
+    double total = seconds([&] {
+        for (size_t i = 0; i < fresh.size(); ++i) {
+            worst = max(worst, seconds([&] { lsm.put(fresh[i], i); }));
+        }
+    });
+
+    vector<string> sorted = keys;
+    sort(sorted.begin(), sorted.end());
+    vector<size_t> picks = randomPicks(100000, sorted.size() - min<size_t>(sorted.size() - 1, 100), 3);
+    double ranges = seconds([&] {
+        size_t found = 0;
+        for (size_t pick : picks) {
+            found += lsm.findRange(sorted[pick], sorted[min(pick + 100, sorted.size() - 1)]).size();
+        }
+        sink = sink + found;
+    });
+    printf("%zu keys compacted, then 200000 puts (%zu runs after)\n"
+           "puts s   worst put ms   findRange k/s\n"
+           "%6.3f %14.2f %15.1f\n",
+           count, lsm.runCount(), total, worst * 1e3, picks.size() / ranges / 1e3);
+}
+
+int main(int argc, char* argv[]) {
+    const char* workload = argc > 1 ? argv[1] : "policies";
+    size_t count = argc > 2 ? strtoull(argv[2], nullptr, 10) : 500000;
+    if (count == 0) {
+        count = 1;
+    }
+
+    if (strcmp(workload, "policies") == 0) {
+        benchPolicies(count);
+    } else if (strcmp(workload, "btree") == 0) {
+        benchBTree(count);
+    } else if (strcmp(workload, "art") == 0) {
+        benchART(count);
+    } else if (strcmp(workload, "hugepages") == 0) {
+        benchHugePages(count);
+    } else if (strcmp(workload, "txn") == 0) {
+        benchTransaction(count);
+    } else if (strcmp(workload, "combining") == 0) {
+        benchCombining(count);
+    } else if (strcmp(workload, "seqlock") == 0) {
+        benchSeqlock(count);
+    } else if (strcmp(workload, "lsm") == 0) {
+        benchLSM(count);
+    } else {
+        fprintf(stderr, "usage: %s [policies|btree|art|hugepages|txn|combining|seqlock|lsm] [keys]\n", argv[0]);
+        return 1;
+    }
+    return 0;
+}
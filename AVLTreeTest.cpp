@@ -0,0 +1,700 @@
+/*
+Behaviour tests for BalancedTree (AVLTree, WAVLTree, RedBlackTree, Treap).
+Each test runs against a std::map holding what the tree should hold.
+ */
+#include "AVLTree.h"
+#include "TestCheck.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+using namespace std;
+
+using Model = map<string, size_t>;
+
+// True if 'tree' holds exactly the pairs in 'model'.
+template <class Tree>
+static bool matches(const Tree& tree, const Model& model) {
+    if (tree.size() != model.size()) {
+        return false;
+    }
+    vector<string> keys = tree.keys();
+    if (keys.size() != model.size()) {
+        return false;
+    }
+    size_t i = 0;
+    for (const auto& [k, v] : model) {
+        if (keys[i++] != k || tree.get(k) != optional<size_t>(v)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Worst-case height of each policy for 'n' keys (expected, for a treap).
+template <class Tree>
+static size_t heightBound(size_t n) {
+    double lg = log2(static_cast<double>(n) + 2);
+    if constexpr (is_same_v<Tree, AVLTree>) {
+        return static_cast<size_t>(1.45 * lg) + 1;
+    } else if constexpr (is_same_v<Tree, Treap>) {
+        return static_cast<size_t>(6 * lg);
+    } else {
+        return static_cast<size_t>(2 * lg) + 1;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// append()
+
+template <class Tree>
+static void testAppend() {
+    Tree tree;
+    Model model;
+    for (size_t i = 0; i < 2000; i += 2) {
+        CHECK(tree.append(key(i), i));
+        model[key(i)] = i;
+    }
+    CHECK(matches(tree, model));
+    CHECK(tree.getHeight() <= heightBound<Tree>(tree.size()));
+
+    // Not a new maximum: same result as insert().
+    CHECK(tree.append(key(1), 1));
+    model[key(1)] = 1;
+    CHECK(!tree.append(key(1), 7));
+    CHECK(!tree.append(key(1998), 7));
+    CHECK(tree.append(key(5000), 5000));
+    model[key(5000)] = 5000;
+    CHECK(matches(tree, model));
+
+    Tree empty;
+    CHECK(empty.append("a", 1));
+    CHECK(empty.get("a") == optional<size_t>(1));
+}
+
+// ---------------------------------------------------------------------------
+// Churn: random inserts and removes, then removing everything. Removes are
+// where WAVL differs from AVL (demotions instead of rotations).
+
+template <class Tree>
+static void testChurn() {
+    Tree tree;
+    Model model;
+    mt19937 rng(52);
+    for (size_t i = 0; i < 30000; ++i) {
+        string k = key(rng() % 5000);
+        if (rng() % 2 == 0) {
+            CHECK(tree.remove(k) == (model.erase(k) == 1));
+        } else {
+            CHECK(tree.insert(k, i) == model.emplace(k, i).second);
+        }
+        if (i % 5000 == 0) {
+            CHECK(tree.getHeight() <= heightBound<Tree>(tree.size()));
+        }
+    }
+    CHECK(matches(tree, model));
+    CHECK(tree.getHeight() <= heightBound<Tree>(tree.size()));
+
+    for (const auto& [k, v] : model) {
+        CHECK(tree.remove(k));
+    }
+    CHECK(tree.size() == 0);
+    CHECK(tree.getHeight() == 0);
+    CHECK(tree.keys().empty());
+}
+
+// ---------------------------------------------------------------------------
+// Frozen top levels. Keys share their first 8 bytes in runs of 10, so
+// probes tie with block prefixes and finish with full compares.
+
+static string tiedKey(size_t i) {
+    char buf[32];
+    snprintf(buf, sizeof buf, "%07zu-%03zu", i / 10, i % 10);
+    return buf;
+}
+
+template <class Tree>
+static void testFrozenIndex() {
+    Tree tree;
+    Model model;
+    for (size_t i = 0; i < 3000; i += 2) {
+        tree.insert(tiedKey(i), i);
+        model[tiedKey(i)] = i;
+    }
+    for (size_t levels : {0, 1, 2, 3, 5, 12, 64}) {
+        tree.freezeTop(levels);
+        CHECK(tree.isFrozen() == (levels >= 2));
+        for (size_t i = 0; i < 3002; ++i) {
+            bool present = i % 2 == 0 && i < 3000;
+            CHECK(tree.contains(tiedKey(i)) == present);
+            CHECK(tree.get(tiedKey(i)) == (present ? optional<size_t>(i) : nullopt));
+        }
+        CHECK(!tree.contains(""));
+        CHECK(!tree.contains("\xff"));
+    }
+
+    // operator[] goes through the index and does not drop it.
+    tree.freezeTop();
+    tree[tiedKey(10)] = 77;
+    model[tiedKey(10)] = 77;
+    CHECK(tree.isFrozen());
+    CHECK(tree.get(tiedKey(10)) == optional<size_t>(77));
+
+    // Writes drop it; lookups are right either way.
+    CHECK(tree.insert(tiedKey(11), 11));
+    model[tiedKey(11)] = 11;
+    CHECK(!tree.isFrozen());
+    CHECK(matches(tree, model));
+    tree.freezeTop();
+    CHECK(tree.remove(tiedKey(20)));
+    model.erase(tiedKey(20));
+    CHECK(!tree.isFrozen());
+    CHECK(matches(tree, model));
+
+    tree.freezeTop();
+    tree.unfreeze();
+    CHECK(!tree.isFrozen());
+    CHECK(matches(tree, model));
+}
+
+// ---------------------------------------------------------------------------
+// Relaxed rebalancing (AVL only).
+
+// Largest height of a tree of 'n' nodes whose balance factors stay within
+// +-maxBalance: minNodes(h) = 1 + minNodes(h - 1) + minNodes(h - 1 - maxBalance).
+static size_t relaxedHeightBound(size_t n, size_t maxBalance) {
+    vector<size_t> minNodes{0, 1};
+    while (minNodes.back() <= n) {
+        size_t h = minNodes.size();
+        size_t shorter = h >= 2 + maxBalance ? minNodes[h - 1 - maxBalance] : 0;
+        minNodes.push_back(1 + minNodes[h - 1] + shorter);
+    }
+    return minNodes.size() - 2;
+}
+
+static void testRelaxedRebalancing() {
+    const size_t slack = 2;
+    AVLTree tree;
+    tree.setRebalanceSlack(slack);
+    CHECK(tree.getRebalanceSlack() == slack);
+
+    // Increasing keys: the worst case for a tree that defers rotations.
+    Model model;
+    for (size_t i = 0; i < 20000; ++i) {
+        CHECK(tree.insert(key(i), i));
+        model[key(i)] = i;
+        CHECK(tree.getHeight() <= relaxedHeightBound(tree.size(), 1 + slack));
+    }
+    mt19937 rng(53);
+    for (size_t i = 0; i < 20000; ++i) {
+        string k = key(rng() % 20000);
+        CHECK(tree.remove(k) == (model.erase(k) == 1));
+        CHECK(tree.getHeight() <= relaxedHeightBound(tree.size(), 1 + slack));
+    }
+    CHECK(matches(tree, model));
+
+    tree.rebalanceNow();
+    CHECK(tree.getHeight() <= heightBound<AVLTree>(tree.size()));
+    CHECK(matches(tree, model));
+
+    // Lowering the slack fixes the nodes beyond the new bound first.
+    tree.setRebalanceSlack(4);
+    for (size_t i = 20000; i < 30000; ++i) {
+        tree.insert(key(i), i);
+        model[key(i)] = i;
+    }
+    tree.setRebalanceSlack(0);
+    CHECK(tree.getHeight() <= heightBound<AVLTree>(tree.size()));
+    CHECK(matches(tree, model));
+
+    // The other policies do not defer.
+    WAVLTree wavl;
+    wavl.setRebalanceSlack(slack);
+    CHECK(wavl.getRebalanceSlack() == 0);
+    RedBlackTree rb;
+    rb.setRebalanceSlack(slack);
+    CHECK(rb.getRebalanceSlack() == 0);
+    Treap treap;
+    treap.setRebalanceSlack(slack);
+    CHECK(treap.getRebalanceSlack() == 0);
+}
+
+// Relaxed mode on a tree and its copy-on-write copy, both emptied from the
+// low end by a thread each: the rotations lift the same subtrees, still
+// shared, in both copies, and neither may write them (a race the thread
+// sanitizer sees).
+static void testRelaxedCopy() {
+    const size_t slack = 2;
+    const size_t count = 20000;
+    AVLTree tree;
+    tree.setRebalanceSlack(slack);
+    Model model;
+    mt19937 rng(53);
+    for (size_t i = 0; i < count; ++i) {
+        size_t k = rng() % count;
+        tree.insert(key(k), k);
+        model[key(k)] = k;
+    }
+    AVLTree copy(tree);
+    copy.setRebalanceSlack(slack);
+    Model copyModel = model;
+
+    auto drain = [count, slack](AVLTree& t, Model& m) {
+        for (size_t i = 0; i < count / 2; ++i) {
+            string k = key(i);
+            CHECK(t.remove(k) == (m.erase(k) == 1));
+            CHECK(t.getHeight() <= relaxedHeightBound(t.size(), 1 + slack));
+            this_thread::yield();       // Interleave the two, even on one core
+        }
+    };
+    thread other([&] { drain(copy, copyModel); });
+    drain(tree, model);
+    other.join();
+    CHECK(matches(tree, model));
+    CHECK(matches(copy, copyModel));
+
+    tree.rebalanceNow();
+    CHECK(tree.getHeight() <= heightBound<AVLTree>(tree.size()));
+    CHECK(matches(tree, model));
+    CHECK(matches(copy, copyModel));
+}
+
+// ---------------------------------------------------------------------------
+// Balancing policies: the same calls give the same results on every policy.
+
+static void testPoliciesAgree() {
+    AVLTree avl;
+    WAVLTree wavl;
+    RedBlackTree rb;
+    Treap treap;
+    mt19937 rng(54);
+    for (size_t i = 0; i < 20000; ++i) {
+        string k = key(rng() % 3000);
+        if (rng() % 3 == 0) {
+            bool removed = avl.remove(k);
+            CHECK(wavl.remove(k) == removed);
+            CHECK(rb.remove(k) == removed);
+            CHECK(treap.remove(k) == removed);
+        } else {
+            bool inserted = avl.insert(k, i);
+            CHECK(wavl.insert(k, i) == inserted);
+            CHECK(rb.insert(k, i) == inserted);
+            CHECK(treap.insert(k, i) == inserted);
+        }
+    }
+    CHECK(wavl.keys() == avl.keys());
+    CHECK(rb.keys() == avl.keys());
+    CHECK(treap.keys() == avl.keys());
+    vector<size_t> range = avl.findRange(key(1000), key(2000));
+    CHECK(wavl.findRange(key(1000), key(2000)) == range);
+    CHECK(rb.findRange(key(1000), key(2000)) == range);
+    CHECK(treap.findRange(key(1000), key(2000)) == range);
+}
+
+// ---------------------------------------------------------------------------
+// Compaction: the keys stay put whatever the layout, and compactStep() may be
+// interleaved with writes.
+
+template <class Tree>
+static void testCompact() {
+    using Order = typename Tree::CompactOrder;
+    Tree tree;
+    Model model;
+    mt19937 rng(61);
+    for (size_t i = 0; i < 20000; ++i) {
+        string k = key(rng() % 8000);
+        if (rng() % 3 == 0) {
+            tree.remove(k);
+            model.erase(k);
+        } else {
+            tree.insert(k, i);
+            model.emplace(k, i);
+        }
+    }
+    for (Order order : {Order::InOrder, Order::VanEmdeBoas}) {
+        tree.freezeTop();
+        tree.compact(order);
+        CHECK(!tree.isFrozen());
+        CHECK(matches(tree, model));
+        CHECK(tree.getHeight() <= heightBound<Tree>(tree.size()));
+    }
+
+    size_t steps = 0;
+    bool done = false;
+    while (!done) {
+        done = tree.compactStep(100);
+        ++steps;
+        string k = key(rng() % 8000);
+        if (rng() % 2 == 0) {
+            CHECK(tree.remove(k) == (model.erase(k) == 1));
+        } else {
+            CHECK(tree.insert(k, steps) == model.emplace(k, steps).second);
+        }
+        string counter = key(rng() % 8000);
+        ++tree[counter];
+        ++model[counter];
+    }
+    CHECK(steps > 1);
+    CHECK(matches(tree, model));
+
+    // Compacting a copy leaves the original alone.
+    Tree copy = tree;
+    copy.compact(Order::VanEmdeBoas);
+    CHECK(copy.remove(model.begin()->first));
+    CHECK(matches(tree, model));
+
+    Tree empty;
+    empty.compact();
+    CHECK(empty.compactStep(10));
+    CHECK(empty.size() == 0);
+}
+
+// ---------------------------------------------------------------------------
+// clear() / clearAsync(): the tree is empty and usable at once, and a copy
+// sharing the nodes keeps them.
+
+template <class Tree>
+static void testClear() {
+    for (bool async : {false, true}) {
+        Tree tree;
+        Model model;
+        for (size_t i = 0; i < 50000; ++i) {
+            tree.append(key(i), i);
+            model[key(i)] = i;
+        }
+        Tree copy = tree;
+        copy.remove(key(0));
+        tree.freezeTop();
+        if (async) {
+            tree.clearAsync();
+        } else {
+            tree.clear();
+        }
+        CHECK(tree.size() == 0);
+        CHECK(tree.getHeight() == 0);
+        CHECK(!tree.isFrozen());
+        CHECK(!tree.contains(key(1)));
+
+        model.erase(key(0));
+        CHECK(matches(copy, model));
+        CHECK(tree.insert(key(1), 1));
+        CHECK(tree.get(key(1)) == optional<size_t>(1));
+        tree.clear();
+        tree.clear();
+        CHECK(tree.size() == 0);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Move and swap take the nodes over without copying.
+
+template <class Tree>
+static void testMoveSwap() {
+    static_assert(is_nothrow_move_constructible_v<Tree>);
+    static_assert(is_nothrow_move_assignable_v<Tree>);
+    static_assert(is_nothrow_swappable_v<Tree>);
+
+    Tree a;
+    Model modelA;
+    for (size_t i = 0; i < 1000; ++i) {
+        a.insert(key(i), i);
+        modelA[key(i)] = i;
+    }
+    Tree b;
+    Model modelB{{"b", 2}};
+    b.insert("b", 2);
+
+    a.freezeTop();
+    swap(a, b);
+    CHECK(matches(a, modelB));
+    CHECK(matches(b, modelA));
+    CHECK(b.isFrozen());
+    a.swap(b);
+    CHECK(matches(a, modelA));
+    CHECK(matches(b, modelB));
+
+    Tree moved(std::move(a));
+    CHECK(matches(moved, modelA));
+    CHECK(a.size() == 0);
+    CHECK(a.insert("a", 1));
+    CHECK(a.get("a") == optional<size_t>(1));
+
+    b = std::move(moved);
+    CHECK(matches(b, modelA));
+    CHECK(matches(moved, modelB));
+    b.remove(key(0));
+    modelA.erase(key(0));
+    CHECK(matches(b, modelA));
+}
+
+// ---------------------------------------------------------------------------
+// Copy-on-write: copies are independent, and a frozen index never outlives
+// the nodes it points at.
+
+template <class Tree>
+static void testCopyOnWrite() {
+    Tree tree;
+    Model model;
+    for (size_t i = 0; i < 4000; i += 2) {
+        tree.insert(key(i), i);
+        model[key(i)] = i;
+    }
+    {
+        Tree copy = tree;
+        Model copyModel = model;
+        for (size_t i = 0; i < 4000; i += 3) {
+            CHECK(copy.remove(key(i)) == (copyModel.erase(key(i)) == 1));
+            CHECK(tree.insert(key(i + 1), i) == model.emplace(key(i + 1), i).second);
+        }
+        copy[key(2)] = 99;
+        copyModel[key(2)] = 99;
+        CHECK(matches(tree, model));
+        CHECK(matches(copy, copyModel));
+    }
+
+    // Writes that change nothing still copy the path they walked, dropping
+    // this tree's references to the old nodes; once the copy that still held
+    // them is gone, the index must not lead there. Keys longer than the
+    // std::string inline buffer, so a stale walk reads freed memory.
+    for (bool duplicate : {true, false}) {
+        Tree frozen;
+        Model frozenModel;
+        for (size_t i = 0; i < 3000; ++i) {
+            string k = key(i) + string(24, 'x');
+            frozen.insert(k, i);
+            frozenModel[k] = i;
+        }
+        frozen.freezeTop();
+        {
+            Tree copy = frozen;
+            if (duplicate) {
+                CHECK(!frozen.insert(key(1500) + string(24, 'x'), 0));
+            } else {
+                CHECK(!frozen.remove(key(1500)));
+            }
+            copy.clear();
+        }
+        Tree reuse = frozen;
+        for (size_t i = 0; i < 3000; ++i) {
+            reuse.insert(key(i) + string(24, 'y'), i);
+        }
+        CHECK(matches(frozen, frozenModel));
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Transactions: nothing reaches the tree before commit().
+
+template <class Tree>
+static void testTransaction() {
+    Tree tree;
+    Model model;
+    for (size_t i = 0; i < 1000; i += 2) {
+        tree.insert(key(i), i);
+        model[key(i)] = i;
+    }
+
+    // Rolled back; committed while a copy shares the tree (through a staged
+    // copy); committed with the copy gone (in place).
+    for (int round = 0; round < 3; ++round) {
+        bool commit = round > 0;
+        auto copy = make_unique<Tree>(tree);
+        Model txModel = model;
+        typename Tree::Transaction tx(tree);
+        mt19937 rng(66);
+        for (size_t i = 0; i < 3000; ++i) {
+            string k = key(rng() % 1000);
+            switch (rng() % 3) {
+            case 0:
+                CHECK(tx.remove(k) == (txModel.erase(k) == 1));
+                break;
+            case 1:
+                CHECK(tx.insert(k, i) == txModel.emplace(k, i).second);
+                break;
+            default: {
+                bool present = txModel.count(k) == 1;
+                CHECK(tx.assign(k, i) == present);
+                if (present) {
+                    txModel[k] = i;
+                }
+                break;
+            }
+            }
+            CHECK(tx.get(k) == (txModel.count(k) ? optional<size_t>(txModel[k]) : nullopt));
+        }
+        CHECK(matches(tree, model));
+        CHECK(matches(*copy, model));
+        CHECK(tx.isOpen());
+        if (round == 2) {
+            copy.reset();
+        }
+        if (commit) {
+            tx.commit();
+            model = txModel;
+        } else {
+            tx.rollback();
+        }
+        CHECK(!tx.isOpen());
+        CHECK(!tx.insert(key(1), 1));
+        CHECK(matches(tree, model));
+        CHECK(tree.getHeight() <= heightBound<Tree>(tree.size()));
+        tree.insert(key(5000), 5000);
+        model[key(5000)] = 5000;
+        CHECK(matches(tree, model));
+    }
+
+    // Destroyed open: rolled back. Assigns in place are not visible either.
+    {
+        typename Tree::Transaction tx(tree);
+        CHECK(tx.assign(model.begin()->first, 123));
+        CHECK(tree.get(model.begin()->first) == optional<size_t>(model.begin()->second));
+        CHECK(!tx.assign("missing", 1));
+    }
+    CHECK(matches(tree, model));
+
+    // A committed transaction on a frozen, seqlocked tree with a live copy.
+    tree.setSeqlock(true);
+    tree.freezeTop();
+    Tree copy = tree;
+    Model copyModel = model;
+    string first = model.begin()->first;
+    string second = next(model.begin())->first;
+    {
+        typename Tree::Transaction tx(tree);
+        CHECK(tx.assign(first, 123));
+        CHECK(tx.remove(second));
+        tx.commit();
+    }
+    model[first] = 123;
+    model.erase(second);
+    CHECK(matches(tree, model));
+    CHECK(matches(copy, copyModel));
+}
+
+// ---------------------------------------------------------------------------
+// Seqlock mode: lock-free readers alongside a writer that inserts, removes,
+// compacts and commits transactions. Keys below 1000 are always present;
+// every key maps to its own index.
+
+template <class Tree>
+static void testSeqlock() {
+    Tree tree;
+    tree.setSeqlock(true);
+    for (size_t i = 0; i < 1000; ++i) {
+        tree.insert(key(i), i);
+    }
+    atomic<bool> done{false};
+    vector<thread> readers;
+    for (size_t t = 0; t < 2; ++t) {
+        readers.emplace_back([&tree, &done, t] {
+            mt19937 rng(70 + t);
+            while (!done.load()) {
+                size_t i = rng() % 3000;
+                optional<size_t> found = tree.get(key(i));
+                CHECK(found ? *found == i : i >= 1000);
+                CHECK(i >= 1000 || tree.contains(key(i)));
+            }
+        });
+    }
+
+    mt19937 rng(70);
+    for (size_t round = 0; round < 200; ++round) {
+        for (size_t j = 0; j < 50; ++j) {
+            size_t i = 1000 + rng() % 2000;
+            if (rng() % 2 == 0) {
+                tree.remove(key(i));
+            } else {
+                tree.insert(key(i), i);
+            }
+        }
+        switch (round % 4) {
+        case 0:
+            tree.compact(round % 8 == 0 ? Tree::CompactOrder::InOrder
+                                        : Tree::CompactOrder::VanEmdeBoas);
+            break;
+        case 1:
+            tree.compactStep(500);
+            break;
+        case 2: {
+            typename Tree::Transaction tx(tree);
+            tx.insert(key(1000 + round), 1000 + round);
+            tx.remove(key(2000 + round));
+            tx.commit();
+            break;
+        }
+        default:
+            tree.append(key(3000 + round), 3000 + round);
+            tree.remove(key(3000 + round));
+            break;
+        }
+    }
+    done.store(true);
+    for (thread& reader : readers) {
+        reader.join();
+    }
+    for (size_t i = 0; i < 1000; ++i) {
+        CHECK(tree.get(key(i)) == optional<size_t>(i));
+    }
+}
+
+// ---------------------------------------------------------------------------
+// findOrInsert: counters bumped through the reference it returns, on a tree
+// whose nodes a copy taken before each round shares.
+
+template <class Tree>
+static void testFindOrInsert() {
+    Tree tree;
+    Model model;
+    mt19937 rng(75);
+    for (size_t round = 0; round < 4; ++round) {
+        Tree copy = tree;
+        Model copyModel = model;
+        for (size_t i = 0; i < 5000; ++i) {
+            string k = key(rng() % 2000);
+            auto [value, added] = tree.findOrInsert(k, 1);
+            bool missing = model.count(k) == 0;
+            CHECK(added == missing);
+            if (!missing) {
+                CHECK(value == model[k]);
+                ++value;
+            }
+            ++model[k];
+        }
+        CHECK(matches(tree, model));
+        CHECK(matches(copy, copyModel));
+        CHECK(tree.getHeight() <= heightBound<Tree>(tree.size()));
+    }
+    CHECK(tree[key(1)] == model[key(1)]);
+}
+
+template <class Tree>
+static void testTree() {
+    testAppend<Tree>();
+    testChurn<Tree>();
+    testFrozenIndex<Tree>();
+    testCopyOnWrite<Tree>();
+    testCompact<Tree>();
+    testClear<Tree>();
+    testMoveSwap<Tree>();
+    testTransaction<Tree>();
+    testSeqlock<Tree>();
+    testFindOrInsert<Tree>();
+}
+
+int main() {
+    testTree<AVLTree>();
+    testTree<WAVLTree>();
+    testTree<RedBlackTree>();
+    testTree<Treap>();
+    testPoliciesAgree();
+    testRelaxedRebalancing();
+    testRelaxedCopy();
+    return testResult();
+}
@@ -0,0 +1,199 @@
+/*
+Tree driven by a single writer thread fed through a lock-free MPSC queue.
+ */
+
+#include "AsyncTree.h"
+
+#include <algorithm>
+
+template <class Tree>
+AsyncTree<Tree>::AsyncTree() : head(&stub), tail(&stub), queued(0) {
+    stub.kind = Operation::Kind::Stop;        // never applied, only links
+    writer = std::thread([this] { run(); });
+}
+
+template <class Tree>
+AsyncTree<Tree>::~AsyncTree() {
+    auto* op = new Operation;
+    op->kind = Operation::Kind::Stop;
+    push(op);
+    writer.join();
+}
+
+// Publishing is one exchange; the link from the previous operation follows,
+// so the writer can briefly see the new head without a way to reach it.
+template <class Tree>
+void AsyncTree<Tree>::link(Operation* op) {
+    op->next.store(nullptr, std::memory_order_relaxed);
+    Operation* prev = head.exchange(op, std::memory_order_acq_rel);
+    prev->next.store(op, std::memory_order_release);
+}
+
+template <class Tree>
+void AsyncTree<Tree>::push(Operation* op) {
+    link(op);
+    if (queued.fetch_add(1, std::memory_order_release) == 0) {
+        queued.notify_one();
+    }
+}
+
+template <class Tree>
+typename AsyncTree<Tree>::Operation* AsyncTree<Tree>::pop() {
+    Operation* first = tail;
+    Operation* next = first->next.load(std::memory_order_acquire);
+    if (first == &stub) {
+        if (!next) {
+            return nullptr;
+        }
+        tail = next;
+        first = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+    if (next) {
+        tail = next;
+        return first;
+    }
+    if (first != head.load(std::memory_order_acquire)) {
+        return nullptr;                       // a push is linking in behind 'first'
+    }
+    // 'first' is the last operation: put the stub behind it so it can go.
+    link(&stub);
+    next = first->next.load(std::memory_order_acquire);
+    if (next) {
+        tail = next;
+        return first;
+    }
+    return nullptr;
+}
+
+template <class Tree>
+void AsyncTree<Tree>::apply(Operation& op) {
+    switch (op.kind) {
+    case Operation::Kind::Insert:
+        op.result = tree.insert(op.key, op.value);
+        break;
+    case Operation::Kind::Remove:
+        op.result = tree.remove(op.key);
+        break;
+    case Operation::Kind::Get:
+        op.read = tree.get(op.key);
+        break;
+    case Operation::Kind::Stop:
+        break;
+    }
+}
+
+template <class Tree>
+void AsyncTree<Tree>::complete(Operation& op) {
+    if (op.done) {
+        op.done(op.result);
+    } else if (op.written) {
+        op.written->set_value(op.result);
+    } else if (op.found) {
+        op.found->set_value(op.read);
+    }
+}
+
+// The batch is applied in key order but completed in queue order, so results
+// reach each producer in the order it queued its operations.
+template <class Tree>
+void AsyncTree<Tree>::run() {
+    std::vector<Operation*> batch;
+    std::vector<Operation*> sorted;
+    batch.reserve(MaxBatch);
+    sorted.reserve(MaxBatch);
+    bool stopping = false;
+
+    while (!stopping) {
+        batch.clear();
+        while (batch.size() < MaxBatch) {
+            Operation* op = pop();
+            if (!op) {
+                break;
+            }
+            batch.push_back(op);
+        }
+        if (batch.empty()) {
+            // Nothing reachable yet: sleep until a push, or retry at once if
+            // one is only halfway through.
+            if (queued.load(std::memory_order_acquire) == 0) {
+                queued.wait(0, std::memory_order_acquire);
+            } else {
+                std::this_thread::yield();
+            }
+            continue;
+        }
+
+        sorted.assign(batch.begin(), batch.end());
+        std::stable_sort(sorted.begin(), sorted.end(),
+                         [](const Operation* a, const Operation* b) { return a->key < b->key; });
+        for (Operation* op : sorted) {
+            apply(*op);
+            stopping |= op->kind == Operation::Kind::Stop;
+        }
+        for (Operation* op : batch) {
+            complete(*op);
+            delete op;
+        }
+        queued.fetch_sub(batch.size(), std::memory_order_release);
+    }
+}
+
+template <class Tree>
+std::future<bool> AsyncTree<Tree>::insert(const KeyType& key, ValueType value) {
+    auto* op = new Operation;
+    op->kind = Operation::Kind::Insert;
+    op->key = key;
+    op->value = value;
+    std::future<bool> result = op->written.emplace().get_future();
+    push(op);
+    return result;
+}
+
+template <class Tree>
+std::future<bool> AsyncTree<Tree>::remove(const KeyType& key) {
+    auto* op = new Operation;
+    op->kind = Operation::Kind::Remove;
+    op->key = key;
+    std::future<bool> result = op->written.emplace().get_future();
+    push(op);
+    return result;
+}
+
+template <class Tree>
+std::future<std::optional<typename AsyncTree<Tree>::ValueType>>
+AsyncTree<Tree>::get(const KeyType& key) {
+    auto* op = new Operation;
+    op->kind = Operation::Kind::Get;
+    op->key = key;
+    auto result = op->found.emplace().get_future();
+    push(op);
+    return result;
+}
+
+template <class Tree>
+void AsyncTree<Tree>::insert(const KeyType& key, ValueType value, std::function<void(bool)> done) {
+    auto* op = new Operation;
+    op->kind = Operation::Kind::Insert;
+    op->key = key;
+    op->value = value;
+    op->done = std::move(done);
+    push(op);
+}
+
+template <class Tree>
+void AsyncTree<Tree>::remove(const KeyType& key, std::function<void(bool)> done) {
+    auto* op = new Operation;
+    op->kind = Operation::Kind::Remove;
+    op->key = key;
+    op->done = std::move(done);
+    push(op);
+}
+
+// Everything queued before this call is completed before its Get.
+template <class Tree>
+void AsyncTree<Tree>::flush() {
+    get(KeyType()).wait();
+}
+
+INSTANTIATE_FOR_EACH_TREE(AsyncTree);
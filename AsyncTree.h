@@ -0,0 +1,102 @@
+#ifndef ASYNCTREE_H
+#define ASYNCTREE_H
+
+#include "AVLTree.h"
+
+#include <atomic>
+#include <functional>
+#include <future>
+#include <optional>
+#include <thread>
+#include <vector>
+
+// A tree owned by one writer thread that all other threads hand their
+// operations to (delegation), instead of taking turns on a lock.
+//
+// Producers push operations onto a lock-free multi-producer single-consumer
+// queue (Vyukov's intrusive MPSC list: one atomic exchange per push) and get
+// a future, or a callback that runs on the writer thread. The writer drains
+// up to MaxBatch operations at a time, sorts them by key (stably, so
+// operations on the same key keep their order) and applies them in key
+// order, so consecutive descents share most of their path in cache. Results
+// are handed out in queue order once the whole batch is applied. When the
+// queue is empty the writer sleeps on an atomic wait.
+//
+// insert / remove / get / flush may be called from any number of threads at
+// once. One thread's operations are applied in the order it queued them.
+// The destructor must not run alongside them; it applies everything queued
+// before it.
+template <class Tree>
+class AsyncTree {
+public:
+    using KeyType   = typename Tree::KeyType;
+    using ValueType = typename Tree::ValueType;
+
+    // Most operations applied per batch.
+    static constexpr size_t MaxBatch = 256;
+
+private:
+    struct Operation {
+        enum class Kind { Insert, Remove, Get, Stop };
+
+        std::atomic<Operation*> next{nullptr};
+        Kind      kind;
+        KeyType   key;
+        ValueType value;
+
+        // Completion: a callback, or one of the promises (set by the writer).
+        std::function<void(bool)> done;
+        std::optional<std::promise<bool>> written;
+        std::optional<std::promise<std::optional<ValueType>>> found;
+
+        bool result = false;
+        std::optional<ValueType> read;
+    };
+
+    Tree tree;
+
+    // Producers exchange themselves in at 'head'; the writer pops at 'tail'.
+    // 'stub' keeps the list non-empty.
+    std::atomic<Operation*> head;
+    Operation* tail;
+    Operation stub;
+
+    // Operations pushed and not yet completed; the writer waits on it.
+    std::atomic<size_t> queued;
+
+    std::thread writer;
+
+    // Appends 'op' to the queue; push() also counts it and wakes the writer.
+    void link(Operation* op);
+    void push(Operation* op);
+
+    // Next operation, or nullptr if the queue is empty or a push is halfway.
+    Operation* pop();
+
+    void run();
+    void apply(Operation& op);
+    static void complete(Operation& op);
+
+public:
+    AsyncTree();
+    ~AsyncTree();
+
+    AsyncTree(const AsyncTree&) = delete;
+    AsyncTree& operator=(const AsyncTree&) = delete;
+
+    // Same results as on the tree itself, delivered through the future.
+    std::future<bool> insert(const KeyType& key, ValueType value);
+    std::future<bool> remove(const KeyType& key);
+    std::future<std::optional<ValueType>> get(const KeyType& key);
+
+    // Same, but 'done' runs on the writer thread with the result; it may be
+    // empty (fire and forget). It must not wait for this tree.
+    void insert(const KeyType& key, ValueType value, std::function<void(bool)> done);
+    void remove(const KeyType& key, std::function<void(bool)> done);
+
+    // Returns once every operation queued before the call has been applied
+    // and its future set or callback run.
+    void flush();
+};
+
+#endif
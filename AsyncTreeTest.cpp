@@ -0,0 +1,104 @@
+/*
+Tests for AsyncTree: results in queue order, callbacks, and many producers.
+ */
+#include "AsyncTree.h"
+#include "TestCheck.h"
+
+#include <atomic>
+#include <cstdio>
+#include <future>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Many operations in flight from one producer: batches are applied in key
+// order, but each result is the one the operations give in queue order.
+static void testQueueOrder() {
+    AsyncTree<AVLTree> async;
+    AVLTree tree;
+    vector<future<bool>> writes;
+    vector<bool> expected;
+    vector<future<optional<size_t>>> reads;
+    vector<optional<size_t>> expectedReads;
+    mt19937 rng(67);
+    for (size_t i = 0; i < 20000; ++i) {
+        string k = key(rng() % 300);
+        switch (rng() % 3) {
+        case 0:
+            writes.push_back(async.remove(k));
+            expected.push_back(tree.remove(k));
+            break;
+        case 1:
+            writes.push_back(async.insert(k, i));
+            expected.push_back(tree.insert(k, i));
+            break;
+        default:
+            reads.push_back(async.get(k));
+            expectedReads.push_back(tree.get(k));
+            break;
+        }
+    }
+    for (size_t i = 0; i < writes.size(); ++i) {
+        CHECK(writes[i].get() == expected[i]);
+    }
+    for (size_t i = 0; i < reads.size(); ++i) {
+        CHECK(reads[i].get() == expectedReads[i]);
+    }
+}
+
+// Callbacks run on the writer thread; flush() waits for them, and the
+// destructor applies what is still queued.
+static void testCallbacks() {
+    atomic<size_t> inserted{0};
+    atomic<size_t> removed{0};
+    {
+        AsyncTree<WAVLTree> async;
+        for (size_t i = 0; i < 1000; ++i) {
+            async.insert(key(i), i, [&inserted](bool ok) { inserted += ok; });
+            async.insert(key(i), i, [&inserted](bool ok) { inserted += ok; });
+        }
+        async.flush();
+        CHECK(inserted.load() == 1000);
+        for (size_t i = 0; i < 1000; i += 2) {
+            async.remove(key(i), [&removed](bool ok) { removed += ok; });
+            async.remove(key(i), {});
+        }
+        async.remove(key(1), nullptr);
+    }
+    CHECK(removed.load() == 500);
+}
+
+// Producers on disjoint keys: every one sees its own writes in order.
+static void testProducers() {
+    AsyncTree<AVLTree> async;
+    vector<thread> threads;
+    for (size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&async, t] {
+            vector<future<bool>> results;
+            for (size_t i = 0; i < 3000; ++i) {
+                results.push_back(async.insert(key(i * 4 + t), i));
+                results.push_back(async.remove(key(i * 4 + t)));
+                results.push_back(async.insert(key(i * 4 + t), i));
+            }
+            for (future<bool>& result : results) {
+                CHECK(result.get());
+            }
+            CHECK(async.get(key(t)).get() == optional<size_t>(0));
+        });
+    }
+    for (thread& t : threads) {
+        t.join();
+    }
+    async.flush();
+    CHECK(async.get(key(4 * 2999 + 3)).get() == optional<size_t>(2999));
+}
+
+int main() {
+    testQueueOrder();
+    testCallbacks();
+    testProducers();
+    return testResult();
+}
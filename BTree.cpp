@@ -0,0 +1,442 @@
+/*
+B-tree map with the same interface as AVLTree. Uses the classic single-pass
+algorithms: full nodes are split on the way down during insert, and nodes that
+are too small are refilled (borrow or merge) on the way down during remove.
+ */
+
+#include "BTree.h"
+
+#include <utility>
+
+BTree::BTreeNode::BTreeNode(bool isLeaf) : count(0), leaf(isLeaf) {
+    for (size_t i = 0; i <= MaxKeys; ++i) {
+        prefix[i] = kPrefixPad;
+        children[i] = nullptr;
+    }
+}
+
+size_t BTree::BTreeNode::lowerBound(const KeyType& key) const {
+    size_t less;
+    size_t lessEqual;
+    prefixRank(prefix, count, keyPrefix(key), less, lessEqual);
+
+    // Keys before 'less' are smaller, keys from 'lessEqual' on are larger;
+    // only the ones sharing the probe's prefix need a full compare.
+    for (size_t i = less; i < lessEqual; ++i) {
+        if (!(keys[i] < key)) {
+            return i;
+        }
+    }
+    return lessEqual;
+}
+
+void BTree::BTreeNode::setKey(size_t i, KeyType key) {
+    prefix[i] = keyPrefix(key);
+    keys[i] = std::move(key);
+}
+
+void BTree::BTreeNode::insertAt(size_t i, KeyType key, ValueType value, BTreeNode* rightChild) {
+    for (size_t j = count; j > i; --j) {
+        keys[j]   = std::move(keys[j - 1]);
+        values[j] = values[j - 1];
+        prefix[j] = prefix[j - 1];
+        children[j + 1] = children[j];
+    }
+    setKey(i, std::move(key));
+    values[i] = value;
+    children[i + 1] = rightChild;
+    ++count;
+}
+
+void BTree::BTreeNode::eraseAt(size_t i) {
+    for (size_t j = i; j + 1 < count; ++j) {
+        keys[j]   = std::move(keys[j + 1]);
+        values[j] = values[j + 1];
+        prefix[j] = prefix[j + 1];
+        children[j + 1] = children[j + 2];
+    }
+    --count;
+    keys[count].clear();
+    prefix[count] = kPrefixPad;
+    children[count + 1] = nullptr;
+}
+
+// Default constructor: start with an empty tree.
+BTree::BTree() : root(nullptr), treeSize(0) {}
+
+// Copy constructor: deep-copy the other tree.
+BTree::BTree(const BTree& other) : root(nullptr), treeSize(0) {
+    root = copyTree(other.root);
+    treeSize = other.treeSize;
+}
+
+// Assignment operator: clear current tree, then deep-copy other.
+BTree& BTree::operator=(const BTree& other) {
+    if (this != &other) {
+        clearTree(root);
+        root = copyTree(other.root);
+        treeSize = other.treeSize;
+    }
+    return *this;
+}
+
+// Destructor: free all nodes.
+BTree::~BTree() {
+    clearTree(root);
+}
+
+//  insert: grows the tree at the top when the root is full.
+bool BTree::insert(const KeyType& key, ValueType value) {
+    if (!root) {
+        root = new BTreeNode(true);
+    }
+    if (root->isFull()) {
+        BTreeNode* newRoot = new BTreeNode(false);
+        newRoot->children[0] = root;
+        root = newRoot;
+        splitChild(root, 0);
+    }
+
+    bool inserted = insertNonFull(root, key, value);
+    if (inserted) {
+        ++treeSize;
+    }
+    return inserted;
+}
+
+bool BTree::insertNonFull(BTreeNode* node, const KeyType& key, ValueType value) {
+    size_t i = node->lowerBound(key);
+    if (i < node->count && node->keys[i] == key) {
+        return false;                         // key already exists
+    }
+
+    if (node->leaf) {
+        node->insertAt(i, key, value, nullptr);
+        return true;
+    }
+
+    if (node->children[i]->isFull()) {
+        splitChild(node, i);
+        // The child's middle key moved up into slot i: pick a side of it.
+        int c = key.compare(node->keys[i]);
+        if (c == 0) {
+            return false;
+        }
+        if (c > 0) {
+            ++i;
+        }
+    }
+    return insertNonFull(node->children[i], key, value);
+}
+
+void BTree::splitChild(BTreeNode* parent, size_t i) {
+    BTreeNode* full = parent->children[i];
+    BTreeNode* right = new BTreeNode(full->leaf);
+
+    // Upper MinDegree-1 keys (and MinDegree children) go to the new node.
+    for (size_t j = 0; j + 1 < MinDegree; ++j) {
+        right->setKey(j, std::move(full->keys[j + MinDegree]));
+        right->values[j] = full->values[j + MinDegree];
+    }
+    if (!full->leaf) {
+        for (size_t j = 0; j < MinDegree; ++j) {
+            right->children[j] = full->children[j + MinDegree];
+            full->children[j + MinDegree] = nullptr;
+        }
+    }
+    right->count = MinDegree - 1;
+
+    KeyType middleKey = std::move(full->keys[MinDegree - 1]);
+    ValueType middleValue = full->values[MinDegree - 1];
+    for (size_t j = MinDegree - 1; j < MaxKeys; ++j) {
+        full->keys[j].clear();
+        full->prefix[j] = kPrefixPad;
+    }
+    full->count = MinDegree - 1;
+
+    parent->insertAt(i, std::move(middleKey), middleValue, right);
+}
+
+//  remove: shrinks the tree at the top when the root runs out of keys.
+bool BTree::remove(const KeyType& key) {
+    if (!root) {
+        return false;
+    }
+
+    bool removed = remove(root, key);
+    if (root->count == 0) {
+        BTreeNode* old = root;
+        root = root->leaf ? nullptr : root->children[0];
+        delete old;
+    }
+    if (removed) {
+        --treeSize;
+    }
+    return removed;
+}
+
+bool BTree::remove(BTreeNode* node, const KeyType& key) {
+    size_t i = node->lowerBound(key);
+
+    if (i < node->count && node->keys[i] == key) {
+        if (node->leaf) {
+            node->eraseAt(i);
+            return true;
+        }
+
+        BTreeNode* left = node->children[i];
+        BTreeNode* right = node->children[i + 1];
+        if (left->count >= MinDegree) {
+            // Replace with the predecessor, then delete that from the left child.
+            BTreeNode* pred = left;
+            while (!pred->leaf) {
+                pred = pred->children[pred->count];
+            }
+            KeyType predKey = pred->keys[pred->count - 1];
+            node->values[i] = pred->values[pred->count - 1];
+            node->setKey(i, predKey);
+            return remove(left, predKey);
+        }
+        if (right->count >= MinDegree) {
+            // Replace with the successor, then delete that from the right child.
+            BTreeNode* succ = right;
+            while (!succ->leaf) {
+                succ = succ->children[0];
+            }
+            KeyType succKey = succ->keys[0];
+            node->values[i] = succ->values[0];
+            node->setKey(i, succKey);
+            return remove(right, succKey);
+        }
+        // Both neighbours are minimal: merge them around the key and retry there.
+        mergeChildren(node, i);
+        return remove(node->children[i], key);
+    }
+
+    if (node->leaf) {
+        return false;                         // key not found
+    }
+    i = fillChild(node, i);
+    return remove(node->children[i], key);
+}
+
+size_t BTree::fillChild(BTreeNode* node, size_t i) {
+    BTreeNode* child = node->children[i];
+    if (child->count >= MinDegree) {
+        return i;
+    }
+
+    if (i > 0 && node->children[i - 1]->count >= MinDegree) {
+        // Borrow through the parent from the left sibling.
+        BTreeNode* sib = node->children[i - 1];
+        child->insertAt(0, std::move(node->keys[i - 1]), node->values[i - 1], child->children[0]);
+        child->children[0] = sib->children[sib->count];
+        node->values[i - 1] = sib->values[sib->count - 1];
+        node->setKey(i - 1, std::move(sib->keys[sib->count - 1]));
+        sib->children[sib->count] = nullptr;
+        sib->eraseAt(sib->count - 1);
+        return i;
+    }
+
+    if (i < node->count && node->children[i + 1]->count >= MinDegree) {
+        // Borrow through the parent from the right sibling.
+        BTreeNode* sib = node->children[i + 1];
+        child->insertAt(child->count, std::move(node->keys[i]), node->values[i], sib->children[0]);
+        node->values[i] = sib->values[0];
+        node->setKey(i, std::move(sib->keys[0]));
+        sib->children[0] = sib->children[1];
+        sib->eraseAt(0);
+        return i;
+    }
+
+    if (i < node->count) {
+        mergeChildren(node, i);
+        return i;
+    }
+    mergeChildren(node, i - 1);
+    return i - 1;
+}
+
+void BTree::mergeChildren(BTreeNode* node, size_t i) {
+    BTreeNode* left = node->children[i];
+    BTreeNode* right = node->children[i + 1];
+
+    left->setKey(left->count, std::move(node->keys[i]));
+    left->values[left->count] = node->values[i];
+    for (size_t j = 0; j < right->count; ++j) {
+        left->setKey(left->count + 1 + j, std::move(right->keys[j]));
+        left->values[left->count + 1 + j] = right->values[j];
+    }
+    if (!left->leaf) {
+        for (size_t j = 0; j <= right->count; ++j) {
+            left->children[left->count + 1 + j] = right->children[j];
+        }
+    }
+    left->count += right->count + 1;
+
+    node->eraseAt(i);                         // also drops the 'right' pointer
+    delete right;
+}
+
+// contains: tells if 'key' is in the tree.
+bool BTree::contains(const KeyType& key) const {
+    size_t slot;
+    return getNode(root, key, slot) != nullptr;
+}
+
+// Returns the value for 'key'. If key not found, returns std::nullopt.
+std::optional<BTree::ValueType> BTree::get(const KeyType& key) const {
+    size_t slot;
+    BTreeNode* found = getNode(root, key, slot);
+    return found ? std::optional<ValueType>(found->values[slot]) : std::nullopt;
+}
+
+BTree::BTreeNode* BTree::getNode(BTreeNode* node, const KeyType& key, size_t& slot) const {
+    if (!node) {
+        return nullptr;
+    }
+    size_t i = node->lowerBound(key);
+    if (i < node->count && node->keys[i] == key) {
+        slot = i;
+        return node;
+    }
+    return node->leaf ? nullptr : getNode(node->children[i], key, slot);
+}
+
+// returns reference to value for 'key', inserting 0 first if needed.
+BTree::ValueType& BTree::operator[](const KeyType& key) {
+    size_t slot;
+    BTreeNode* node = getNode(root, key, slot);
+    if (!node) {
+        insert(key, 0);
+        node = getNode(root, key, slot);
+    }
+    return node->values[slot];
+}
+
+// Returns vector of VALUES whose keys lie between [lowKey, highKey] (inclusive).
+std::vector<BTree::ValueType> BTree::findRange(const KeyType& lowKey,
+                                               const KeyType& highKey) const {
+    std::vector<ValueType> out;
+    findRange(root, lowKey, highKey, out);
+    return out;
+}
+
+void BTree::findRange(const BTreeNode* node,
+                      const KeyType& lowKey,
+                      const KeyType& highKey,
+                      std::vector<ValueType>& result) const {
+    if (!node) {
+        return;
+    }
+
+    // children[i] holds keys between keys[i-1] and keys[i]; everything left
+    // of the first key >= lowKey is out of range.
+    for (size_t i = node->lowerBound(lowKey); i <= node->count; ++i) {
+        if (!node->leaf) {
+            findRange(node->children[i], lowKey, highKey, result);
+        }
+        if (i == node->count || node->keys[i] > highKey) {
+            break;
+        }
+        result.push_back(node->values[i]);
+    }
+}
+
+// Returns all keys currently stored, in sorted order
+std::vector<BTree::KeyType> BTree::keys() const {
+    std::vector<KeyType> result;
+    result.reserve(treeSize);
+    getKeys(root, result);
+    return result;
+}
+
+void BTree::getKeys(const BTreeNode* node, std::vector<KeyType>& result) const {
+    if (!node) {
+        return;
+    }
+    for (size_t i = 0; i < node->count; ++i) {
+        if (!node->leaf) {
+            getKeys(node->children[i], result);
+        }
+        result.push_back(node->keys[i]);
+    }
+    if (!node->leaf) {
+        getKeys(node->children[node->count], result);
+    }
+}
+
+// Returns how many keys are in the tree.
+size_t BTree::size() const {
+    return treeSize;
+}
+
+// All leaves are at the same depth, so follow the leftmost path.
+size_t BTree::getHeight() const {
+    size_t height = 0;
+    for (const BTreeNode* node = root; node; node = node->leaf ? nullptr : node->children[0]) {
+        ++height;
+    }
+    return height;
+}
+
+// copies the subtree rooted at 'other' and returns new root.
+BTree::BTreeNode* BTree::copyTree(const BTreeNode* other) {
+    if (!other) {
+        return nullptr;
+    }
+
+    BTreeNode* n = new BTreeNode(other->leaf);
+    n->count = other->count;
+    for (size_t i = 0; i < other->count; ++i) {
+        n->prefix[i] = other->prefix[i];
+        n->keys[i]   = other->keys[i];
+        n->values[i] = other->values[i];
+    }
+    if (!other->leaf) {
+        for (size_t i = 0; i <= other->count; ++i) {
+            n->children[i] = copyTree(other->children[i]);
+        }
+    }
+    return n;
+}
+
+//  deletes all nodes in subtree rooted at 'node'.
+void BTree::clearTree(BTreeNode* node) {
+    if (!node) {
+        return;
+    }
+    if (!node->leaf) {
+        for (size_t i = 0; i <= node->count; ++i) {
+            clearTree(node->children[i]);
+        }
+    }
+    delete node;
+}
+
+std::ostream& operator<<(std::ostream& os, const BTree& tree) {
+    tree.printTree(os, tree.root);
+    return os;
+}
+
+// One line per node, children indented below it.
+void BTree::printTree(std::ostream& os, const BTreeNode* node, size_t depth) const {
+    if (!node) {
+        return;
+    }
+
+    for (size_t i = 0; i < depth; ++i) {
+        os << "    ";
+    }
+    os << "[";
+    for (size_t i = 0; i < node->count; ++i) {
+        os << (i ? " " : "") << node->keys[i] << ":" << node->values[i];
+    }
+    os << "]\n";
+
+    if (!node->leaf) {
+        for (size_t i = 0; i <= node->count; ++i) {
+            printTree(os, node->children[i], depth + 1);
+        }
+    }
+}
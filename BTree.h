@@ -0,0 +1,154 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <iostream>
+#include <cstdint>
+
+#include "KeyPrefix.h"
+
+// Sibling of AVLTree for large maps: a B-tree that keeps up to 15 keys per
+// node in sorted arrays, so one node visit (a couple of cache lines) replaces
+// about four levels of the binary tree. Searches inside a node compare the
+// probe's 8-byte prefix against all keys at once (see KeyPrefix.h) and only
+// fall back to full string compares for keys sharing that prefix.
+// Same public API as AVLTree.
+class BTree {
+public:
+    using KeyType   = std::string; // Keys stored in the tree
+    using ValueType = size_t;      // Values stored in the tree
+
+private:
+    // Minimum degree t: every node but the root holds t-1 .. 2t-1 keys.
+    static constexpr size_t MinDegree = 8;
+    static constexpr size_t MaxKeys   = 2 * MinDegree - 1;
+
+    // This class represents a single node of the B-tree.
+    class BTreeNode {
+    public:
+        // Prefixes of keys[0, count); the rest is kPrefixPad. Kept first and
+        // cache-line aligned: it is all a search touches until the final compare.
+        alignas(64) int64_t prefix[MaxKeys + 1];
+
+        size_t count;                  // Number of keys in use
+        bool   leaf;                   // True if the node has no children
+
+        KeyType    keys[MaxKeys];      // Sorted keys
+        ValueType  values[MaxKeys];    // values[i] belongs to keys[i]
+        BTreeNode* children[MaxKeys + 1]; // children[i] holds keys between keys[i-1] and keys[i]
+
+        explicit BTreeNode(bool isLeaf);
+
+        bool isFull() const {
+            return count == MaxKeys;
+        }
+
+        // Index of the first key >= 'key' (count if none).
+        size_t lowerBound(const KeyType& key) const;
+
+        // Stores 'key' at slot i and refreshes its prefix.
+        void setKey(size_t i, KeyType key);
+
+        // Opens slot i (shifting keys, values and the children after it right)
+        // and stores the entry with 'rightChild' as children[i + 1].
+        void insertAt(size_t i, KeyType key, ValueType value, BTreeNode* rightChild);
+
+        // Closes slot i, dropping children[i + 1].
+        void eraseAt(size_t i);
+    };
+
+    // Pointer to the root node (nullptr if empty)
+    BTreeNode* root;
+
+    // Number of key-value pairs stored in the tree
+    size_t treeSize;
+
+    // Inserts into a node that is known not to be full, splitting full
+    // children on the way down. Returns false if the key already exists.
+    bool insertNonFull(BTreeNode* node, const KeyType& key, ValueType value);
+
+    // Splits the full child parent->children[i], moving its middle key up.
+    void splitChild(BTreeNode* parent, size_t i);
+
+    // Removes 'key' from the subtree rooted at 'node'. Every node visited
+    // has at least MinDegree keys (except the root), so no fix-up is needed
+    // on the way back. Returns true if a key was removed.
+    bool remove(BTreeNode* node, const KeyType& key);
+
+    // Makes sure node->children[i] has at least MinDegree keys by borrowing
+    // from a sibling or merging with one. Returns the index to descend into.
+    size_t fillChild(BTreeNode* node, size_t i);
+
+    // Merges children[i], keys[i] and children[i + 1] into children[i].
+    void mergeChildren(BTreeNode* node, size_t i);
+
+    // Returns the node holding 'key' and its slot, or nullptr.
+    BTreeNode* getNode(BTreeNode* node, const KeyType& key, size_t& slot) const;
+
+    //  adds all VALUES whose keys are in [lowKey, highKey] to 'result'.
+    void findRange(const BTreeNode* node,
+                   const KeyType& lowKey,
+                   const KeyType& highKey,
+                   std::vector<ValueType>& result) const;
+
+    // in-order traversal pushing all keys into 'result'.
+    void getKeys(const BTreeNode* node, std::vector<KeyType>& result) const;
+
+    // Creates a deep copy of the subtree rooted at 'other' and returns the new root.
+    BTreeNode* copyTree(const BTreeNode* other);
+
+    //  deletes all nodes in subtree rooted at 'node'.
+    void clearTree(BTreeNode* node);
+
+    void printTree(std::ostream& os, const BTreeNode* node, size_t depth = 0) const;
+
+public:
+    //  constructor: creates an empty tree.
+    BTree();
+
+    // Copy constructor: creates a copy of 'other'.
+    BTree(const BTree& other);
+
+    // Assignment operator: clears current tree, then copies 'other'.
+    BTree& operator=(const BTree& other);
+
+    // Destructor: frees all nodes.
+    ~BTree();
+
+    // Inserts (key, value) into the tree.
+    // Returns true if a new entry is inserted, false if key already exists.
+    bool insert(const KeyType& key, ValueType value);
+
+    // Removes the given key from the tree.
+    // Returns true if an entry was removed, false if key not found.
+    bool remove(const KeyType& key);
+
+    // Returns true if the key exists in the tree; false otherwise.
+    bool contains(const KeyType& key) const;
+
+    // Returns the value associated with 'key', or std::nullopt.
+    std::optional<ValueType> get(const KeyType& key) const;
+
+    // Returns reference to value for 'key', inserting 0 if it is missing.
+    ValueType& operator[](const KeyType& key);
+
+    // Returns a vector of all VALUES whose keys lie between [lowKey, highKey].
+    std::vector<ValueType> findRange(const KeyType& lowKey,
+                                     const KeyType& highKey) const;
+
+    // Returns a vector of all keys currently stored in the tree, in sorted order.
+    std::vector<KeyType> keys() const;
+
+    // Returns how many key-value pairs are in the tree (O(1)).
+    size_t size() const;
+
+    // Returns the number of node levels. Empty tree has height 0.
+    size_t getHeight() const;
+
+    // printing using: std::cout << tree;
+    friend std::ostream& operator<<(std::ostream& os, const BTree& tree);
+};
+
+#endif
@@ -0,0 +1,119 @@
+/*
+Behaviour tests for BTree, against a std::map holding what it should hold.
+ */
+#include "BTree.h"
+#include "TestCheck.h"
+
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+using Model = map<string, size_t>;
+
+// Keys share their first 8 bytes in runs of 100, so node searches hit
+// prefix ties and have to finish with full compares.
+static string prefixKey(size_t i) {
+    char buf[32];
+    snprintf(buf, sizeof buf, "prefix%02zu-%05zu", i / 100 % 100, i);
+    return buf;
+}
+
+static bool matches(const BTree& tree, const Model& model) {
+    if (tree.size() != model.size() || tree.keys().size() != model.size()) {
+        return false;
+    }
+    vector<string> keys = tree.keys();
+    size_t i = 0;
+    for (const auto& [k, v] : model) {
+        if (keys[i++] != k || tree.get(k) != optional<size_t>(v) || !tree.contains(k)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static vector<size_t> modelRange(const Model& model, const string& low, const string& high) {
+    vector<size_t> values;
+    for (auto it = model.lower_bound(low); it != model.end() && it->first <= high; ++it) {
+        values.push_back(it->second);
+    }
+    return values;
+}
+
+static void testChurn() {
+    BTree tree;
+    Model model;
+    mt19937 rng(55);
+    for (size_t i = 0; i < 60000; ++i) {
+        string k = prefixKey(rng() % 8000);
+        if (rng() % 3 == 0) {
+            CHECK(tree.remove(k) == (model.erase(k) == 1));
+        } else {
+            CHECK(tree.insert(k, i) == model.emplace(k, i).second);
+        }
+    }
+    CHECK(matches(tree, model));
+    CHECK(!tree.contains("prefix"));
+    CHECK(!tree.get("zzz").has_value());
+
+    // Every node but the root holds at least 7 keys.
+    double fanout = 8;
+    CHECK(tree.getHeight() <= 1 + log(static_cast<double>(tree.size())) / log(fanout) + 1);
+
+    string low = prefixKey(1234), high = prefixKey(5678);
+    CHECK(tree.findRange(low, high) == modelRange(model, low, high));
+    CHECK(tree.findRange("a", "z") == modelRange(model, "a", "z"));
+    CHECK(tree.findRange(prefixKey(10), prefixKey(5)).empty());
+
+    for (const auto& [k, v] : model) {
+        CHECK(tree.remove(k));
+    }
+    CHECK(tree.size() == 0);
+    CHECK(tree.getHeight() == 0);
+}
+
+static void testIndexAndCopy() {
+    BTree tree;
+    for (size_t i = 0; i < 1000; ++i) {
+        tree[prefixKey(i % 100)] += 1;
+    }
+    CHECK(tree.size() == 100);
+    CHECK(tree.get(prefixKey(42)) == optional<size_t>(10));
+
+    BTree copy(tree);
+    copy.remove(prefixKey(42));
+    copy[prefixKey(7)] = 99;
+    CHECK(tree.get(prefixKey(42)) == optional<size_t>(10));
+    CHECK(tree.get(prefixKey(7)) == optional<size_t>(10));
+    CHECK(copy.get(prefixKey(7)) == optional<size_t>(99));
+    CHECK(copy.size() == 99);
+
+    tree = copy;
+    CHECK(tree.keys() == copy.keys());
+}
+
+// Bytes above 0x7f sort after ASCII, as in std::string.
+static void testBinaryKeys() {
+    BTree tree;
+    Model model;
+    for (int i = 0; i < 256; ++i) {
+        string k = "same8byt" + string(1, static_cast<char>(i)) + "x";
+        tree.insert(k, i);
+        model[k] = i;
+        string shortKey(1, static_cast<char>(i));
+        tree.insert(shortKey, 1000 + i);
+        model[shortKey] = 1000 + i;
+    }
+    CHECK(matches(tree, model));
+}
+
+int main() {
+    testChurn();
+    testIndexAndCopy();
+    testBinaryKeys();
+    return testResult();
+}
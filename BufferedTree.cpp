@@ -0,0 +1,183 @@
+/*
+Per-thread write buffers merged into a shared tree in sorted batches.
+ */
+
+#include "BufferedTree.h"
+
+#include <algorithm>
+
+template <class Tree>
+BufferedTree<Tree>::BufferedTree() : registry([this](Buffer* buffer) { retire(buffer); }) {}
+
+// Buffers of threads still running are dropped unmerged with the tree.
+template <class Tree>
+BufferedTree<Tree>::~BufferedTree() {
+    registry.close();
+}
+
+// Buffers belong to the tree, so flushAll() can reach every one of them.
+template <class Tree>
+typename BufferedTree<Tree>::Buffer& BufferedTree<Tree>::localBuffer() {
+    return registry.local([this] {
+        auto owned = std::make_unique<Buffer>();
+        owned->entries.reserve(BufferSize);
+        owned->order.reserve(BufferSize);
+        Buffer* buffer = owned.get();
+        std::lock_guard<std::mutex> guard(buffersLock);
+        buffers.push_back(std::move(owned));
+        return buffer;
+    });
+}
+
+template <class Tree>
+void BufferedTree<Tree>::retire(Buffer* buffer) {
+    std::lock_guard<std::mutex> listGuard(buffersLock);
+    {
+        std::lock_guard<std::mutex> bufferGuard(buffer->lock);
+        std::lock_guard<std::mutex> guard(lock);
+        merge(*buffer);
+    }
+    auto it = std::find_if(buffers.begin(), buffers.end(),
+                           [buffer](const std::unique_ptr<Buffer>& owned) { return owned.get() == buffer; });
+    *it = std::move(buffers.back());
+    buffers.pop_back();
+}
+
+template <class Tree>
+std::vector<uint32_t>::iterator BufferedTree<Tree>::position(Buffer& buffer, const KeyType& key) {
+    return std::lower_bound(buffer.order.begin(), buffer.order.end(), key,
+                            [&buffer](uint32_t index, const KeyType& k) {
+                                return buffer.entries[index].first < k;
+                            });
+}
+
+template <class Tree>
+bool BufferedTree<Tree>::holds(Buffer& buffer, std::vector<uint32_t>::iterator at,
+                               const KeyType& key) {
+    return at != buffer.order.end() && buffer.entries[*at].first == key;
+}
+
+// A put replaces whatever was pending; an add on top of a pending put or add
+// folds into it.
+template <class Tree>
+void BufferedTree<Tree>::buffer(const KeyType& key, Pending pending) {
+    Buffer& local = localBuffer();
+    std::lock_guard<std::mutex> bufferGuard(local.lock);
+    auto at = position(local, key);
+    if (holds(local, at, key)) {
+        Pending& held = local.entries[*at].second;
+        if (pending.assign) {
+            held = pending;
+        } else {
+            held.value += pending.value;
+        }
+        return;
+    }
+    local.order.insert(at, static_cast<uint32_t>(local.entries.size()));
+    local.entries.emplace_back(key, pending);
+    if (local.entries.size() >= BufferSize) {
+        std::lock_guard<std::mutex> guard(lock);
+        merge(local);
+    }
+}
+
+// In key order, so consecutive descents share most of their path. One
+// descent per key: a missing key is inserted with the pending value, which
+// is right for a put and for an add to a counter starting at 0.
+template <class Tree>
+void BufferedTree<Tree>::merge(Buffer& buffer) {
+    for (uint32_t index : buffer.order) {
+        const auto& [key, pending] = buffer.entries[index];
+        auto [value, added] = tree.findOrInsert(key, pending.value);
+        if (!added) {
+            value = pending.assign ? pending.value : value + pending.value;
+        }
+    }
+    buffer.entries.clear();
+    buffer.order.clear();
+}
+
+template <class Tree>
+void BufferedTree<Tree>::put(const KeyType& key, ValueType value) {
+    buffer(key, {value, true});
+}
+
+template <class Tree>
+void BufferedTree<Tree>::add(const KeyType& key, ValueType delta) {
+    buffer(key, {delta, false});
+}
+
+// Entries after the dropped one move down a place, and so do their indices.
+template <class Tree>
+bool BufferedTree<Tree>::remove(const KeyType& key) {
+    Buffer& local = localBuffer();
+    std::lock_guard<std::mutex> bufferGuard(local.lock);
+    auto at = position(local, key);
+    bool buffered = holds(local, at, key);
+    if (buffered) {
+        uint32_t dropped = *at;
+        local.order.erase(at);
+        local.entries.erase(local.entries.begin() + dropped);
+        for (uint32_t& index : local.order) {
+            index -= index > dropped;
+        }
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    return tree.remove(key) || buffered;
+}
+
+template <class Tree>
+std::optional<typename BufferedTree<Tree>::ValueType>
+BufferedTree<Tree>::get(const KeyType& key) {
+    Buffer& local = localBuffer();
+    std::lock_guard<std::mutex> bufferGuard(local.lock);
+    auto at = position(local, key);
+    const Pending* pending = holds(local, at, key) ? &local.entries[*at].second : nullptr;
+    if (pending && pending->assign) {
+        return pending->value;
+    }
+
+    std::optional<ValueType> shared;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        shared = tree.get(key);
+    }
+    if (pending) {
+        return shared.value_or(0) + pending->value;
+    }
+    return shared;
+}
+
+template <class Tree>
+bool BufferedTree<Tree>::contains(const KeyType& key) {
+    return get(key).has_value();
+}
+
+template <class Tree>
+void BufferedTree<Tree>::flush() {
+    Buffer& local = localBuffer();
+    std::lock_guard<std::mutex> bufferGuard(local.lock);
+    if (local.entries.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    merge(local);
+}
+
+template <class Tree>
+void BufferedTree<Tree>::flushAll() {
+    std::lock_guard<std::mutex> listGuard(buffersLock);
+    for (auto& buffer : buffers) {
+        std::lock_guard<std::mutex> bufferGuard(buffer->lock);
+        std::lock_guard<std::mutex> guard(lock);
+        merge(*buffer);
+    }
+}
+
+template <class Tree>
+size_t BufferedTree<Tree>::size() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return tree.size();
+}
+
+INSTANTIATE_FOR_EACH_TREE(BufferedTree);
@@ -0,0 +1,118 @@
+#ifndef BUFFEREDTREE_H
+#define BUFFEREDTREE_H
+
+#include "AVLTree.h"
+#include "ThreadRegistry.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// A shared tree written through per-thread buffers, for write-heavy work
+// such as counters bumped from many threads.
+//
+// Writes go into a small sorted buffer owned by the calling thread and reach
+// the shared tree only when the buffer fills (or on flush()), all of them
+// under one lock acquisition and in key order, so the lock is taken once per
+// BufferSize writes instead of once per write. A thread sees its own
+// buffered writes: lookups check its buffer first and only go to the shared
+// tree when the buffer cannot answer alone. Other threads see them once
+// they are merged. A thread's buffer is merged and freed when it exits.
+//
+// Each buffer has a lock of its own, taken by its owner for every call and
+// by flushAll() / the exit merge, so the owner never contends for it except
+// with those. Locks are taken in the order buffersLock, a buffer's lock,
+// then 'lock'.
+//
+// A thread reads its own writes at once; another thread's writes show up
+// once merged (by that thread's flush(), a full buffer, its exit, or
+// flushAll()). Callers need no lock of their own.
+template <class Tree>
+class BufferedTree {
+public:
+    using KeyType   = typename Tree::KeyType;
+    using ValueType = typename Tree::ValueType;
+
+    // Distinct keys a thread buffers before it merges.
+    static constexpr size_t BufferSize = 64;
+
+private:
+    // What a thread has buffered for one key: a value that replaces the
+    // shared one, or an amount to add to it.
+    struct Pending {
+        ValueType value;
+        bool      assign;
+    };
+
+    // One thread's buffer: pending writes in arrival order, one per key, and
+    // their indices sorted by key (so keeping it sorted moves indices, not
+    // strings).
+    struct Buffer {
+        std::mutex lock;                       // Owner vs. flushAll() and the exit merge
+        std::vector<std::pair<KeyType, Pending>> entries;
+        std::vector<uint32_t> order;
+    };
+
+    Tree tree;
+    mutable std::mutex lock;                   // Guards 'tree'
+
+    std::mutex buffersLock;                    // Guards 'buffers'
+    std::vector<std::unique_ptr<Buffer>> buffers;
+    ThreadRegistry<Buffer> registry;
+
+    // The calling thread's buffer, registered on first use.
+    Buffer& localBuffer();
+
+    // Where the index of 'key' is (or would go) in buffer.order.
+    static std::vector<uint32_t>::iterator position(Buffer& buffer, const KeyType& key);
+    static bool holds(Buffer& buffer, std::vector<uint32_t>::iterator at, const KeyType& key);
+
+    // Adds 'pending' for 'key' to the caller's buffer, merging when full.
+    void buffer(const KeyType& key, Pending pending);
+
+    // Applies 'buffer' to the tree and empties it ('lock' and the buffer's
+    // lock held).
+    void merge(Buffer& buffer);
+
+    // Merges and frees the buffer of an exiting thread.
+    void retire(Buffer* buffer);
+
+public:
+    BufferedTree();
+    ~BufferedTree();
+
+    BufferedTree(const BufferedTree&) = delete;
+    BufferedTree& operator=(const BufferedTree&) = delete;
+
+    // Sets 'key' to 'value', inserting it if missing.
+    void put(const KeyType& key, ValueType value);
+
+    // Adds 'delta' to the value of 'key', which starts at 0 if missing
+    // (tree[key] += delta).
+    void add(const KeyType& key, ValueType delta);
+
+    // Not buffered: drops the caller's pending write for 'key', then removes
+    // it from the shared tree. Pending writes of other threads bring it back
+    // when they are merged. Returns true if the caller could see the key.
+    bool remove(const KeyType& key);
+
+    // The caller's view: the shared tree with its own buffer applied. A key
+    // the caller has put is answered from the buffer without taking 'lock'.
+    std::optional<ValueType> get(const KeyType& key);
+    bool contains(const KeyType& key);
+
+    // Merges the caller's buffer now.
+    void flush();
+
+    // Merges every thread's buffer; writes made meanwhile may or may not be
+    // included.
+    void flushAll();
+
+    // Keys in the shared tree (exact after flushAll() if nobody writes).
+    size_t size() const;
+};
+
+#endif
@@ -0,0 +1,101 @@
+/*
+Tests for BufferedTree: a thread's view of its own writes, merges on flush,
+flushAll() alongside writers, and buffers merged when their thread exits.
+ */
+#include "BufferedTree.h"
+#include "TestCheck.h"
+
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// One thread: its view matches a map throughout, buffered or merged.
+static void testOwnView() {
+    BufferedTree<AVLTree> buffered;
+    map<string, size_t> model;
+    mt19937 rng(72);
+    for (size_t i = 0; i < 20000; ++i) {
+        string k = key(rng() % 300);
+        switch (rng() % 4) {
+        case 0:
+            CHECK(buffered.remove(k) == (model.erase(k) == 1));
+            break;
+        case 1:
+            buffered.put(k, i);
+            model[k] = i;
+            break;
+        default:
+            buffered.add(k, i % 7);
+            model[k] += i % 7;
+            break;
+        }
+        auto found = model.find(k);
+        CHECK(buffered.get(k) == (found == model.end() ? nullopt : optional<size_t>(found->second)));
+        if (i % 1000 == 0) {
+            buffered.flush();
+            CHECK(buffered.size() == model.size());
+        }
+    }
+    buffered.flushAll();
+    CHECK(buffered.size() == model.size());
+    CHECK(buffered.contains(model.begin()->first));
+}
+
+// Counters bumped from threads that exit without flushing: every buffer is
+// merged at exit, while another thread keeps calling flushAll().
+static void testThreads() {
+    BufferedTree<WAVLTree> counters;
+    atomic<bool> done{false};
+    thread flusher([&counters, &done] {
+        while (!done.load()) {
+            counters.flushAll();
+            this_thread::yield();
+        }
+    });
+    for (size_t round = 0; round < 4; ++round) {
+        vector<thread> threads;
+        for (size_t t = 0; t < 4; ++t) {
+            threads.emplace_back([&counters, t] {
+                for (size_t i = 0; i < 5000; ++i) {
+                    counters.add(key(i % 100), 1);
+                    counters.put(key(1000 + t), i);
+                    if (i % 500 == 0) {
+                        CHECK(counters.get(key(1000 + t)) == optional<size_t>(i));
+                    }
+                }
+            });
+        }
+        for (thread& t : threads) {
+            t.join();
+        }
+    }
+    done.store(true);
+    flusher.join();
+    CHECK(counters.size() == 104);
+    for (size_t i = 0; i < 100; ++i) {
+        CHECK(counters.get(key(i)) == optional<size_t>(4 * 4 * 50));
+    }
+    for (size_t t = 0; t < 4; ++t) {
+        CHECK(counters.get(key(1000 + t)) == optional<size_t>(4999));
+    }
+
+    // A tree destroyed before the threads that used it exit.
+    auto early = make_unique<BufferedTree<AVLTree>>();
+    thread late([&early] {
+        early->add(key(0), 1);
+        early.reset();
+    });
+    late.join();
+}
+
+int main() {
+    testOwnView();
+    testThreads();
+    return testResult();
+}
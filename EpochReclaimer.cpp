@@ -0,0 +1,171 @@
+/*
+Epoch-based reclamation: per-thread epochs and limbo lists, freed in batches.
+ */
+
+#include "EpochReclaimer.h"
+
+#include <thread>
+#include <utility>
+
+EpochReclaimer::EpochReclaimer() : globalEpoch(1), records(nullptr), pendingCount(0) {}
+
+EpochReclaimer::~EpochReclaimer() {
+    for (Record* record = records.load(); record;) {
+        Record* next = record->next;
+        for (auto& list : record->limbo) {
+            free(list);
+        }
+        delete record;
+        record = next;
+    }
+}
+
+// A record stays registered after its thread exits: its limbo lists are
+// emptied by flush() and collect().
+EpochReclaimer::Record& EpochReclaimer::localRecord() {
+    return registry.local([this] {
+        auto* record = new Record;
+        record->next = records.load(std::memory_order_relaxed);
+        while (!records.compare_exchange_weak(record->next, record, std::memory_order_release,
+                                              std::memory_order_relaxed)) {
+        }
+        return record;
+    });
+}
+
+// The epoch is published, then read again: if it moved in between, an
+// advance may have missed us, so publish the new one.
+void EpochReclaimer::enter() {
+    enter(localRecord());
+}
+
+void EpochReclaimer::enter(Record& record) {
+    if (record.depth++ > 0) {
+        return;
+    }
+    uint64_t seen = globalEpoch.load();
+    for (;;) {
+        record.state.store(seen << 1 | 1);
+        uint64_t now = globalEpoch.load();
+        if (now == seen) {
+            return;
+        }
+        seen = now;
+    }
+}
+
+void EpochReclaimer::leave() {
+    leave(localRecord());
+}
+
+void EpochReclaimer::leave(Record& record) {
+    if (--record.depth == 0) {
+        record.state.store(0, std::memory_order_release);
+    }
+}
+
+// A thread registering during the scan pins at this epoch or the next one,
+// both of which the advance allows.
+uint64_t EpochReclaimer::tryAdvance() {
+    uint64_t current = globalEpoch.load();
+    for (Record* record = records.load(std::memory_order_acquire); record; record = record->next) {
+        uint64_t state = record->state.load();
+        if ((state & 1) && (state >> 1) != current) {
+            return current;                   // someone is still in an older epoch
+        }
+    }
+    if (globalEpoch.compare_exchange_strong(current, current + 1)) {
+        return current + 1;
+    }
+    return current;                           // another thread advanced it
+}
+
+void EpochReclaimer::free(std::vector<Retired>& batch) {
+    for (const Retired& retired : batch) {
+        retired.deleter(retired.object, retired.context);
+    }
+    pendingCount.fetch_sub(batch.size(), std::memory_order_relaxed);
+    batch.clear();
+}
+
+// A limbo list that still holds a list from three epochs ago is emptied
+// before it is reused: that list is safe by now.
+void EpochReclaimer::retire(void* object, Deleter deleter, void* context) {
+    Record& record = localRecord();
+    pendingCount.fetch_add(1, std::memory_order_relaxed);
+
+    std::vector<Retired> safe;
+    {
+        std::lock_guard<std::mutex> guard(record.limboLock);
+        uint64_t current = globalEpoch.load();
+        size_t index = current % 3;
+        if (record.limboEpoch[index] != current) {
+            safe.swap(record.limbo[index]);
+            record.limboEpoch[index] = current;
+        }
+        record.limbo[index].push_back({object, deleter, context});
+    }
+    free(safe);
+
+    if (++record.sinceAdvance < BatchSize) {
+        return;
+    }
+    record.sinceAdvance = 0;
+    uint64_t current = tryAdvance();
+    {
+        std::lock_guard<std::mutex> guard(record.limboLock);
+        for (size_t i = 0; i < 3; ++i) {
+            if (record.limboEpoch[i] + 2 <= current && !record.limbo[i].empty()) {
+                safe.insert(safe.end(), record.limbo[i].begin(), record.limbo[i].end());
+                record.limbo[i].clear();
+            }
+        }
+    }
+    free(safe);
+}
+
+// Lists retired after the call started may not be safe yet and stay.
+void EpochReclaimer::flush() {
+    uint64_t target = globalEpoch.load() + 2;
+    uint64_t current;
+    while ((current = tryAdvance()) < target) {
+        std::this_thread::yield();
+    }
+    freeSafe(current);
+}
+
+void EpochReclaimer::collect() {
+    freeSafe(tryAdvance());
+}
+
+void EpochReclaimer::freeSafe(uint64_t current) {
+    std::vector<Retired> safe;
+    for (Record* record = records.load(std::memory_order_acquire); record; record = record->next) {
+        {
+            std::lock_guard<std::mutex> guard(record->limboLock);
+            for (size_t i = 0; i < 3; ++i) {
+                if (record->limboEpoch[i] + 2 <= current && !record->limbo[i].empty()) {
+                    safe.insert(safe.end(), record->limbo[i].begin(), record->limbo[i].end());
+                    record->limbo[i].clear();
+                }
+            }
+        }
+        free(safe);
+    }
+}
+
+size_t EpochReclaimer::pending() const {
+    return pendingCount.load(std::memory_order_relaxed);
+}
+
+uint64_t EpochReclaimer::epoch() const {
+    return globalEpoch.load(std::memory_order_relaxed);
+}
+
+EpochReclaimer::Guard::Guard(EpochReclaimer& r) : reclaimer(r), record(r.localRecord()) {
+    reclaimer.enter(record);
+}
+
+EpochReclaimer::Guard::~Guard() {
+    reclaimer.leave(record);
+}
@@ -0,0 +1,128 @@
+#ifndef EPOCHRECLAIMER_H
+#define EPOCHRECLAIMER_H
+
+#include "ThreadRegistry.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Epoch-based reclamation (Fraser, "Practical lock-freedom", 2004).
+//
+// Readers that follow pointers without a lock pin the reclaimer for the
+// duration of the read. A writer that unlinks an object retires it instead of
+// freeing it; the object is freed once every thread pinned at the time of the
+// retire has unpinned.
+//
+// There is one global epoch. Pinning publishes the epoch the thread saw; the
+// epoch only advances when every pinned thread has seen the current one, so
+// an object retired in epoch e can no longer be reached by anyone once the
+// epoch is e + 2. Each thread keeps its retired objects in three limbo lists,
+// one per epoch modulo 3, and tries to advance the epoch after every
+// BatchSize retires, freeing its lists that have become safe in one go.
+//
+// Thread safe: any number of threads may pin, retire and flush concurrently.
+// Threads register on first use and stay registered until the reclaimer is
+// destroyed, which frees everything still retired (nobody may be pinned then).
+class EpochReclaimer {
+    struct Record;
+
+public:
+    // Frees 'object'; 'context' is whatever was passed to retire().
+    using Deleter = void (*)(void* object, void* context);
+
+    // Retires per thread between attempts to advance the epoch.
+    static constexpr size_t BatchSize = 64;
+
+    EpochReclaimer();
+    ~EpochReclaimer();
+
+    EpochReclaimer(const EpochReclaimer&) = delete;
+    EpochReclaimer& operator=(const EpochReclaimer&) = delete;
+
+    // Pins the calling thread for its lifetime. Guards nest: the outermost
+    // one pays for the pin (a seq_cst store between two epoch loads, a full
+    // fence on x86, and a release store to unpin), a nested one only counts.
+    // A thread about to make many short reads can hold one Guard around all
+    // of them, as long as it does not hold up flush() for long.
+    class Guard {
+    public:
+        explicit Guard(EpochReclaimer& reclaimer);
+        ~Guard();
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+    private:
+        EpochReclaimer& reclaimer;
+        Record& record;                   // The thread's, looked up once
+    };
+
+    // Pin / unpin by hand (same nesting rules as Guard).
+    void enter();
+    void leave();
+
+    // Hands over 'object', already unreachable for new readers; deleter(object,
+    // context) runs once no earlier reader can still hold it.
+    void retire(void* object, Deleter deleter, void* context);
+
+    // Waits until every thread pinned at the time of the call has unpinned,
+    // then frees everything retired so far, by any thread. Must not be called
+    // while pinned. Use it before memory the deleters need goes away (an
+    // arena, say).
+    void flush();
+
+    // Tries once to advance the epoch, then frees whatever has become safe,
+    // by any thread. Never waits.
+    void collect();
+
+    // Objects retired but not yet freed.
+    size_t pending() const;
+
+    uint64_t epoch() const;
+
+private:
+    struct Retired {
+        void*   object;
+        Deleter deleter;
+        void*   context;
+    };
+
+    // One registered thread.
+    struct Record {
+        // Epoch seen when pinned, shifted left by one, plus 1 while pinned.
+        std::atomic<uint64_t> state{0};
+        size_t depth = 0;                 // Nesting of enter(), owner only
+        size_t sinceAdvance = 0;          // Retires since the last attempt, owner only
+
+        std::mutex limboLock;             // Taken by the owner and by flush()
+        std::array<std::vector<Retired>, 3> limbo;
+        std::array<uint64_t, 3> limboEpoch{};
+
+        Record* next = nullptr;
+    };
+
+    std::atomic<uint64_t> globalEpoch;
+    std::atomic<Record*> records;         // Every registered thread (pushed at the front)
+    std::atomic<size_t> pendingCount;
+    ThreadRegistry<Record> registry;
+
+    Record& localRecord();
+
+    void enter(Record& record);
+    void leave(Record& record);
+
+    // Moves the epoch on if every pinned thread has seen it. Returns the epoch.
+    uint64_t tryAdvance();
+
+    // Frees the limbo lists of every thread that are safe in epoch 'current'.
+    void freeSafe(uint64_t current);
+
+    // Runs the deleters of 'batch' and empties it.
+    void free(std::vector<Retired>& batch);
+};
+
+#endif
@@ -0,0 +1,114 @@
+/*
+Tests for EpochReclaimer: nothing is freed under a pinned reader, and
+everything retired is freed in the end.
+ */
+#include "EpochReclaimer.h"
+#include "TestCheck.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Counts the objects it frees in the counter passed as context.
+static void countFree(void* object, void* freed) {
+    delete static_cast<size_t*>(object);
+    static_cast<atomic<size_t>*>(freed)->fetch_add(1);
+}
+
+static void testFlush() {
+    atomic<size_t> freed{0};
+    EpochReclaimer reclaimer;
+    for (size_t i = 0; i < 1000; ++i) {
+        reclaimer.retire(new size_t(i), &countFree, &freed);
+    }
+    CHECK(reclaimer.pending() + freed.load() == 1000);
+    reclaimer.flush();
+    CHECK(reclaimer.pending() == 0);
+    CHECK(freed.load() == 1000);
+
+    // Left for the destructor.
+    reclaimer.retire(new size_t(0), &countFree, &freed);
+    {
+        EpochReclaimer other;
+        other.retire(new size_t(0), &countFree, &freed);
+    }
+    CHECK(freed.load() == 1001);
+}
+
+// A reader pinned before a retire holds it back, however often the epoch is
+// pushed; nested pins unpin with the outermost.
+static void testPinnedReader() {
+    atomic<size_t> freed{0};
+    EpochReclaimer reclaimer;
+    atomic<int> stage{0};
+    thread reader([&] {
+        EpochReclaimer::Guard outer(reclaimer);
+        {
+            EpochReclaimer::Guard inner(reclaimer);
+        }
+        stage.store(1);
+        while (stage.load() != 2) {
+            this_thread::yield();
+        }
+    });
+    while (stage.load() != 1) {
+        this_thread::yield();
+    }
+    reclaimer.retire(new size_t(1), &countFree, &freed);
+    for (size_t i = 0; i < 10; ++i) {
+        reclaimer.collect();
+    }
+    CHECK(freed.load() == 0);
+    CHECK(reclaimer.pending() == 1);
+    CHECK(reclaimer.epoch() <= 2);
+    stage.store(2);
+    reader.join();
+    reclaimer.flush();
+    CHECK(freed.load() == 1);
+}
+
+// Writers replace a shared object and retire the old one while readers
+// pin and read it: a reader never sees a freed object (ASan would catch it),
+// and retires of threads that have exited are freed by flush().
+static void testReadersAndWriters() {
+    atomic<size_t> freed{0};
+    EpochReclaimer reclaimer;
+    atomic<size_t*> current{new size_t(0)};
+    atomic<bool> done{false};
+    vector<thread> threads;
+    for (size_t t = 0; t < 2; ++t) {
+        threads.emplace_back([&] {
+            for (size_t i = 1; i <= 20000; ++i) {
+                size_t* old = current.exchange(new size_t(i));
+                reclaimer.retire(old, &countFree, &freed);
+            }
+        });
+    }
+    for (size_t t = 0; t < 2; ++t) {
+        threads.emplace_back([&] {
+            size_t reads = 0;
+            while (!done.load() || reads == 0) {
+                EpochReclaimer::Guard guard(reclaimer);
+                CHECK(*current.load() <= 20000);
+                ++reads;
+            }
+        });
+    }
+    threads[0].join();
+    threads[1].join();
+    done.store(true);
+    threads[2].join();
+    threads[3].join();
+    reclaimer.flush();
+    CHECK(freed.load() == 40000);
+    CHECK(reclaimer.pending() == 0);
+    delete current.load();
+}
+
+int main() {
+    testFlush();
+    testPinnedReader();
+    testReadersAndWriters();
+    return testResult();
+}
@@ -0,0 +1,229 @@
+/*
+Map with expiring entries: expiry checked on lookup, evictions driven by a
+hierarchical timing wheel and removed in sorted batches.
+ */
+
+#include "ExpiringTree.h"
+
+#include <algorithm>
+
+template <class Tree>
+ExpiringTree<Tree>::ExpiringTree(std::chrono::milliseconds sweepPeriod)
+    : start(Clock::now()), wheelTime(0), timerCount(0), stopping(false), period(sweepPeriod),
+      sweeper([this] { runSweeper(); }) {}
+
+template <class Tree>
+ExpiringTree<Tree>::~ExpiringTree() {
+    {
+        std::lock_guard<std::mutex> guard(sweeperLock);
+        stopping = true;
+    }
+    sweeperWake.notify_one();
+    sweeper.join();
+}
+
+template <class Tree>
+typename ExpiringTree<Tree>::Tick ExpiringTree<Tree>::now() const {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count() + 1;
+}
+
+template <class Tree>
+bool ExpiringTree<Tree>::expired(const Slot& slot, Tick time) {
+    return slot.expiry && slot.expiry <= time;
+}
+
+template <class Tree>
+void ExpiringTree<Tree>::release(uint32_t index) {
+    Slot& slot = slots[index];
+    slot.live = false;
+    slot.key.clear();
+    freeSlots.push_back(index);
+}
+
+// ---------------------------------------------------------------------------
+// Timing wheel
+
+// A timer 'delta' ticks away goes in the first wheel whose buckets cover it,
+// in the bucket its expiry falls in there; when that bucket's turn comes it
+// is less than one bucket away and moves to a finer wheel. A timer beyond
+// the last wheel goes in its furthest bucket and is filed again from there.
+// While the wheel advances, 'wheelTime' is the tick being processed, so a
+// timer due then goes in the bucket processed next.
+template <class Tree>
+void ExpiringTree<Tree>::schedule(Timer timer) {
+    constexpr Tick span = Tick{1} << (WheelBits * WheelLevels);
+    constexpr Tick mask = (Tick{1} << WheelBits) - 1;
+    Tick at = std::max(timer.expiry, wheelTime);
+    if (at - wheelTime >= span) {
+        at = wheelTime + span - 1;
+    }
+    size_t level = 0;
+    while (level + 1 < WheelLevels && at - wheelTime >= Tick{1} << (WheelBits * (level + 1))) {
+        ++level;
+    }
+    wheel[level][(at >> (WheelBits * level)) & mask].push_back(timer);
+    ++timerCount;
+}
+
+// At each tick, the buckets of the coarser wheels whose turn it is are filed
+// again, then the first wheel's bucket for the tick holds what is due. Its
+// stale timers (the slot was written or removed since) are dropped.
+template <class Tree>
+bool ExpiringTree<Tree>::advance(Tick to, std::vector<KeyType>& due) {
+    constexpr Tick mask = (Tick{1} << WheelBits) - 1;
+    while (wheelTime < to) {
+        if (due.size() >= ExpireBatch) {
+            return false;
+        }
+        if (timerCount == 0) {
+            wheelTime = to;
+            break;
+        }
+        Tick tick = ++wheelTime;
+        for (size_t level = 1; level < WheelLevels; ++level) {
+            if (tick & ((Tick{1} << (WheelBits * level)) - 1)) {
+                break;
+            }
+            std::vector<Timer> bucket;
+            bucket.swap(wheel[level][(tick >> (WheelBits * level)) & mask]);
+            timerCount -= bucket.size();
+            for (const Timer& timer : bucket) {
+                schedule(timer);
+            }
+        }
+
+        std::vector<Timer>& bucket = wheel[0][tick & mask];
+        timerCount -= bucket.size();
+        for (const Timer& timer : bucket) {
+            Slot& slot = slots[timer.slot];
+            if (slot.live && slot.expiry == timer.expiry) {
+                due.push_back(std::move(slot.key));
+                release(timer.slot);
+            }
+        }
+        bucket.clear();
+    }
+    return true;
+}
+
+// The exclusive lock is let go between batches, so writers wait for one
+// batch at most.
+template <class Tree>
+void ExpiringTree<Tree>::expire() {
+    Tick to = now();
+    bool done = false;
+    while (!done) {
+        std::vector<KeyType> due;
+        std::unique_lock<std::shared_mutex> guard(lock);
+        done = advance(to, due);
+        std::sort(due.begin(), due.end());
+        for (const KeyType& key : due) {
+            tree.remove(key);
+        }
+    }
+}
+
+template <class Tree>
+void ExpiringTree<Tree>::runSweeper() {
+    std::unique_lock<std::mutex> guard(sweeperLock);
+    while (!stopping) {
+        sweeperWake.wait_for(guard, period);
+        if (stopping) {
+            break;
+        }
+        guard.unlock();
+        expire();
+        guard.lock();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Map operations
+
+template <class Tree>
+bool ExpiringTree<Tree>::put(const KeyType& key, ValueType value) {
+    return put(key, value, std::chrono::milliseconds::zero());
+}
+
+// One descent: findOrInsert() finds the key or inserts it. An expiry is
+// always a tick or more ahead of the wheel.
+template <class Tree>
+bool ExpiringTree<Tree>::put(const KeyType& key, ValueType value, std::chrono::milliseconds ttl) {
+    std::unique_lock<std::shared_mutex> guard(lock);
+    Tick time = now();
+    Tick expiry = ttl.count() > 0 ? time + ttl.count() : 0;
+
+    auto [index, added] = tree.findOrInsert(key, 0);
+    if (added) {
+        if (!freeSlots.empty()) {
+            index = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            index = slots.size();
+            slots.emplace_back();
+        }
+        slots[index].key = key;
+    } else {
+        added = expired(slots[index], time);
+    }
+
+    Slot& slot = slots[index];
+    slot.value = value;
+    slot.expiry = expiry;
+    slot.live = true;
+    if (expiry) {
+        schedule({static_cast<uint32_t>(index), expiry});
+    }
+    return added;
+}
+
+template <class Tree>
+bool ExpiringTree<Tree>::remove(const KeyType& key) {
+    std::unique_lock<std::shared_mutex> guard(lock);
+    auto index = tree.get(key);
+    if (!index) {
+        return false;
+    }
+    bool live = !expired(slots[*index], now());
+    tree.remove(key);
+    release(*index);
+    return live;
+}
+
+template <class Tree>
+std::optional<typename ExpiringTree<Tree>::ValueType>
+ExpiringTree<Tree>::get(const KeyType& key) const {
+    std::shared_lock<std::shared_mutex> guard(lock);
+    auto index = tree.get(key);
+    if (!index || expired(slots[*index], now())) {
+        return std::nullopt;
+    }
+    return slots[*index].value;
+}
+
+template <class Tree>
+bool ExpiringTree<Tree>::contains(const KeyType& key) const {
+    return get(key).has_value();
+}
+
+template <class Tree>
+std::vector<typename ExpiringTree<Tree>::ValueType>
+ExpiringTree<Tree>::findRange(const KeyType& lowKey, const KeyType& highKey) const {
+    std::shared_lock<std::shared_mutex> guard(lock);
+    Tick time = now();
+    std::vector<ValueType> result;
+    for (size_t index : tree.findRange(lowKey, highKey)) {
+        if (!expired(slots[index], time)) {
+            result.push_back(slots[index].value);
+        }
+    }
+    return result;
+}
+
+template <class Tree>
+size_t ExpiringTree<Tree>::size() const {
+    std::shared_lock<std::shared_mutex> guard(lock);
+    return tree.size();
+}
+
+INSTANTIATE_FOR_EACH_TREE(ExpiringTree);
@@ -0,0 +1,128 @@
+#ifndef EXPIRINGTREE_H
+#define EXPIRINGTREE_H
+
+#include "AVLTree.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+// A map whose entries may expire, for indexes such as sessions.
+//
+// The tree maps a key to a slot holding its value and expiry time, so a
+// lookup is one descent plus a comparison: an entry past its expiry is
+// absent from the moment it expires, whether or not it has been evicted.
+//
+// Evicting takes no scan. Each expiring write also files a timer in a
+// hierarchical timing wheel: WheelLevels wheels of 2^WheelBits buckets, one
+// millisecond per bucket in the first wheel and 2^WheelBits times coarser in
+// each next one. Advancing the wheel to the current time empties the buckets
+// that came due (cascading the coarser ones into finer ones as it goes), and
+// the expired keys found are removed in batches, sorted so the descents
+// share their paths. A timer made stale by a later write or removal stays
+// filed and is skipped when it comes due. A background thread advances the
+// wheel every 'sweepPeriod'; expire() does it right away.
+//
+// Lookups share one reader-writer lock and run side by side; writes hold it
+// exclusively, and eviction holds it for one batch of ExpireBatch keys at a
+// time.
+template <class Tree>
+class ExpiringTree {
+public:
+    using KeyType   = typename Tree::KeyType;
+    using ValueType = typename Tree::ValueType;
+    using Clock     = std::chrono::steady_clock;
+
+    static constexpr size_t WheelBits   = 6;
+    static constexpr size_t WheelLevels = 4;     // About 4.6 hours before a timer is refiled
+
+private:
+    // Milliseconds since construction, plus 1; an expiry of 0 means never.
+    using Tick = uint64_t;
+
+    struct Slot {
+        KeyType   key;
+        ValueType value;
+        Tick      expiry;
+        bool      live;
+    };
+
+    // A slot due at 'expiry'. It still applies if the slot expires then.
+    struct Timer {
+        uint32_t slot;
+        Tick     expiry;
+    };
+
+    mutable std::shared_mutex lock;   // Shared for reads, exclusive for writes / eviction
+    Tree tree;                        // Key -> index in 'slots'
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+
+    Clock::time_point start;
+    std::vector<Timer> wheel[WheelLevels][size_t{1} << WheelBits];
+    Tick wheelTime;                   // Last tick the wheel was advanced to
+    size_t timerCount;                // Timers filed, stale ones included
+
+    // Background sweeper.
+    std::mutex sweeperLock;
+    std::condition_variable sweeperWake;
+    bool stopping;
+    std::chrono::milliseconds period;
+    std::thread sweeper;
+
+    Tick now() const;
+    static bool expired(const Slot& slot, Tick time);
+
+    // Files 'timer' in the bucket its expiry falls in (exclusive lock held).
+    void schedule(Timer timer);
+
+    // Advances the wheel towards 'to', moving the keys that expire into 'due'
+    // and freeing their slots, until 'due' holds ExpireBatch keys or more.
+    // Returns true once it reached 'to' (exclusive lock held).
+    bool advance(Tick to, std::vector<KeyType>& due);
+
+    // Marks a slot free for reuse (exclusive lock held).
+    void release(uint32_t index);
+
+    void runSweeper();
+
+public:
+    // Expired keys evicted per hold of the exclusive lock.
+    static constexpr size_t ExpireBatch = 1024;
+
+    explicit ExpiringTree(std::chrono::milliseconds sweepPeriod = std::chrono::milliseconds(10));
+    ~ExpiringTree();
+
+    ExpiringTree(const ExpiringTree&) = delete;
+    ExpiringTree& operator=(const ExpiringTree&) = delete;
+
+    // Sets 'key' to 'value', to expire after 'ttl', or never (no ttl, or one
+    // of zero). Replaces the value and expiry of a live key. Returns true if
+    // the key was absent.
+    bool put(const KeyType& key, ValueType value);
+    bool put(const KeyType& key, ValueType value, std::chrono::milliseconds ttl);
+
+    // Returns true if a live key was removed.
+    bool remove(const KeyType& key);
+
+    // Expired entries are absent.
+    bool contains(const KeyType& key) const;
+    std::optional<ValueType> get(const KeyType& key) const;
+    std::vector<ValueType> findRange(const KeyType& lowKey,
+                                     const KeyType& highKey) const;
+
+    // Evicts every entry expired by now.
+    void expire();
+
+    // Keys held, expired ones not yet evicted included.
+    size_t size() const;
+};
+
+using AVLTreeExpiring = ExpiringTree<AVLTree>;
+
+#endif
@@ -0,0 +1,148 @@
+/*
+Tests for ExpiringTree: entries vanishing once their ttl passes, eviction
+by expire() and by the sweeper, ttls replaced by later writes, and lookups
+alongside writers and eviction.
+ */
+#include "ExpiringTree.h"
+#include "TestCheck.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+using namespace std::chrono_literals;
+
+// Without ttls it is a plain map.
+template <class Tree>
+static void testNoExpiry() {
+    ExpiringTree<Tree> entries;
+    map<string, size_t> model;
+    mt19937 rng(75);
+    for (size_t i = 0; i < 20000; ++i) {
+        string k = key(rng() % 500);
+        if (rng() % 3 == 0) {
+            CHECK(entries.remove(k) == (model.erase(k) == 1));
+        } else {
+            CHECK(entries.put(k, i) == (model.count(k) == 0));
+            model[k] = i;
+        }
+        auto found = model.find(k);
+        CHECK(entries.get(k) == (found == model.end() ? nullopt : optional<size_t>(found->second)));
+    }
+    CHECK(entries.size() == model.size());
+    vector<size_t> expected;
+    for (auto it = model.lower_bound(key(100)); it != model.end() && it->first <= key(200); ++it) {
+        expected.push_back(it->second);
+    }
+    CHECK(entries.findRange(key(100), key(200)) == expected);
+}
+
+// Expired entries are absent at once and evicted by expire(); a later put
+// replaces the ttl, and a put or remove after expiry sees the key absent
+// (keys 1, 4 and 10 of the expiring third end up live).
+static void testExpiry() {
+    ExpiringTree<AVLTree> entries(1h);   // Sweeper out of the way
+    for (size_t i = 0; i < 3000; ++i) {
+        entries.put(key(i), i, i % 3 == 0 ? 0ms : i % 3 == 1 ? 300ms : 1h);
+    }
+    CHECK(entries.put(key(1), 1, 1h) == false);    // Now lives on
+    CHECK(entries.put(key(4), 4) == false);        // Never expires
+    CHECK(entries.size() == 3000);
+    this_thread::sleep_for(400ms);
+
+    CHECK(entries.size() == 3000);                 // Not evicted yet
+    for (size_t i = 0; i < 3000; ++i) {
+        bool live = i % 3 != 1 || i == 1 || i == 4;
+        CHECK(entries.contains(key(i)) == live);
+    }
+    CHECK(entries.findRange(key(0), key(8)) == (vector<size_t>{0, 1, 2, 3, 4, 5, 6, 8}));
+    CHECK(entries.remove(key(7)) == false);
+    CHECK(entries.put(key(10), 10) == true);
+    CHECK(entries.size() == 2999);                 // remove() dropped key(7)
+
+    entries.expire();
+    CHECK(entries.size() == 3000 - 1000 + 3);
+    CHECK(entries.get(key(10)) == optional<size_t>(10));
+    CHECK(entries.get(key(2)) == optional<size_t>(2));
+    entries.expire();
+    CHECK(entries.size() == 3000 - 1000 + 3);
+}
+
+// The sweeper evicts on its own.
+static void testSweeper() {
+    ExpiringTree<WAVLTree> entries(5ms);
+    for (size_t i = 0; i < 5000; ++i) {
+        entries.put(key(i), i, 10ms);
+    }
+    entries.put(key(9999), 1);
+    for (size_t tries = 0; tries < 200 && entries.size() > 1; ++tries) {
+        this_thread::sleep_for(10ms);
+    }
+    CHECK(entries.size() == 1);
+    CHECK(entries.contains(key(9999)));
+}
+
+// Writers refreshing short ttls on their own keys while readers look them
+// up and the sweeper evicts: a value read belongs to the key's writer.
+static void testThreads() {
+    ExpiringTree<RedBlackTree> entries(1ms);
+    atomic<bool> done{false};
+    vector<thread> readers;
+    for (size_t r = 0; r < 2; ++r) {
+        readers.emplace_back([&entries, &done, r] {
+            mt19937 rng(r);
+            while (!done.load()) {
+                size_t k = rng() % 4000;
+                if (auto value = entries.get(key(k))) {
+                    CHECK(*value % 4 == k / 1000);
+                }
+                CHECK(entries.findRange(key(k), key(k + 20)).size() <= 21);
+            }
+        });
+    }
+    vector<thread> writers;
+    for (size_t t = 0; t < 4; ++t) {
+        writers.emplace_back([&entries, t] {
+            for (size_t i = 0; i < 20000; ++i) {
+                string k = key(t * 1000 + i % 1000);
+                if (i % 7 == 0) {
+                    entries.remove(k);
+                } else {
+                    entries.put(k, 4 * i + t, chrono::milliseconds(i % 5));
+                }
+            }
+        });
+    }
+    for (thread& t : writers) {
+        t.join();
+    }
+    done.store(true);
+    for (thread& t : readers) {
+        t.join();
+    }
+    this_thread::sleep_for(10ms);
+    entries.expire();
+    CHECK(entries.size() <= 4000);
+    for (size_t i = 0; i < 4000; ++i) {
+        if (auto value = entries.get(key(i))) {
+            CHECK(*value % 4 == i / 1000);
+        }
+    }
+}
+
+int main() {
+    testNoExpiry<AVLTree>();
+    testNoExpiry<WAVLTree>();
+    testNoExpiry<RedBlackTree>();
+    testNoExpiry<Treap>();
+    testExpiry();
+    testSweeper();
+    testThreads();
+    return testResult();
+}
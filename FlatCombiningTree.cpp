@@ -0,0 +1,158 @@
+/*
+Flat-combining front end: per-thread request slots served in sorted batches
+by whichever thread holds the combiner lock.
+ */
+
+#include "FlatCombiningTree.h"
+
+#include <algorithm>
+#include <thread>
+
+// Passes over the slots per turn as combiner; later passes pick up requests
+// posted while the earlier ones ran.
+static constexpr int CombinePasses = 3;
+
+template <class Tree>
+FlatCombiningTree<Tree>::FlatCombiningTree()
+    : slots(nullptr), registry([](Slot* slot) { slot->dead.store(true, std::memory_order_release); }) {}
+
+template <class Tree>
+FlatCombiningTree<Tree>::~FlatCombiningTree() {
+    registry.close();
+    for (Slot* slot = slots.load(); slot;) {
+        Slot* next = slot->next;
+        delete slot;
+        slot = next;
+    }
+}
+
+template <class Tree>
+typename FlatCombiningTree<Tree>::Slot& FlatCombiningTree<Tree>::localSlot() {
+    return registry.local([this] {
+        auto* slot = new Slot;
+        slot->next = slots.load(std::memory_order_relaxed);
+        while (!slots.compare_exchange_weak(slot->next, slot, std::memory_order_release,
+                                            std::memory_order_relaxed)) {
+        }
+        return slot;
+    });
+}
+
+template <class Tree>
+void FlatCombiningTree<Tree>::execute(Slot& slot) {
+    slot.pending.store(true, std::memory_order_release);
+    for (;;) {
+        if (combinerLock.try_lock()) {
+            combine();
+            combinerLock.unlock();
+        }
+        if (!slot.pending.load(std::memory_order_acquire)) {
+            return;
+        }
+        std::this_thread::yield();            // a combiner is busy, likely with us
+    }
+}
+
+template <class Tree>
+void FlatCombiningTree<Tree>::apply(Slot& slot) {
+    switch (slot.kind) {
+    case Slot::Kind::Insert:
+        slot.result = tree.insert(*slot.key, slot.value);
+        break;
+    case Slot::Kind::Remove:
+        slot.result = tree.remove(*slot.key);
+        break;
+    case Slot::Kind::Get:
+        slot.read = tree.get(*slot.key);
+        break;
+    }
+}
+
+// Only the combiner removes slots, and new ones are only pushed at the
+// front, so a link inside the list is ours to change. The head is shared
+// with pushers: if one got in first, the slot stays for the next walk.
+template <class Tree>
+bool FlatCombiningTree<Tree>::unlink(Slot** link, Slot* slot) {
+    if (link) {
+        *link = slot->next;
+        return true;
+    }
+    Slot* expected = slot;
+    return slots.compare_exchange_strong(expected, slot->next, std::memory_order_acq_rel);
+}
+
+template <class Tree>
+void FlatCombiningTree<Tree>::combine() {
+    std::vector<Slot*> batch;
+    for (int pass = 0; pass < CombinePasses; ++pass) {
+        batch.clear();
+        Slot** link = nullptr;                // Link to 'slot' inside the list
+        for (Slot* slot = slots.load(std::memory_order_acquire); slot;) {
+            Slot* next = slot->next;
+            if (slot->dead.load(std::memory_order_acquire) && unlink(link, slot)) {
+                delete slot;
+            } else {
+                if (slot->pending.load(std::memory_order_acquire)) {
+                    batch.push_back(slot);
+                }
+                link = &slot->next;
+            }
+            slot = next;
+        }
+        if (batch.empty()) {
+            return;
+        }
+        std::sort(batch.begin(), batch.end(),
+                  [](const Slot* a, const Slot* b) { return *a->key < *b->key; });
+        for (Slot* slot : batch) {
+            apply(*slot);
+            slot->pending.store(false, std::memory_order_release);
+        }
+    }
+}
+
+template <class Tree>
+bool FlatCombiningTree<Tree>::insert(const KeyType& key, ValueType value) {
+    Slot& slot = localSlot();
+    slot.kind = Slot::Kind::Insert;
+    slot.key = &key;
+    slot.value = value;
+    execute(slot);
+    return slot.result;
+}
+
+template <class Tree>
+bool FlatCombiningTree<Tree>::remove(const KeyType& key) {
+    Slot& slot = localSlot();
+    slot.kind = Slot::Kind::Remove;
+    slot.key = &key;
+    execute(slot);
+    return slot.result;
+}
+
+template <class Tree>
+bool FlatCombiningTree<Tree>::contains(const KeyType& key) {
+    return get(key).has_value();
+}
+
+template <class Tree>
+std::optional<typename FlatCombiningTree<Tree>::ValueType>
+FlatCombiningTree<Tree>::get(const KeyType& key) {
+    Slot& slot = localSlot();
+    slot.kind = Slot::Kind::Get;
+    slot.key = &key;
+    execute(slot);
+    return slot.read;
+}
+
+template <class Tree>
+size_t FlatCombiningTree<Tree>::slotCount() {
+    std::lock_guard<std::mutex> guard(combinerLock);
+    size_t count = 0;
+    for (Slot* slot = slots.load(std::memory_order_acquire); slot; slot = slot->next) {
+        ++count;
+    }
+    return count;
+}
+
+INSTANTIATE_FOR_EACH_TREE(FlatCombiningTree);
@@ -0,0 +1,91 @@
+#ifndef FLATCOMBININGTREE_H
+#define FLATCOMBININGTREE_H
+
+#include "AVLTree.h"
+#include "ThreadRegistry.h"
+
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+// A tree shared by many threads through flat combining (Hendler, Incze,
+// Shavit, Tzafrir, SPAA 2010).
+//
+// Every thread has its own request slot. A caller writes its request there
+// and then either becomes the combiner (if it gets the combiner lock) or
+// waits for the current combiner to serve it. The combiner collects the
+// pending requests of all slots, sorts them by key (requests on one key come
+// from different threads, so any order among them is a valid one) and runs
+// them against the tree in one pass, so the tree is touched by one thread at
+// a time without a lock handoff per operation, and consecutive descents share
+// most of their path in cache.
+//
+// A thread's slot is marked dead when the thread exits, and the combiner
+// unlinks dead slots as it walks the list, so the walk is over the threads
+// still using the tree.
+//
+// insert / remove / contains / get may be called from any number of threads
+// at once; each call returns once its request has been applied. The
+// destructor must not run alongside them.
+template <class Tree>
+class FlatCombiningTree {
+public:
+    using KeyType   = typename Tree::KeyType;
+    using ValueType = typename Tree::ValueType;
+
+private:
+    // One thread's request, written by that thread while 'pending' is false
+    // and by the combiner while it is true.
+    struct Slot {
+        enum class Kind { Insert, Remove, Get };
+
+        std::atomic<bool> pending{false};
+        std::atomic<bool> dead{false};     // Owner thread exited
+        Kind             kind = Kind::Get;
+        const KeyType*   key = nullptr;
+        ValueType        value = 0;
+        bool             result = false;
+        std::optional<ValueType> read;
+        Slot*            next = nullptr;   // Registration list
+    };
+
+    Tree tree;
+    std::mutex combinerLock;
+    std::atomic<Slot*> slots;   // Registered slots (pushed at the front)
+    ThreadRegistry<Slot> registry;
+
+    // The calling thread's slot, registered on first use.
+    Slot& localSlot();
+
+    // Posts the request in 'slot' and returns once it has been served.
+    void execute(Slot& slot);
+
+    // Serves every pending request and unlinks dead slots (combiner lock
+    // held).
+    void combine();
+
+    // Takes the dead 'slot' out of the list, given the link to it (nullptr:
+    // the head). False if it could not be done now.
+    bool unlink(Slot** link, Slot* slot);
+
+    void apply(Slot& slot);
+
+public:
+    FlatCombiningTree();
+    ~FlatCombiningTree();
+
+    FlatCombiningTree(const FlatCombiningTree&) = delete;
+    FlatCombiningTree& operator=(const FlatCombiningTree&) = delete;
+
+    // Same meaning and results as on the tree itself.
+    bool insert(const KeyType& key, ValueType value);
+    bool remove(const KeyType& key);
+    bool contains(const KeyType& key);
+    std::optional<ValueType> get(const KeyType& key);
+
+    // Registered slots, dead ones the combiner has not unlinked yet included.
+    size_t slotCount();
+};
+
+#endif
@@ -0,0 +1,100 @@
+/*
+Tests for FlatCombiningTree: results like a single tree, many threads, and
+slots of exited threads going away.
+ */
+#include "FlatCombiningTree.h"
+#include "TestCheck.h"
+
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+static void testLikeOneTree() {
+    FlatCombiningTree<AVLTree> combining;
+    map<string, size_t> model;
+    mt19937 rng(68);
+    for (size_t i = 0; i < 20000; ++i) {
+        string k = key(rng() % 1000);
+        switch (rng() % 3) {
+        case 0:
+            CHECK(combining.remove(k) == (model.erase(k) == 1));
+            break;
+        case 1:
+            CHECK(combining.insert(k, i) == model.emplace(k, i).second);
+            break;
+        default:
+            CHECK(combining.contains(k) == (model.count(k) == 1));
+            break;
+        }
+    }
+    for (size_t i = 0; i < 1000; ++i) {
+        auto found = model.find(key(i));
+        CHECK(combining.get(key(i)) == (found == model.end() ? nullopt : optional<size_t>(found->second)));
+    }
+}
+
+// Threads on disjoint keys: each sees its own writes.
+static void testThreads() {
+    FlatCombiningTree<RedBlackTree> combining;
+    vector<thread> threads;
+    for (size_t t = 0; t < 8; ++t) {
+        threads.emplace_back([&combining, t] {
+            for (size_t i = 0; i < 2000; ++i) {
+                string k = key(i * 8 + t);
+                CHECK(combining.insert(k, i));
+                CHECK(combining.get(k) == optional<size_t>(i));
+                if (i % 2 == 0) {
+                    CHECK(combining.remove(k));
+                    CHECK(!combining.contains(k));
+                }
+            }
+        });
+    }
+    for (thread& t : threads) {
+        t.join();
+    }
+    for (size_t t = 0; t < 8; ++t) {
+        CHECK(!combining.contains(key(t)));
+        CHECK(combining.get(key(8 + t)) == optional<size_t>(1));
+    }
+}
+
+// Short-lived threads leave no slots behind for the combiner to walk, and
+// trees destroyed before or after a thread exits are both fine.
+static void testExitedThreads() {
+    FlatCombiningTree<AVLTree> combining;
+    auto early = make_unique<FlatCombiningTree<WAVLTree>>();
+    for (size_t i = 0; i < 200; ++i) {
+        thread([&combining, &early, i] {
+            combining.insert(key(i), i);
+            if (early) {
+                early->insert(key(i), i);
+            }
+        }).join();
+        if (i == 100) {
+            early.reset();
+        }
+    }
+    CHECK(combining.get(key(7)) == optional<size_t>(7));
+    CHECK(combining.slotCount() <= 2);
+
+    // Trees come and go under one thread, which keeps a cache entry for each
+    // one it used until the entry is pruned.
+    for (size_t i = 0; i < 1000; ++i) {
+        FlatCombiningTree<Treap> shortLived;
+        shortLived.insert(key(i), i);
+        CHECK(shortLived.slotCount() == 1);
+    }
+}
+
+int main() {
+    testLikeOneTree();
+    testThreads();
+    testExitedThreads();
+    return testResult();
+}
@@ -0,0 +1,134 @@
+/*
+SIMD three-way key comparison with runtime CPU dispatch.
+ */
+
+#include "KeyCompare.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KEYCOMPARE_X86 1
+#endif
+
+// Length compare once the common part is equal.
+static int compareLengths(size_t a, size_t b) {
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static int compareScalar(const std::string& a, const std::string& b) {
+    size_t n = std::min(a.size(), b.size());
+    int c = n ? std::memcmp(a.data(), b.data(), n) : 0;
+    return c ? c : compareLengths(a.size(), b.size());
+}
+
+#ifdef KEYCOMPARE_X86
+
+// A block load of 'width' bytes at 'p' cannot fault if it stays inside p's
+// 4 KB page, even when it runs past the end of the string; the extra bytes
+// are masked off. Near a page end the block is copied into a buffer instead.
+static bool blockStaysInPage(const char* p, size_t width) {
+    return (reinterpret_cast<uintptr_t>(p) & 4095) <= 4096 - width;
+}
+
+// The loads below may read past the end of a key (see blockStaysInPage),
+// so address and thread sanitizing are turned off for the kernels.
+__attribute__((target("avx2"), no_sanitize("address", "thread")))
+static int compareAVX2(const std::string& a, const std::string& b) {
+    const char* pa = a.data();
+    const char* pb = b.data();
+    size_t n = std::min(a.size(), b.size());
+
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pa + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pb + i));
+        uint32_t diff = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)));
+        if (diff) {
+            size_t j = i + __builtin_ctz(diff);
+            return static_cast<unsigned char>(pa[j]) - static_cast<unsigned char>(pb[j]);
+        }
+    }
+
+    size_t rest = n - i;
+    if (rest) {
+        alignas(32) char bufA[32];
+        alignas(32) char bufB[32];
+        const char* ta = pa + i;
+        const char* tb = pb + i;
+        if (!blockStaysInPage(ta, 32)) {
+            std::memcpy(bufA, ta, rest);
+            ta = bufA;
+        }
+        if (!blockStaysInPage(tb, 32)) {
+            std::memcpy(bufB, tb, rest);
+            tb = bufB;
+        }
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ta));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(tb));
+        uint32_t diff = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)));
+        diff &= (uint32_t{1} << rest) - 1;    // rest < 32: ignore bytes past the shorter key
+        if (diff) {
+            size_t j = __builtin_ctz(diff);
+            return static_cast<unsigned char>(ta[j]) - static_cast<unsigned char>(tb[j]);
+        }
+    }
+    return compareLengths(a.size(), b.size());
+}
+
+// PCMPESTRI takes explicit lengths, so the last block needs no mask: it
+// returns the index of the first differing byte within the given lengths,
+// or 16 if there is none.
+__attribute__((target("sse4.2"), no_sanitize("address", "thread")))
+static int compareSSE42(const std::string& a, const std::string& b) {
+    const char* pa = a.data();
+    const char* pb = b.data();
+    size_t n = std::min(a.size(), b.size());
+    constexpr int mode = _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_EACH | _SIDD_NEGATIVE_POLARITY;
+
+    for (size_t i = 0; i < n; i += 16) {
+        int len = static_cast<int>(std::min<size_t>(16, n - i));
+        alignas(16) char bufA[16];
+        alignas(16) char bufB[16];
+        const char* ta = pa + i;
+        const char* tb = pb + i;
+        if (len < 16 && !blockStaysInPage(ta, 16)) {
+            std::memcpy(bufA, ta, len);
+            ta = bufA;
+        }
+        if (len < 16 && !blockStaysInPage(tb, 16)) {
+            std::memcpy(bufB, tb, len);
+            tb = bufB;
+        }
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ta));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tb));
+        int j = _mm_cmpestri(va, len, vb, len, mode);
+        if (j < len) {
+            return static_cast<unsigned char>(ta[j]) - static_cast<unsigned char>(tb[j]);
+        }
+    }
+    return compareLengths(a.size(), b.size());
+}
+
+#endif
+
+using CompareFn = int (*)(const std::string&, const std::string&);
+
+static CompareFn pickCompare() {
+#ifdef KEYCOMPARE_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return compareAVX2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return compareSSE42;
+    }
+#endif
+    return compareScalar;
+}
+
+int compareKeys(const std::string& a, const std::string& b) {
+    static const CompareFn impl = pickCompare();
+    return impl(a, b);
+}
@@ -0,0 +1,17 @@
+#ifndef KEYCOMPARE_H
+#define KEYCOMPARE_H
+
+#include <string>
+
+// Three-way comparison of keys in std::string order (bytes compared as
+// unsigned char, shorter key first on a tie): < 0, 0 or > 0.
+//
+// One call replaces the 'key < node->key' / 'key > node->key' pair in tree
+// descents. Bytes are compared 32 at a time (AVX2) or 16 at a time (SSE4.2
+// PCMPESTRI): the first differing byte is found with a movemask + count
+// trailing zeros, and the final partial block is compared with a length mask
+// instead of a byte loop. The implementation is picked once at runtime from
+// the CPU's features, with a scalar (memcmp) fallback.
+int compareKeys(const std::string& a, const std::string& b);
+
+#endif
@@ -0,0 +1,117 @@
+/*
+Tests for the SIMD key comparison and the 8-byte key prefixes: both must
+agree with std::string order.
+ */
+#include "KeyCompare.h"
+#include "KeyPrefix.h"
+#include "TestCheck.h"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+static int sign(int value) {
+    return (value > 0) - (value < 0);
+}
+
+static bool agrees(const string& a, const string& b) {
+    return sign(compareKeys(a, b)) == sign(a.compare(b))
+           && sign(compareKeys(b, a)) == -sign(a.compare(b));
+}
+
+// Every length around the 16 / 32 byte blocks, differing at every position,
+// with bytes on both sides of 0x80 (compared unsigned) and embedded zeros.
+static void testBlockBoundaries() {
+    for (size_t length = 0; length <= 70; ++length) {
+        string a(length, 'k');
+        for (size_t i = 0; i < length; ++i) {
+            a[i] = static_cast<char>('a' + i % 26);
+        }
+        CHECK(agrees(a, a));
+        CHECK(agrees(a, a + '\0'));
+        CHECK(agrees(a, a + 'x'));
+        for (size_t at = 0; at < length; ++at) {
+            for (char c : {'\0', 'A', '\x7f', '\x80', '\xff'}) {
+                string b = a;
+                b[at] = c;
+                CHECK(agrees(a, b));
+                CHECK(agrees(a, b.substr(0, at + 1)));
+            }
+        }
+    }
+}
+
+static void testRandom() {
+    mt19937 rng(57);
+    string base(100, 'p');
+    for (size_t i = 0; i < 100000; ++i) {
+        // Mostly long shared prefixes, so the difference lands anywhere.
+        string a = base.substr(0, rng() % 100);
+        string b = base.substr(0, rng() % 100);
+        if (!a.empty() && rng() % 2) {
+            a[rng() % a.size()] = static_cast<char>(rng());
+        }
+        if (!b.empty() && rng() % 2) {
+            b[rng() % b.size()] = static_cast<char>(rng());
+        }
+        CHECK(agrees(a, b));
+    }
+}
+
+// keyPrefix() order implies key order; equal prefixes mean equal first 8 bytes.
+static void testPrefixOrder() {
+    mt19937 rng(58);
+    for (size_t i = 0; i < 100000; ++i) {
+        string a(rng() % 12, 'x');
+        string b(rng() % 12, 'x');
+        for (char& c : a) {
+            c = static_cast<char>(rng() % 4 == 0 ? rng() : 'x');
+        }
+        for (char& c : b) {
+            c = static_cast<char>(rng() % 4 == 0 ? rng() : 'x');
+        }
+        int64_t pa = keyPrefix(a);
+        int64_t pb = keyPrefix(b);
+        if (pa < pb) {
+            CHECK(a < b);
+        } else if (pa > pb) {
+            CHECK(a > b);
+        } else {
+            string headA = a.substr(0, 8), headB = b.substr(0, 8);
+            headA.resize(8, '\0');
+            headB.resize(8, '\0');
+            CHECK(headA == headB);
+        }
+        CHECK(pa <= kPrefixPad);
+    }
+}
+
+// prefixRank() against counting by hand, for every count up to 16.
+static void testPrefixRank() {
+    mt19937_64 rng(58);
+    alignas(32) int64_t prefixes[16];
+    for (size_t round = 0; round < 20000; ++round) {
+        size_t count = rng() % 17;
+        for (size_t i = 0; i < 16; ++i) {
+            prefixes[i] = i < count ? static_cast<int64_t>(rng() % 8) - 4 : kPrefixPad;
+        }
+        sort(prefixes, prefixes + count);
+        int64_t probe = static_cast<int64_t>(rng() % 10) - 5;
+        size_t less = 0, lessEqual = 0;
+        prefixRank(prefixes, count, probe, less, lessEqual);
+        CHECK(less == static_cast<size_t>(count_if(prefixes, prefixes + count,
+                                                   [&](int64_t p) { return p < probe; })));
+        CHECK(lessEqual == static_cast<size_t>(count_if(prefixes, prefixes + count,
+                                                        [&](int64_t p) { return p <= probe; })));
+    }
+}
+
+int main() {
+    testBlockBoundaries();
+    testRandom();
+    testPrefixOrder();
+    testPrefixRank();
+    return testResult();
+}
@@ -0,0 +1,92 @@
+/*
+8-byte key prefixes and the SIMD rank kernel used for in-node searches.
+ */
+
+#include "KeyPrefix.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KEYPREFIX_X86 1
+#endif
+
+int64_t keyPrefix(const std::string& key) {
+    unsigned char bytes[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    std::memcpy(bytes, key.data(), std::min<size_t>(key.size(), 8));
+
+    uint64_t packed = 0;
+    for (unsigned char b : bytes) {
+        packed = (packed << 8) | b;           // big-endian: first byte most significant
+    }
+    // Flip the sign bit so signed order equals unsigned (byte) order.
+    return static_cast<int64_t>(packed ^ (uint64_t{1} << 63));
+}
+
+static void prefixRankScalar(const int64_t* prefixes, size_t count, int64_t probe,
+                             size_t& less, size_t& lessEqual) {
+    less = 0;
+    lessEqual = 0;
+    for (size_t i = 0; i < count; ++i) {
+        less      += prefixes[i] <  probe;
+        lessEqual += prefixes[i] <= probe;
+    }
+}
+
+#ifdef KEYPREFIX_X86
+
+// 4 prefixes per compare. Padding entries are kPrefixPad, so they are never
+// 'less'; they can only be 'lessEqual' for a probe equal to the pad, hence the clamp.
+__attribute__((target("avx2")))
+static void prefixRankAVX2(const int64_t* prefixes, size_t count, int64_t probe,
+                           size_t& less, size_t& lessEqual) {
+    const __m256i p = _mm256_set1_epi64x(probe);
+    size_t lt = 0;
+    size_t gt = 0;
+    size_t padded = (count + 3) & ~size_t{3};
+    for (size_t i = 0; i < padded; i += 4) {
+        __m256i v = _mm256_load_si256(reinterpret_cast<const __m256i*>(prefixes + i));
+        lt += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(p, v))));
+        gt += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(v, p))));
+    }
+    less = lt;
+    lessEqual = std::min(count, padded - gt);
+}
+
+// Same with 2 prefixes per compare.
+__attribute__((target("sse4.2")))
+static void prefixRankSSE42(const int64_t* prefixes, size_t count, int64_t probe,
+                            size_t& less, size_t& lessEqual) {
+    const __m128i p = _mm_set1_epi64x(probe);
+    size_t lt = 0;
+    size_t gt = 0;
+    size_t padded = (count + 3) & ~size_t{3};
+    for (size_t i = 0; i < padded; i += 2) {
+        __m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(prefixes + i));
+        lt += __builtin_popcount(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(p, v))));
+        gt += __builtin_popcount(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(v, p))));
+    }
+    less = lt;
+    lessEqual = std::min(count, padded - gt);
+}
+
+#endif
+
+void prefixRank(const int64_t* prefixes, size_t count, int64_t probe,
+                size_t& less, size_t& lessEqual) {
+#ifdef KEYPREFIX_X86
+    static const int level = __builtin_cpu_supports("avx2")   ? 2
+                           : __builtin_cpu_supports("sse4.2") ? 1
+                                                              : 0;
+    if (level == 2) {
+        prefixRankAVX2(prefixes, count, probe, less, lessEqual);
+        return;
+    }
+    if (level == 1) {
+        prefixRankSSE42(prefixes, count, probe, less, lessEqual);
+        return;
+    }
+#endif
+    prefixRankScalar(prefixes, count, probe, less, lessEqual);
+}
@@ -0,0 +1,30 @@
+#ifndef KEYPREFIX_H
+#define KEYPREFIX_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// 8-byte key prefixes for SIMD searches over std::string keys.
+//
+// keyPrefix() packs the first 8 bytes of a key big-endian (zero padded) and
+// flips the sign bit, so comparing two prefixes as signed 64-bit integers
+// orders them like the keys themselves:
+//   keyPrefix(a) < keyPrefix(b)  implies  a < b
+//   keyPrefix(a) == keyPrefix(b) means the keys still need a full compare.
+// Signed order is what the SSE4.2 / AVX2 64-bit compares provide.
+
+// Prefix value used to pad unused slots: never less than any real prefix.
+constexpr int64_t kPrefixPad = INT64_MAX;
+
+int64_t keyPrefix(const std::string& key);
+
+// Counts the entries of prefixes[0, count) that are < probe ('less') and
+// <= probe ('lessEqual'). For a sorted array these are the bounds of the run
+// of entries whose prefix equals the probe's. 'prefixes' must be 32-byte
+// aligned and padded with kPrefixPad up to a multiple of 4 entries.
+// Uses AVX2 or SSE4.2 when the CPU has them, scalar code otherwise.
+void prefixRank(const int64_t* prefixes, size_t count, int64_t probe,
+                size_t& less, size_t& lessEqual);
+
+#endif
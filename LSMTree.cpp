@@ -0,0 +1,434 @@
+/*
+Log-structured store: an AVL memtable over tiers of frozen sorted runs with
+Bloom filters, merged by a background compactor.
+ */
+
+#include "LSMTree.h"
+#include "KeyCompare.h"
+
+#include <algorithm>
+#include <functional>
+
+template <class Tree>
+LSMTree<Tree>::LSMTree(size_t limit)
+    : levels(std::make_shared<Levels>()), memtableLimit(std::max<size_t>(limit, 1)),
+      stopping(false), compactor([this] { runCompactor(); }) {}
+
+template <class Tree>
+LSMTree<Tree>::~LSMTree() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    compactorWake.notify_one();
+    compactor.join();
+}
+
+// ---------------------------------------------------------------------------
+// Run
+
+// Double hashing: probe i is h1 + i * h2, with h2 odd so the probes differ.
+template <class Tree>
+LSMTree<Tree>::Run::Run(std::vector<Entry> sorted, size_t t)
+    : entries(std::move(sorted)), tier(t) {
+    bloom.assign((entries.size() * BloomBitsPerKey + 63) / 64 + 1, 0);
+    size_t bits = bloom.size() * 64;
+    for (const Entry& entry : entries) {
+        uint64_t h1 = std::hash<KeyType>{}(entry.key);
+        uint64_t h2 = (h1 >> 32 | h1 << 32) | 1;
+        for (size_t i = 0; i < BloomProbes; ++i) {
+            uint64_t bit = (h1 + i * h2) % bits;
+            bloom[bit / 64] |= uint64_t{1} << (bit % 64);
+        }
+    }
+}
+
+template <class Tree>
+bool LSMTree<Tree>::Run::mayContain(const KeyType& key) const {
+    size_t bits = bloom.size() * 64;
+    uint64_t h1 = std::hash<KeyType>{}(key);
+    uint64_t h2 = (h1 >> 32 | h1 << 32) | 1;
+    for (size_t i = 0; i < BloomProbes; ++i) {
+        uint64_t bit = (h1 + i * h2) % bits;
+        if (!(bloom[bit / 64] >> (bit % 64) & 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <class Tree>
+const typename LSMTree<Tree>::Entry* LSMTree<Tree>::Run::find(const KeyType& key) const {
+    size_t lo = 0;
+    size_t hi = entries.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = compareKeys(entries[mid].key, key);
+        if (cmp == 0) {
+            return &entries[mid];
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return nullptr;
+}
+
+// ---------------------------------------------------------------------------
+// Level
+
+// A merge of the run with the odd elements of the catalog below. On equal
+// keys the sample goes first, so 'own' is the run's lower bound for every
+// bridge; a run entry's 'down' is the next sample, which is at most a step or
+// two past the lower bound below. A level much larger than the run is not
+// sampled: it heads a chain of its own.
+template <class Tree>
+LSMTree<Tree>::Level::Level(std::shared_ptr<const Run> r, std::shared_ptr<const Level> b)
+    : run(std::move(r)), below(std::move(b)) {
+    const auto& entries = run->entries;
+    if (below && below->catalog.size() > CascadeRatio * std::max<size_t>(entries.size(), 1)) {
+        below = nullptr;
+    }
+    size_t lower = below ? below->catalog.size() - 1 : 0;   // without its end bridge
+    catalog.reserve(entries.size() + lower / 2 + 1);
+
+    size_t own = 0;
+    size_t sample = 1;
+    while (own < entries.size() || sample < lower) {
+        if (sample < lower &&
+            (own == entries.size() ||
+             compareKeys(*below->catalog[sample].key, entries[own].key) <= 0)) {
+            catalog.push_back({below->catalog[sample].key, static_cast<uint32_t>(own),
+                               static_cast<uint32_t>(sample)});
+            sample += 2;
+        } else {
+            catalog.push_back({&entries[own].key, static_cast<uint32_t>(own),
+                               static_cast<uint32_t>(std::min(sample, lower))});
+            ++own;
+        }
+    }
+    catalog.push_back({nullptr, static_cast<uint32_t>(entries.size()), static_cast<uint32_t>(lower)});
+}
+
+// ---------------------------------------------------------------------------
+// Writes
+
+template <class Tree>
+void LSMTree<Tree>::write(const KeyType& key, ValueType value, bool removed) {
+    if (auto index = memtable.get(key)) {
+        slots[*index] = {key, value, removed};
+        return;
+    }
+    memtable.insert(key, slots.size());
+    slots.push_back({key, value, removed});
+    if (slots.size() >= memtableLimit) {
+        freeze();
+    }
+}
+
+template <class Tree>
+void LSMTree<Tree>::stall(std::unique_lock<std::mutex>& guard) {
+    writersWake.wait(guard, [this] {
+        return levels->size() <= MaxRuns || !fullTier(*levels).second;
+    });
+}
+
+template <class Tree>
+void LSMTree<Tree>::put(const KeyType& key, ValueType value) {
+    std::unique_lock<std::mutex> guard(lock);
+    write(key, value, false);
+    stall(guard);
+}
+
+template <class Tree>
+void LSMTree<Tree>::remove(const KeyType& key) {
+    std::unique_lock<std::mutex> guard(lock);
+    write(key, 0, true);
+    stall(guard);
+}
+
+// The slots are in arrival order; sorting them gives the run.
+template <class Tree>
+void LSMTree<Tree>::freeze() {
+    if (slots.empty()) {
+        return;
+    }
+    std::sort(slots.begin(), slots.end(), [](const Entry& a, const Entry& b) {
+        return compareKeys(a.key, b.key) < 0;
+    });
+    auto run = std::make_shared<const Run>(std::move(slots), 0);
+    auto next = std::make_shared<Levels>();
+    next->reserve(levels->size() + 1);
+    next->push_back(std::make_shared<const Level>(std::move(run),
+                                                  levels->empty() ? nullptr : levels->front()));
+    next->insert(next->end(), levels->begin(), levels->end());
+    levels = std::move(next);
+
+    slots = {};
+    memtable.clear();
+    if (fullTier(*levels).second) {
+        compactorWake.notify_one();
+    }
+}
+
+template <class Tree>
+void LSMTree<Tree>::flush() {
+    std::lock_guard<std::mutex> guard(lock);
+    freeze();
+}
+
+// ---------------------------------------------------------------------------
+// Reads
+
+template <class Tree>
+std::optional<typename LSMTree<Tree>::ValueType> LSMTree<Tree>::get(const KeyType& key) const {
+    std::shared_ptr<const Levels> runs;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (auto index = memtable.get(key)) {
+            const Entry& entry = slots[*index];
+            return entry.removed ? std::nullopt : std::optional<ValueType>(entry.value);
+        }
+        runs = levels;
+    }
+    for (const auto& level : *runs) {
+        if (!level->run->mayContain(key)) {
+            continue;
+        }
+        if (const Entry* entry = level->run->find(key)) {
+            return entry->removed ? std::nullopt : std::optional<ValueType>(entry->value);
+        }
+    }
+    return std::nullopt;
+}
+
+template <class Tree>
+bool LSMTree<Tree>::contains(const KeyType& key) const {
+    return get(key).has_value();
+}
+
+// Every key of a run is in its catalog, so the bridge found for 'key' in a
+// catalog tells where 'key' goes in the run. Below, 'down' lands at most a
+// few bridges past where 'key' goes (every second one was sampled into the
+// catalog above), so a short walk back finds it.
+template <class Tree>
+void LSMTree<Tree>::cascade(const Level& top, const KeyType& key, bool after,
+                            std::vector<const Entry*>& bounds) {
+    auto beyond = [&key, after](const Bridge& bridge) {
+        int cmp = compareKeys(*bridge.key, key);
+        return after ? cmp > 0 : cmp >= 0;
+    };
+
+    size_t lo = 0;
+    size_t hi = top.catalog.size() - 1;       // the end bridge is beyond every key
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (beyond(top.catalog[mid])) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    size_t at = lo;
+    for (const Level* level = &top; level; level = level->below.get()) {
+        const Bridge& bridge = level->catalog[at];
+        bounds.push_back(level->run->entries.data() + bridge.own);
+        if (level->below) {
+            const auto& lower = level->below->catalog;
+            at = bridge.down;
+            while (at > 0 && beyond(lower[at - 1])) {
+                --at;
+            }
+        }
+    }
+}
+
+// The smallest key under any cursor comes from the newest source holding it
+// (the first one found); every cursor on that key then moves past it. Runs
+// stay alive while merged, so 'next' does too.
+template <class Tree>
+template <class Visit>
+void LSMTree<Tree>::mergeCursors(std::vector<Cursor>& sources, Visit visit) {
+    for (;;) {
+        const Entry* next = nullptr;
+        for (const Cursor& cursor : sources) {
+            if (cursor.at != cursor.end && (!next || compareKeys(cursor.at->key, next->key) < 0)) {
+                next = cursor.at;
+            }
+        }
+        if (!next) {
+            return;
+        }
+        visit(*next);
+        for (Cursor& cursor : sources) {
+            if (cursor.at != cursor.end && cursor.at->key == next->key) {
+                ++cursor.at;
+            }
+        }
+    }
+}
+
+// The memtable's part is copied out under the lock; the runs are read after
+// it is released.
+template <class Tree>
+std::vector<typename LSMTree<Tree>::ValueType>
+LSMTree<Tree>::findRange(const KeyType& lowKey, const KeyType& highKey) const {
+    std::vector<Entry> recent;
+    std::shared_ptr<const Levels> runs;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (size_t index : memtable.findRange(lowKey, highKey)) {
+            recent.push_back(slots[index]);
+        }
+        runs = levels;
+    }
+
+    // A level the one in front of it does not cascade into heads a chain.
+    std::vector<const Entry*> starts;
+    std::vector<const Entry*> ends;
+    for (size_t i = 0; i < runs->size(); ++i) {
+        if (i == 0 || (*runs)[i - 1]->below != (*runs)[i]) {
+            cascade(*(*runs)[i], lowKey, false, starts);
+            cascade(*(*runs)[i], highKey, true, ends);
+        }
+    }
+    std::vector<Cursor> sources;
+    sources.reserve(runs->size() + 1);
+    sources.push_back({recent.data(), recent.data() + recent.size()});
+    for (size_t i = 0; i < starts.size(); ++i) {
+        sources.push_back({starts[i], ends[i]});
+    }
+
+    std::vector<ValueType> result;
+    mergeCursors(sources, [&result](const Entry& entry) {
+        if (!entry.removed) {
+            result.push_back(entry.value);
+        }
+    });
+    return result;
+}
+
+template <class Tree>
+size_t LSMTree<Tree>::memtableSize() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return slots.size();
+}
+
+template <class Tree>
+size_t LSMTree<Tree>::runCount() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return levels->size();
+}
+
+// ---------------------------------------------------------------------------
+// Compaction
+
+// Tiers only grow from newest to oldest, so the runs of a tier are adjacent.
+template <class Tree>
+std::pair<size_t, size_t> LSMTree<Tree>::fullTier(const Levels& runs) {
+    size_t first = 0;
+    for (size_t i = 1; i <= runs.size(); ++i) {
+        if (i == runs.size() || runs[i]->run->tier != runs[first]->run->tier) {
+            if (i - first >= Fanout) {
+                return {first, i - first};
+            }
+            first = i;
+        }
+    }
+    return {0, 0};
+}
+
+// Runs frozen meanwhile were only put in front, so the merged ones are still
+// adjacent, just further back. Tombstones go once no older run is left to
+// hide a key in. The merged level is built outside the lock (nothing below
+// it changes meanwhile); the ones in front of it are rebuilt over it.
+template <class Tree>
+void LSMTree<Tree>::merge(const Levels& from, size_t first, size_t count, size_t tier) {
+    std::vector<Cursor> sources;
+    size_t total = 0;
+    for (size_t i = first; i < first + count; ++i) {
+        const auto& entries = from[i]->run->entries;
+        sources.push_back({entries.data(), entries.data() + entries.size()});
+        total += entries.size();
+    }
+    bool bottom = first + count == from.size();
+
+    std::vector<Entry> merged;
+    merged.reserve(total);
+    mergeCursors(sources, [&merged, bottom](const Entry& entry) {
+        if (!(bottom && entry.removed)) {
+            merged.push_back(entry);
+        }
+    });
+    std::shared_ptr<const Level> rest = first + count < from.size() ? from[first + count] : nullptr;
+    std::shared_ptr<const Level> top = rest;
+    if (!merged.empty()) {
+        top = std::make_shared<const Level>(std::make_shared<const Run>(std::move(merged), tier), rest);
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    const Levels& current = *levels;
+    size_t at = std::find(current.begin(), current.end(), from[first]) - current.begin();
+    Levels next(current.begin() + at + count, current.end());
+    if (top != rest) {
+        next.insert(next.begin(), top);
+    }
+    // Levels in front are rebuilt up to the first one that heads a chain;
+    // it and everything in front of it do not see what changed.
+    size_t kept = at;
+    while (kept > 0 && current[kept - 1]->below) {
+        --kept;
+    }
+    for (size_t i = at; i-- > kept;) {
+        top = std::make_shared<const Level>(current[i]->run, top);
+        next.insert(next.begin(), top);
+    }
+    next.insert(next.begin(), current.begin(), current.begin() + kept);
+    levels = std::make_shared<Levels>(std::move(next));
+    writersWake.notify_all();
+}
+
+template <class Tree>
+void LSMTree<Tree>::runCompactor() {
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            compactorWake.wait(guard, [this] { return stopping || fullTier(*levels).second; });
+            if (stopping) {
+                return;
+            }
+        }
+        // compact() may have run since the wait ended, so look again.
+        std::lock_guard<std::mutex> compactGuard(compacting);
+        std::shared_ptr<const Levels> runs;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            runs = levels;
+        }
+        auto [first, count] = fullTier(*runs);
+        if (count) {
+            merge(*runs, first, count, (*runs)[first]->run->tier + 1);
+        }
+    }
+}
+
+// The result takes the oldest run's tier, so it is not merged again soon.
+template <class Tree>
+void LSMTree<Tree>::compact() {
+    std::lock_guard<std::mutex> compactGuard(compacting);
+    std::shared_ptr<const Levels> runs;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        freeze();
+        runs = levels;
+    }
+    if (runs->empty()) {
+        return;
+    }
+    merge(*runs, 0, runs->size(), runs->back()->run->tier);
+}
+
+INSTANTIATE_FOR_EACH_TREE(LSMTree);
@@ -0,0 +1,190 @@
+#ifndef LSMTREE_H
+#define LSMTREE_H
+
+#include "AVLTree.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// A log-structured store, for write rates one balanced tree cannot absorb.
+//
+// Writes go to a small mutable tree, the memtable. Once it holds
+// 'memtableLimit' keys it is frozen into a sorted run (an immutable array)
+// and a new memtable starts, so a write never touches more than the memtable.
+// Removals are written as tombstones that hide the key in older runs.
+//
+// Runs are kept newest first and grouped in tiers: a frozen memtable is
+// tier 0, and a background thread merges Fanout runs of one tier into one
+// run of the next, dropping the versions they shadow (and tombstones, once
+// nothing older is left below them). Lookups check the memtable, then the
+// runs from newest to oldest; each run has a Bloom filter, so get() skips
+// nearly every run that does not hold the key without searching it.
+// findRange() merges all levels, the newest version of each key winning;
+// fractional cascading finds where the range starts and ends in every run
+// with one binary search per chain of similar-sized levels, plus a step or
+// two per level below in the chain.
+// Writers that outpace the compactor wait once MaxRuns runs pile up, so
+// lookups never have to search an unbounded number of runs.
+//
+// Writes from any number of threads take one lock; reads take it only to
+// look at the memtable and pick up the current list of runs, which they then
+// search without it. compact() and the compactor take turns.
+template <class Tree>
+class LSMTree {
+public:
+    using KeyType   = typename Tree::KeyType;
+    using ValueType = typename Tree::ValueType;
+
+    // Runs of one tier merged together into the next tier.
+    static constexpr size_t Fanout = 4;
+
+    // Runs past which writers wait for the compactor to catch up.
+    static constexpr size_t MaxRuns = 32;
+
+    // A level cascades into the one below it only if the catalog below holds
+    // at most CascadeRatio times as many keys as its run; otherwise it starts
+    // a new chain. A catalog then stays within 1 + CascadeRatio / 2 times its
+    // run, so freezing a memtable over a big run costs the memtable's size,
+    // not half the run's.
+    static constexpr size_t CascadeRatio = 4;
+
+    // Bloom filter size and probes per key (about 1% false positives).
+    static constexpr size_t BloomBitsPerKey = 10;
+    static constexpr size_t BloomProbes     = 7;
+
+private:
+    // A key's newest version in one level: a value or a tombstone.
+    struct Entry {
+        KeyType   key;
+        ValueType value;
+        bool      removed;
+    };
+
+    // A frozen level: entries sorted by key, one per key, and their filter.
+    struct Run {
+        std::vector<Entry> entries;
+        std::vector<uint64_t> bloom;
+        size_t tier;
+
+        Run(std::vector<Entry> sorted, size_t tier);
+
+        bool mayContain(const KeyType& key) const;
+        const Entry* find(const KeyType& key) const;
+    };
+
+    // One element of a level's catalog: a key, where it would go in the
+    // level's run ('own'), and near where it would go in the catalog below
+    // ('down': at or just past it).
+    struct Bridge {
+        const KeyType* key;
+        uint32_t own;
+        uint32_t down;
+    };
+
+    // A run in the list, with its fractional-cascading catalog: the run's
+    // keys merged with every second element of the catalog below (if it
+    // cascades into that level, see CascadeRatio), and a bridge past the end.
+    // Built over the level below it, so a level is rebuilt when anything
+    // below it changes; freezing only builds one.
+    struct Level {
+        std::shared_ptr<const Run> run;
+        std::vector<Bridge> catalog;
+        std::shared_ptr<const Level> below;   // Next older level in the chain, nullptr at its end
+
+        Level(std::shared_ptr<const Run> run, std::shared_ptr<const Level> below);
+    };
+
+    // All levels, newest first. Replaced as a whole, never changed, so
+    // readers take the current list and search it without the lock.
+    using Levels = std::vector<std::shared_ptr<const Level>>;
+
+    // Entries [at, end) of one level, for merging.
+    struct Cursor {
+        const Entry* at;
+        const Entry* end;
+    };
+
+    mutable std::mutex lock;                 // Guards everything up to 'stopping'
+    Tree memtable;                           // Key -> index in 'slots'
+    std::vector<Entry> slots;
+    std::shared_ptr<const Levels> levels;
+    size_t memtableLimit;
+
+    // Background compaction. The compactor waits on 'lock' for a full tier,
+    // stalled writers for it to merge one; 'compacting' keeps compactions
+    // one at a time.
+    std::condition_variable compactorWake;
+    std::condition_variable writersWake;
+    bool stopping;
+    std::mutex compacting;
+    std::thread compactor;
+
+    // Writes the newest version of 'key' into the memtable ('lock' held).
+    void write(const KeyType& key, ValueType value, bool removed);
+
+    // Turns the memtable into the newest run ('lock' held).
+    void freeze();
+
+    // Waits while there are more than MaxRuns runs and a merge would
+    // reduce them.
+    void stall(std::unique_lock<std::mutex>& guard);
+
+    // First run and number of runs of the newest tier that holds Fanout
+    // runs or more; the number is 0 if no tier does.
+    static std::pair<size_t, size_t> fullTier(const Levels& runs);
+
+    // Merges runs [first, first + count) of 'from' into one run of 'tier'
+    // and swaps it in for them ('compacting' held, 'lock' not).
+    void merge(const Levels& from, size_t first, size_t count, size_t tier);
+
+    void runCompactor();
+
+    // Appends, for 'top' and every level below it in its chain, the first
+    // entry of its run with a key >= 'key' (> 'key' when 'after').
+    static void cascade(const Level& top, const KeyType& key, bool after,
+                        std::vector<const Entry*>& bounds);
+
+    // Calls 'visit' with the newest entry of each key across 'sources'
+    // (newest first), in key order.
+    template <class Visit>
+    static void mergeCursors(std::vector<Cursor>& sources, Visit visit);
+
+public:
+    explicit LSMTree(size_t memtableLimit = 4096);
+    ~LSMTree();
+
+    LSMTree(const LSMTree&) = delete;
+    LSMTree& operator=(const LSMTree&) = delete;
+
+    // Blind writes: they only touch the memtable and do not look for the key
+    // in the runs, so they cannot tell whether it was there.
+    void put(const KeyType& key, ValueType value);
+    void remove(const KeyType& key);
+
+    bool contains(const KeyType& key) const;
+    std::optional<ValueType> get(const KeyType& key) const;
+
+    // Values whose keys lie in [lowKey, highKey], in key order.
+    std::vector<ValueType> findRange(const KeyType& lowKey,
+                                     const KeyType& highKey) const;
+
+    // Freezes the memtable now, even if it is not full.
+    void flush();
+
+    // Merges the memtable and every run into one run, in the calling thread.
+    void compact();
+
+    // Keys in the memtable, and frozen runs.
+    size_t memtableSize() const;
+    size_t runCount() const;
+};
+
+using AVLTreeLSM = LSMTree<AVLTree>;
+
+#endif
@@ -0,0 +1,144 @@
+/*
+Tests for LSMTree: lookups and ranges against a map across flushes, merges
+and compaction, cascading past a large bottom run, and readers alongside
+writers and the compactor.
+ */
+#include "LSMTree.h"
+#include "TestCheck.h"
+
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+template <class Tree>
+static void checkRange(const LSMTree<Tree>& store, const map<string, size_t>& model,
+                       const string& low, const string& high) {
+    vector<size_t> expected;
+    for (auto it = model.lower_bound(low); it != model.end() && it->first <= high; ++it) {
+        expected.push_back(it->second);
+    }
+    CHECK(store.findRange(low, high) == expected);
+}
+
+// Random puts and removes over a small memtable, so keys end up spread over
+// many runs and tombstones, checked against a map as runs come and go.
+template <class Tree>
+static void testModel() {
+    LSMTree<Tree> store(64);
+    map<string, size_t> model;
+    mt19937 rng(73);
+    for (size_t i = 0; i < 40000; ++i) {
+        string k = key(rng() % 2000);
+        if (rng() % 4 == 0) {
+            store.remove(k);
+            model.erase(k);
+        } else {
+            store.put(k, i);
+            model[k] = i;
+        }
+        if (i % 500 == 0) {
+            auto found = model.find(k);
+            CHECK(store.get(k) == (found == model.end() ? nullopt : optional<size_t>(found->second)));
+            size_t low = rng() % 2000;
+            checkRange(store, model, key(low), key(low + rng() % 200));
+        }
+        if (i % 9000 == 0) {
+            store.compact();
+            CHECK(store.runCount() == 1);
+        } else if (i % 3000 == 0) {
+            store.flush();
+            CHECK(store.memtableSize() == 0);
+        }
+    }
+    for (size_t i = 0; i < 2000; ++i) {
+        auto found = model.find(key(i));
+        CHECK(store.contains(key(i)) == (found != model.end()));
+    }
+    checkRange(store, model, key(0), key(2000));
+    checkRange(store, model, "a", "b");
+    checkRange(store, model, key(5), key(4));
+}
+
+// Small runs over a bottom run far larger than them: the small ones do not
+// cascade into it, and ranges still see every level.
+static void testLargeBottom() {
+    LSMTree<AVLTree> store(16);
+    map<string, size_t> model;
+    for (size_t i = 0; i < 20000; ++i) {
+        store.put(key(2 * i), i);
+        model[key(2 * i)] = i;
+    }
+    store.compact();
+    for (size_t i = 0; i < 200; ++i) {
+        size_t k = (i * 97) % 40000;
+        if (i % 3 == 0) {
+            store.remove(key(k));
+            model.erase(key(k));
+        } else {
+            store.put(key(k), i);
+            model[key(k)] = i;
+        }
+    }
+    store.flush();
+    CHECK(store.runCount() > 1);
+    for (size_t low = 0; low < 40000; low += 1999) {
+        checkRange(store, model, key(low), key(low + 300));
+    }
+    checkRange(store, model, key(0), key(40000));
+}
+
+// Writers on disjoint keys while readers check that a key, once written,
+// keeps a value that writer wrote, and the compactor merges underneath.
+static void testThreads() {
+    LSMTree<RedBlackTree> store(128);
+    atomic<bool> done{false};
+    vector<thread> readers;
+    for (size_t r = 0; r < 2; ++r) {
+        readers.emplace_back([&store, &done, r] {
+            mt19937 rng(r);
+            while (!done.load()) {
+                size_t k = rng() % 20000;
+                if (auto value = store.get(key(k))) {
+                    CHECK(*value % 4 == k / 5000);
+                }
+                CHECK(store.findRange(key(k), key(k + 50)).size() <= 51);
+            }
+        });
+    }
+    vector<thread> writers;
+    for (size_t t = 0; t < 4; ++t) {
+        writers.emplace_back([&store, t] {
+            for (size_t i = 0; i < 20000; ++i) {
+                store.put(key(t * 5000 + i % 5000), 4 * i + t);
+            }
+        });
+    }
+    for (thread& t : writers) {
+        t.join();
+    }
+    done.store(true);
+    for (thread& t : readers) {
+        t.join();
+    }
+    store.compact();
+    CHECK(store.findRange(key(0), key(20000)).size() == 20000);
+    for (size_t t = 0; t < 4; ++t) {
+        CHECK(store.get(key(t * 5000 + 4999)) == optional<size_t>(4 * 19999 + t));
+    }
+}
+
+int main() {
+    testModel<AVLTree>();
+    testModel<WAVLTree>();
+    testModel<RedBlackTree>();
+    testModel<Treap>();
+    testLargeBottom();
+    testThreads();
+    return testResult();
+}
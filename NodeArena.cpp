@@ -0,0 +1,214 @@
+/*
+Slot allocator for tree nodes backed by 2 MB (huge page) chunks.
+ */
+
+#include "NodeArena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <new>
+
+#include <fstream>
+#include <string>
+#include <utility>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static constexpr size_t FirstChunkSize = size_t{64} << 10;
+
+NodeArena::NodeArena(size_t size, size_t slotAlign)
+    : slotSize(std::max(size, sizeof(void*))), numaNode(-1),
+      freeList(nullptr), next(nullptr), end(nullptr) {
+    // Every slot must also be able to hold the free list link.
+    size_t align = std::max(slotAlign, alignof(void*));
+    slotSize = (slotSize + align - 1) & ~(align - 1);
+}
+
+NodeArena::~NodeArena() {
+    clear();
+}
+
+// Locked although it may not run concurrently with anything: a thread that
+// released slots and then let go of the arena (its last shared_ptr) only
+// synchronizes with us through the lock, use_count() being a relaxed load.
+void NodeArena::clear() {
+    std::lock_guard<std::mutex> guard(lock);
+    for (const Chunk& chunk : chunks) {
+        freeChunk(chunk);
+    }
+    chunks.clear();
+    ranges.clear();
+    freeList = nullptr;
+    next = nullptr;
+    end = nullptr;
+}
+
+void* NodeArena::allocate() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (freeList) {
+        void* slot = freeList;
+        freeList = *static_cast<void**>(slot);
+        return slot;
+    }
+    if (static_cast<size_t>(end - next) < slotSize) {
+        grow();
+    }
+    void* slot = next;
+    next += slotSize;
+    return slot;
+}
+
+void NodeArena::release(void* slot) {
+    std::lock_guard<std::mutex> guard(lock);
+    *static_cast<void**>(slot) = freeList;
+    freeList = slot;
+}
+
+void NodeArena::swap(NodeArena& other) noexcept {
+    std::swap(slotSize, other.slotSize);
+    std::swap(numaNode, other.numaNode);
+    chunks.swap(other.chunks);
+    ranges.swap(other.ranges);
+    std::swap(freeList, other.freeList);
+    std::swap(next, other.next);
+    std::swap(end, other.end);
+}
+
+bool NodeArena::owns(const void* slot) const {
+    uintptr_t p = reinterpret_cast<uintptr_t>(slot);
+    auto it = ranges.upper_bound(p);
+    if (it == ranges.begin()) {
+        return false;
+    }
+    --it;
+    return p < it->second;
+}
+
+void NodeArena::setNumaNode(int node) {
+    numaNode = node;
+}
+
+int NodeArena::getNumaNode() const {
+    return numaNode;
+}
+
+// /sys/devices/system/node/online lists the nodes as ranges, e.g. "0-1".
+size_t NodeArena::numaNodeCount() {
+    std::ifstream in("/sys/devices/system/node/online");
+    std::string ranges;
+    if (!(in >> ranges) || ranges.empty()) {
+        return 1;
+    }
+    size_t last = ranges.find_last_of("-,");
+    return std::stoul(last == std::string::npos ? ranges : ranges.substr(last + 1)) + 1;
+}
+
+int NodeArena::currentNumaNode() {
+#ifdef __linux__
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if (getcpu(&cpu, &node) == 0) {
+        return static_cast<int>(node);
+    }
+#endif
+    return 0;
+}
+
+size_t NodeArena::reservedBytes() const {
+    size_t total = 0;
+    for (const Chunk& chunk : chunks) {
+        total += chunk.bytes;
+    }
+    return total;
+}
+
+size_t NodeArena::hugePageBytes() const {
+    size_t total = 0;
+    for (const Chunk& chunk : chunks) {
+        if (chunk.backing == Backing::Mapped || chunk.backing == Backing::HugeTLB) {
+            total += chunk.bytes;
+        }
+    }
+    return total;
+}
+
+void NodeArena::grow() {
+    size_t bytes = chunks.empty() ? FirstChunkSize
+                                  : std::min(chunks.back().bytes * 2, HugePageSize);
+    bytes = std::max(bytes, slotSize);
+    chunks.push_back(allocateChunk(bytes));
+    next = static_cast<char*>(chunks.back().base);
+    end = next + bytes;
+    ranges[reinterpret_cast<uintptr_t>(next)] = reinterpret_cast<uintptr_t>(end);
+}
+
+#ifdef __linux__
+// Binds a fresh mapping to 'node'. Preferred rather than strict binding:
+// when the node runs out of memory the pages come from another node.
+static void bindToNode(void* base, size_t bytes, int node) {
+    if (node < 0 || node >= 64) {
+        return;
+    }
+    unsigned long mask = 1UL << node;
+    syscall(SYS_mbind, base, bytes, MPOL_PREFERRED, &mask, 64UL, 0U);
+}
+#endif
+
+NodeArena::Chunk NodeArena::allocateChunk(size_t bytes) const {
+    Chunk chunk = {nullptr, bytes, Backing::Heap};
+#ifdef __linux__
+    if (bytes == HugePageSize) {
+        // Reserved huge pages: only available if the admin set some aside.
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            chunk = {p, bytes, Backing::HugeTLB};
+        }
+        // Transparent huge pages need a 2 MB aligned range: map twice the
+        // size and unmap the unaligned ends.
+        else if ((p = mmap(nullptr, 2 * bytes, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) != MAP_FAILED) {
+            uintptr_t start = reinterpret_cast<uintptr_t>(p);
+            uintptr_t aligned = (start + bytes - 1) & ~(bytes - 1);
+            if (aligned > start) {
+                munmap(p, aligned - start);
+            }
+            if (aligned + bytes < start + 2 * bytes) {
+                munmap(reinterpret_cast<void*>(aligned + bytes), start + bytes - aligned);
+            }
+            void* base = reinterpret_cast<void*>(aligned);
+            madvise(base, bytes, MADV_HUGEPAGE);   // a hint: ignored if THP is off
+            chunk = {base, bytes, Backing::Mapped};
+        }
+    } else if (numaNode >= 0) {
+        // Heap memory cannot be bound to a node, so small chunks are mapped too.
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED) {
+            chunk = {p, bytes, Backing::Paged};
+        }
+    }
+    if (chunk.base) {
+        bindToNode(chunk.base, bytes, numaNode);
+        return chunk;
+    }
+#endif
+    chunk.base = ::operator new(bytes);
+    return chunk;
+}
+
+void NodeArena::freeChunk(const Chunk& chunk) {
+#ifdef __linux__
+    if (chunk.backing != Backing::Heap) {
+        munmap(chunk.base, chunk.bytes);
+        return;
+    }
+#endif
+    ::operator delete(chunk.base);
+}
@@ -0,0 +1,91 @@
+#ifndef NODEARENA_H
+#define NODEARENA_H
+
+#include <vector>
+#include <map>
+#include <mutex>
+#include <cstddef>
+#include <cstdint>
+
+// Fixed-size slot allocator for tree nodes.
+//
+// Slots are carved out of chunks that double in size up to 2 MB. Chunks of
+// 2 MB are 2 MB aligned and backed by huge pages when the system allows it:
+// first MAP_HUGETLB (reserved huge pages), then a plain mapping with
+// madvise(MADV_HUGEPAGE) (transparent huge pages), then ordinary memory.
+// A tree of N nodes then needs about N * slotSize / 2 MB TLB entries instead
+// of one per 4 KB page. Released slots are kept on a free list and reused;
+// memory goes back to the system only when the arena is destroyed.
+//
+// With setNumaNode(), chunks allocated from then on are mapped and bound to
+// that NUMA node (mbind, MPOL_PREFERRED) before any page is touched.
+//
+// allocate() and release() may be called from several threads (trees that
+// share nodes share their arena); the other members may not.
+class NodeArena {
+public:
+    static constexpr size_t HugePageSize = size_t{2} << 20;
+
+    // Slots of 'slotSize' bytes aligned to 'slotAlign' (at most 16).
+    NodeArena(size_t slotSize, size_t slotAlign);
+    ~NodeArena();
+
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+
+    // Returns uninitialised storage for one slot.
+    void* allocate();
+
+    // Gives back a slot obtained from allocate().
+    void release(void* slot);
+
+    // True if 'slot' lies in one of this arena's chunks (O(log chunks)).
+    bool owns(const void* slot) const;
+
+    // Frees every chunk at once (O(number of chunks)); all slots become invalid.
+    void clear();
+
+    // Exchanges all chunks and slots with 'other' (both must use the same slot size).
+    void swap(NodeArena& other) noexcept;
+
+    // Places future chunks on NUMA node 'node' (-1: wherever the kernel likes).
+    void setNumaNode(int node);
+    int getNumaNode() const;
+
+    // Number of NUMA nodes on this machine, and the node the calling thread
+    // is running on (1 and 0 where this is unknown).
+    static size_t numaNodeCount();
+    static int currentNumaNode();
+
+    // Total bytes held in chunks, and how many of them were mapped for huge pages.
+    size_t reservedBytes() const;
+    size_t hugePageBytes() const;
+
+private:
+    // Heap: operator new. Paged: plain mapping. Mapped: 2 MB mapping advised
+    // for transparent huge pages. HugeTLB: reserved huge pages.
+    enum class Backing { Heap, Paged, Mapped, HugeTLB };
+
+    struct Chunk {
+        void*   base;
+        size_t  bytes;
+        Backing backing;
+    };
+
+    size_t slotSize;
+    int numaNode;         // Node chunks are bound to, -1 for none
+    std::vector<Chunk> chunks;
+    std::map<uintptr_t, uintptr_t> ranges;  // Chunk start -> end, for owns()
+    std::mutex lock;      // Guards the free list and the bump region
+    void* freeList;       // Released slots, linked through their first word
+    char* next;           // Unused part of the newest chunk
+    char* end;
+
+    // Adds a chunk twice the size of the previous one (at most HugePageSize).
+    void grow();
+
+    Chunk allocateChunk(size_t bytes) const;
+    static void freeChunk(const Chunk& chunk);
+};
+
+#endif
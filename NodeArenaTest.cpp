@@ -0,0 +1,103 @@
+/*
+Tests for NodeArena, the slot allocator behind the tree nodes.
+ */
+#include "NodeArena.h"
+#include "TestCheck.h"
+
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <thread>
+#include <vector>
+using namespace std;
+
+static void testSlots() {
+    NodeArena arena(40, 16);
+    CHECK(arena.reservedBytes() == 0);
+
+    // Enough slots to go through every chunk size up to a 2 MB chunk.
+    vector<void*> slots;
+    set<uintptr_t> seen;
+    for (size_t i = 0; i < 200000; ++i) {
+        void* slot = arena.allocate();
+        CHECK(reinterpret_cast<uintptr_t>(slot) % 16 == 0);
+        CHECK(arena.owns(slot));
+        memset(slot, 0xab, 40);
+        seen.insert(reinterpret_cast<uintptr_t>(slot));
+        slots.push_back(slot);
+    }
+    CHECK(seen.size() == slots.size());
+    CHECK(arena.reservedBytes() >= 200000 * 48);
+    CHECK(arena.hugePageBytes() <= arena.reservedBytes());
+
+    int local = 0;
+    CHECK(!arena.owns(&local));
+    CHECK(!arena.owns(nullptr));
+
+    // Released slots are handed out again before the arena grows.
+    size_t reserved = arena.reservedBytes();
+    for (size_t i = 0; i < slots.size(); i += 2) {
+        arena.release(slots[i]);
+    }
+    for (size_t i = 0; i < slots.size(); i += 2) {
+        CHECK(seen.count(reinterpret_cast<uintptr_t>(arena.allocate())) == 1);
+    }
+    CHECK(arena.reservedBytes() == reserved);
+
+    arena.clear();
+    CHECK(arena.reservedBytes() == 0);
+    CHECK(!arena.owns(slots[1]));
+    CHECK(arena.owns(arena.allocate()));
+}
+
+static void testSwapAndNuma() {
+    NodeArena a(32, 8);
+    NodeArena b(32, 8);
+    void* slot = a.allocate();
+    a.setNumaNode(0);
+    a.swap(b);
+    CHECK(b.owns(slot));
+    CHECK(!a.owns(slot));
+    CHECK(b.getNumaNode() == 0);
+    CHECK(a.getNumaNode() == -1);
+
+    CHECK(NodeArena::numaNodeCount() >= 1);
+    CHECK(NodeArena::currentNumaNode() >= 0);
+    CHECK(static_cast<size_t>(NodeArena::currentNumaNode()) < NodeArena::numaNodeCount());
+
+    // Bound to a node: still usable where binding is not supported.
+    NodeArena bound(32, 8);
+    bound.setNumaNode(NodeArena::currentNumaNode());
+    CHECK(bound.owns(bound.allocate()));
+}
+
+// allocate() and release() may run on several threads at once.
+static void testThreads() {
+    NodeArena arena(24, 8);
+    vector<thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&arena] {
+            vector<void*> mine;
+            for (int round = 0; round < 50; ++round) {
+                for (int i = 0; i < 200; ++i) {
+                    mine.push_back(arena.allocate());
+                }
+                for (void* slot : mine) {
+                    arena.release(slot);
+                }
+                mine.clear();
+            }
+        });
+    }
+    for (thread& t : threads) {
+        t.join();
+    }
+    CHECK(arena.reservedBytes() > 0);
+}
+
+int main() {
+    testSlots();
+    testSwapAndNuma();
+    testThreads();
+    return testResult();
+}
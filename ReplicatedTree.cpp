@@ -0,0 +1,187 @@
+/*
+Per-NUMA-node replicas of a tree kept in sync through an operation log.
+ */
+
+#include "ReplicatedTree.h"
+
+template <class Tree>
+ReplicatedTree<Tree>::ReplicatedTree() : ReplicatedTree(NodeArena::numaNodeCount()) {}
+
+template <class Tree>
+ReplicatedTree<Tree>::ReplicatedTree(size_t count) : logStart(0), logEnd(0) {
+    size_t nodes = NodeArena::numaNodeCount();
+    for (size_t i = 0; i < std::max<size_t>(count, 1); ++i) {
+        replicas.push_back(std::make_unique<Replica>());
+        replicas.back()->tree.setNumaNode(static_cast<int>(i % nodes));
+    }
+}
+
+template <class Tree>
+typename ReplicatedTree<Tree>::Replica& ReplicatedTree<Tree>::localReplica() const {
+    return *replicas[static_cast<size_t>(NodeArena::currentNumaNode()) % replicas.size()];
+}
+
+template <class Tree>
+bool ReplicatedTree<Tree>::apply(Tree& tree, const Operation& op) {
+    switch (op.kind) {
+    case Operation::Kind::Insert:
+        return tree.insert(op.key, op.value);
+    case Operation::Kind::Append:
+        return tree.append(op.key, op.value);
+    case Operation::Kind::Remove:
+        return tree.remove(op.key);
+    }
+    return false;
+}
+
+// The pending entries are copied out so the log lock is not held while the
+// tree is updated.
+template <class Tree>
+bool ReplicatedTree<Tree>::replay(Replica& replica, size_t upTo) const {
+    size_t from = replica.applied.load();
+    if (from >= upTo) {
+        return false;
+    }
+
+    std::vector<Operation> pending;
+    {
+        std::lock_guard<std::mutex> guard(logLock);
+        pending.assign(log.begin() + (from - logStart), log.begin() + (upTo - logStart));
+    }
+
+    bool result = false;
+    for (const Operation& op : pending) {
+        result = apply(replica.tree, op);
+    }
+    replica.applied.store(upTo);
+    return result;
+}
+
+// The local replica stays locked from before the entry is logged until it is
+// applied, so nobody else can replay past it and its result is ours.
+template <class Tree>
+bool ReplicatedTree<Tree>::write(Operation op) {
+    Replica& replica = localReplica();
+    bool result;
+    {
+        std::unique_lock<std::shared_mutex> replicaGuard(replica.lock);
+        size_t position;
+        {
+            std::lock_guard<std::mutex> guard(logLock);
+            log.push_back(std::move(op));
+            position = logEnd.load() + 1;
+            logEnd.store(position);
+            trim();
+        }
+        result = replay(replica, position);
+    }
+    catchUp();
+    return result;
+}
+
+// Called with the writer's own replica unlocked: replica locks are only ever
+// held one at a time. Each replay covers about MaxLag entries, once every
+// MaxLag writes, so it costs O(1) amortized per write and replica.
+template <class Tree>
+void ReplicatedTree<Tree>::catchUp() {
+    bool replayed = false;
+    for (const auto& r : replicas) {
+        if (r->applied.load() + MaxLag < logEnd.load()) {
+            std::unique_lock<std::shared_mutex> replicaGuard(r->lock);
+            replay(*r, logEnd.load());
+            replayed = true;
+        }
+    }
+    if (replayed) {
+        std::lock_guard<std::mutex> guard(logLock);
+        trim();
+    }
+}
+
+template <class Tree>
+void ReplicatedTree<Tree>::trim() {
+    size_t oldest = logEnd.load();
+    for (const auto& r : replicas) {
+        oldest = std::min(oldest, r->applied.load());
+    }
+    while (logStart < oldest) {
+        log.pop_front();
+        ++logStart;
+    }
+}
+
+template <class Tree>
+const Tree& ReplicatedTree<Tree>::readReplica(std::shared_lock<std::shared_mutex>& guard) const {
+    Replica& replica = localReplica();
+    size_t target = logEnd.load();
+    for (;;) {
+        guard = std::shared_lock<std::shared_mutex>(replica.lock);
+        if (replica.applied.load() >= target) {
+            return replica.tree;
+        }
+        guard.unlock();
+
+        std::unique_lock<std::shared_mutex> replayGuard(replica.lock);
+        replay(replica, target);
+    }
+}
+
+template <class Tree>
+bool ReplicatedTree<Tree>::insert(const KeyType& key, ValueType value) {
+    return write({Operation::Kind::Insert, key, value});
+}
+
+template <class Tree>
+bool ReplicatedTree<Tree>::append(const KeyType& key, ValueType value) {
+    return write({Operation::Kind::Append, key, value});
+}
+
+template <class Tree>
+bool ReplicatedTree<Tree>::remove(const KeyType& key) {
+    return write({Operation::Kind::Remove, key, 0});
+}
+
+template <class Tree>
+bool ReplicatedTree<Tree>::contains(const KeyType& key) const {
+    std::shared_lock<std::shared_mutex> guard;
+    return readReplica(guard).contains(key);
+}
+
+template <class Tree>
+std::optional<typename ReplicatedTree<Tree>::ValueType>
+ReplicatedTree<Tree>::get(const KeyType& key) const {
+    std::shared_lock<std::shared_mutex> guard;
+    return readReplica(guard).get(key);
+}
+
+template <class Tree>
+std::vector<typename ReplicatedTree<Tree>::ValueType>
+ReplicatedTree<Tree>::findRange(const KeyType& lowKey, const KeyType& highKey) const {
+    std::shared_lock<std::shared_mutex> guard;
+    return readReplica(guard).findRange(lowKey, highKey);
+}
+
+template <class Tree>
+std::vector<typename ReplicatedTree<Tree>::KeyType> ReplicatedTree<Tree>::keys() const {
+    std::shared_lock<std::shared_mutex> guard;
+    return readReplica(guard).keys();
+}
+
+template <class Tree>
+size_t ReplicatedTree<Tree>::size() const {
+    std::shared_lock<std::shared_mutex> guard;
+    return readReplica(guard).size();
+}
+
+template <class Tree>
+size_t ReplicatedTree<Tree>::replicaCount() const {
+    return replicas.size();
+}
+
+template <class Tree>
+size_t ReplicatedTree<Tree>::logSize() const {
+    std::lock_guard<std::mutex> guard(logLock);
+    return log.size();
+}
+
+INSTANTIATE_FOR_EACH_TREE(ReplicatedTree);
@@ -0,0 +1,109 @@
+#ifndef REPLICATEDTREE_H
+#define REPLICATEDTREE_H
+
+#include "AVLTree.h"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+// A read-mostly map replicated once per NUMA node (node replication).
+//
+// Every replica is a full tree whose nodes live in its own node's memory, so
+// readers only touch local memory: a reader uses the replica of the node its
+// thread runs on. Writes are appended to a shared operation log; a replica
+// replays the log entries it has not seen yet before it serves a read or a
+// write, so all replicas apply the same operations in the same order. Log
+// entries every replica has applied are dropped. A replica nobody reads (no
+// thread on its node) would keep the whole log alive, so once one falls more
+// than MaxLag entries behind, the next writer replays them for it.
+//
+// All replicas apply the writes in one order, that of the log, and a read
+// sees every write that completed before it started, on whatever thread.
+template <class Tree>
+class ReplicatedTree {
+public:
+    using KeyType   = typename Tree::KeyType;
+    using ValueType = typename Tree::ValueType;
+
+    // Log entries a replica may fall behind before a writer brings it up to
+    // date; also the most a read ever has to replay on an idle replica.
+    static constexpr size_t MaxLag = 1024;
+
+private:
+    // One logged write.
+    struct Operation {
+        enum class Kind { Insert, Append, Remove };
+        Kind      kind;
+        KeyType   key;
+        ValueType value;
+    };
+
+    // A copy of the tree plus how much of the log it has applied.
+    struct Replica {
+        Tree tree;
+        std::shared_mutex lock;           // Shared for reads, exclusive to replay
+        std::atomic<size_t> applied{0};   // Log position replayed up to
+    };
+
+    std::vector<std::unique_ptr<Replica>> replicas;
+
+    // Log entries [logStart, logEnd) that some replica has not applied yet.
+    // Lock order: a replica's lock before logLock.
+    mutable std::mutex logLock;
+    std::deque<Operation> log;
+    size_t logStart;
+    std::atomic<size_t> logEnd;
+
+    // Replica of the NUMA node the calling thread runs on.
+    Replica& localReplica() const;
+
+    // Applies the log up to position 'upTo' to 'replica' (exclusive lock
+    // held). Returns the result of the last operation applied.
+    bool replay(Replica& replica, size_t upTo) const;
+
+    // Logs 'op' and applies it to the local replica, returning its result.
+    bool write(Operation op);
+
+    // Replays the log for every replica more than MaxLag entries behind
+    // (no lock held).
+    void catchUp();
+
+    // Drops the log entries every replica has applied (logLock held).
+    void trim();
+
+    // Shared-locks the local replica once it has applied every write that
+    // completed before the call.
+    const Tree& readReplica(std::shared_lock<std::shared_mutex>& guard) const;
+
+    static bool apply(Tree& tree, const Operation& op);
+
+public:
+    // One replica per NUMA node, or 'count' replicas placed round-robin.
+    ReplicatedTree();
+    explicit ReplicatedTree(size_t count);
+
+    ReplicatedTree(const ReplicatedTree&) = delete;
+    ReplicatedTree& operator=(const ReplicatedTree&) = delete;
+
+    // Same meaning and results as on the tree itself.
+    bool insert(const KeyType& key, ValueType value);
+    bool append(const KeyType& key, ValueType value);
+    bool remove(const KeyType& key);
+
+    bool contains(const KeyType& key) const;
+    std::optional<ValueType> get(const KeyType& key) const;
+    std::vector<ValueType> findRange(const KeyType& lowKey,
+                                     const KeyType& highKey) const;
+    std::vector<KeyType> keys() const;
+    size_t size() const;
+
+    // Number of replicas, and log entries not yet applied by all of them.
+    size_t replicaCount() const;
+    size_t logSize() const;
+};
+
+#endif
@@ -0,0 +1,83 @@
+/*
+Tests for ReplicatedTree: results like a single tree, and a bounded log.
+ */
+#include "ReplicatedTree.h"
+#include "TestCheck.h"
+
+#include <cstdio>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+static void testLikeOneTree() {
+    ReplicatedTree<AVLTree> replicated(3);
+    AVLTree tree;
+    CHECK(replicated.replicaCount() == 3);
+    mt19937 rng(60);
+    for (size_t i = 0; i < 5000; ++i) {
+        string k = key(rng() % 1000);
+        switch (rng() % 3) {
+        case 0:
+            CHECK(replicated.remove(k) == tree.remove(k));
+            break;
+        case 1:
+            CHECK(replicated.insert(k, i) == tree.insert(k, i));
+            break;
+        default:
+            CHECK(replicated.append(key(1000 + i), i) == tree.append(key(1000 + i), i));
+            break;
+        }
+        CHECK(replicated.get(k) == tree.get(k));
+    }
+    CHECK(replicated.keys() == tree.keys());
+    CHECK(replicated.size() == tree.size());
+    CHECK(replicated.findRange(key(100), key(900)) == tree.findRange(key(100), key(900)));
+    CHECK(replicated.contains(tree.keys().front()));
+}
+
+// Only the replica of this thread's NUMA node is read; the others must not
+// hold the log back.
+static void testIdleReplicasBoundTheLog() {
+    ReplicatedTree<AVLTree> replicated(4);
+    size_t longest = 0;
+    for (size_t i = 0; i < 20 * ReplicatedTree<AVLTree>::MaxLag; ++i) {
+        replicated.insert(key(i), i);
+        longest = max(longest, replicated.logSize());
+    }
+    CHECK(longest <= ReplicatedTree<AVLTree>::MaxLag + 1);
+    CHECK(replicated.size() == 20 * ReplicatedTree<AVLTree>::MaxLag);
+}
+
+// Writers on disjoint keys and readers, all at once.
+static void testThreads() {
+    ReplicatedTree<WAVLTree> replicated(2);
+    vector<thread> threads;
+    for (size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&replicated, t] {
+            for (size_t i = 0; i < 2000; ++i) {
+                size_t k = i * 4 + t;
+                replicated.insert(key(k), k);
+                if (i % 3 == 0) {
+                    replicated.remove(key(k));
+                }
+                replicated.get(key(k));
+            }
+        });
+    }
+    for (thread& t : threads) {
+        t.join();
+    }
+    CHECK(replicated.size() == 4 * (2000 - 667));
+    CHECK(!replicated.contains(key(0)));
+    CHECK(replicated.get(key(5)) == optional<size_t>(5));
+}
+
+int main() {
+    testLikeOneTree();
+    testIdleReplicasBoundTheLog();
+    testThreads();
+    return testResult();
+}
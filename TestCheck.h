@@ -0,0 +1,46 @@
+#ifndef TESTCHECK_H
+#define TESTCHECK_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+// Checks for the test drivers. A failed CHECK prints where it failed and the
+// driver carries on, so one run reports every failure; unlike assert() it is
+// not compiled out under NDEBUG. main() returns testResult(). Checks may run
+// on any thread, so the failure count is atomic.
+
+inline std::atomic<int>& testFailures() {
+    static std::atomic<int> failures{0};
+    return failures;
+}
+
+#define CHECK(condition)                                                        \
+    do {                                                                        \
+        if (!(condition)) {                                                     \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK failed: "      \
+                      << #condition << "\n";                                    \
+            ++testFailures();                                                   \
+        }                                                                       \
+    } while (0)
+
+// Key number 'i' as the drivers spell it, "k0000042": zero-padded, so keys
+// sort as their numbers do.
+inline std::string key(size_t i) {
+    char buf[16];
+    snprintf(buf, sizeof buf, "k%07zu", i);
+    return buf;
+}
+
+// Exit status for the driver: 0 if every check passed.
+inline int testResult() {
+    if (int failures = testFailures().load(); failures > 0) {
+        std::cerr << failures << " check(s) failed\n";
+        return 1;
+    }
+    return 0;
+}
+
+#endif
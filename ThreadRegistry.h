@@ -0,0 +1,136 @@
+#ifndef THREADREGISTRY_H
+#define THREADREGISTRY_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// Per-thread records of an object shared by many threads (a tree's request
+// slots or write buffers, a reclaimer's epoch records).
+//
+// The owner holds a ThreadRegistry and asks it for the calling thread's
+// record; the first call on a thread creates the record and the thread
+// remembers it in a thread_local cache, keyed by a registry id rather than
+// the owner's address, so an owner allocated where a destroyed one was does
+// not pick up its dangling records. The last registry used is remembered
+// too, so the common case skips the hash lookup.
+//
+// When a thread exits, the exit hook runs on it once for each record it
+// still has in a registry that is open, so the owner can retire the record.
+// The owner calls close() first thing in its destructor: after that no hook
+// runs, and one already running has finished. Cache entries of closed
+// registries are dropped as the cache grows, so a thread that outlives many
+// owners keeps a cache proportional to the live ones.
+//
+// Any number of threads may call local() at once; the owner's record list
+// is its own business.
+template <class Record>
+class ThreadRegistry {
+public:
+    // Runs on an exiting thread with the record it leaves behind.
+    using ExitHook = std::function<void(Record*)>;
+
+    explicit ThreadRegistry(ExitHook onExit = nullptr)
+        : control(std::make_shared<Control>()), id(nextId().fetch_add(1) + 1) {
+        control->onExit = std::move(onExit);
+    }
+
+    ~ThreadRegistry() {
+        close();
+    }
+
+    ThreadRegistry(const ThreadRegistry&) = delete;
+    ThreadRegistry& operator=(const ThreadRegistry&) = delete;
+
+    // The calling thread's record; 'make' creates it (and registers it with
+    // the owner) on the first call.
+    template <class Make>
+    Record& local(Make make) {
+        Cache& cache = threadCache();
+        if (cache.lastId == id) {
+            return *cache.last;
+        }
+        Entry& entry = cache.entries[id];
+        if (!entry.record) {
+            entry.record = make();
+            entry.control = control;
+            if (cache.entries.size() >= cache.pruneAt) {
+                cache.prune();
+            }
+        }
+        cache.lastId = id;
+        cache.last = entry.record;
+        return *entry.record;
+    }
+
+    // Stops exit hooks, waiting for one that is running.
+    void close() {
+        std::lock_guard<std::mutex> guard(control->lock);
+        control->open = false;
+    }
+
+private:
+    struct Control {
+        std::mutex lock;              // Held while a hook runs, and by close()
+        bool open = true;
+        ExitHook onExit;
+    };
+
+    struct Entry {
+        Record* record = nullptr;
+        std::weak_ptr<Control> control;
+    };
+
+    struct Cache {
+        std::unordered_map<uint64_t, Entry> entries;
+        uint64_t lastId = 0;
+        Record* last = nullptr;
+        size_t pruneAt = 16;
+
+        // Drops the entries of closed registries; the next prune waits until
+        // the cache has doubled again.
+        void prune() {
+            for (auto it = entries.begin(); it != entries.end();) {
+                if (it->second.control.expired()) {
+                    if (it->first == lastId) {
+                        lastId = 0;
+                    }
+                    it = entries.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            pruneAt = std::max<size_t>(16, entries.size() * 2);
+        }
+
+        ~Cache() {
+            for (auto& [id, entry] : entries) {
+                if (std::shared_ptr<Control> owner = entry.control.lock()) {
+                    std::lock_guard<std::mutex> guard(owner->lock);
+                    if (owner->open && owner->onExit) {
+                        owner->onExit(entry.record);
+                    }
+                }
+            }
+        }
+    };
+
+    static Cache& threadCache() {
+        thread_local Cache cache;
+        return cache;
+    }
+
+    static std::atomic<uint64_t>& nextId() {
+        static std::atomic<uint64_t> counter{0};
+        return counter;
+    }
+
+    std::shared_ptr<Control> control;
+    uint64_t id;
+};
+
+#endif
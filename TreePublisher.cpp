@@ -0,0 +1,97 @@
+/*
+RCU-style publishing of whole trees: one atomic pointer, epoch-based
+reclamation of the trees it replaced.
+ */
+
+#include "TreePublisher.h"
+
+#include <utility>
+
+template <class Tree>
+TreePublisher<Tree>::TreePublisher() : current(new Tree) {}
+
+template <class Tree>
+TreePublisher<Tree>::TreePublisher(Tree initial) : current(new Tree(std::move(initial))) {}
+
+// The reclaimer, destroyed after this, deletes the trees still retired.
+template <class Tree>
+TreePublisher<Tree>::~TreePublisher() {
+    delete current.load();
+}
+
+template <class Tree>
+void TreePublisher<Tree>::deleteTree(void* tree, void*) {
+    delete static_cast<const Tree*>(tree);
+}
+
+template <class Tree>
+typename TreePublisher<Tree>::Snapshot TreePublisher<Tree>::snapshot() const {
+    reclaimer.enter();
+    return Snapshot(&reclaimer, current.load(std::memory_order_acquire));
+}
+
+template <class Tree>
+void TreePublisher<Tree>::replace(const Tree* next) {
+    const Tree* old = current.exchange(next, std::memory_order_acq_rel);
+    reclaimer.retire(const_cast<Tree*>(old), &deleteTree, nullptr);
+    reclaimer.collect();
+}
+
+template <class Tree>
+void TreePublisher<Tree>::publish(Tree tree) {
+    auto* next = new Tree(std::move(tree));
+    std::lock_guard<std::mutex> guard(writers);
+    replace(next);
+}
+
+// Readers may be on the current tree while it is copied and the copy is
+// edited: copy-on-write never changes a node the two trees share.
+template <class Tree>
+void TreePublisher<Tree>::update(const std::function<void(Tree&)>& edit) {
+    std::lock_guard<std::mutex> guard(writers);
+    auto* next = new Tree(*current.load(std::memory_order_acquire));
+    edit(*next);
+    replace(next);
+}
+
+template <class Tree>
+void TreePublisher<Tree>::synchronize() {
+    reclaimer.flush();
+}
+
+template <class Tree>
+size_t TreePublisher<Tree>::retiredTrees() const {
+    return reclaimer.pending();
+}
+
+// ---------------------------------------------------------------------------
+// Snapshot
+
+template <class Tree>
+TreePublisher<Tree>::Snapshot::Snapshot(EpochReclaimer* r, const Tree* t)
+    : reclaimer(r), tree(t) {}
+
+template <class Tree>
+TreePublisher<Tree>::Snapshot::Snapshot(Snapshot&& other) noexcept
+    : reclaimer(other.reclaimer), tree(other.tree) {
+    other.reclaimer = nullptr;
+}
+
+template <class Tree>
+TreePublisher<Tree>::Snapshot::~Snapshot() {
+    if (reclaimer) {
+        reclaimer->leave();
+    }
+}
+
+template <class Tree>
+const Tree& TreePublisher<Tree>::Snapshot::operator*() const {
+    return *tree;
+}
+
+template <class Tree>
+const Tree* TreePublisher<Tree>::Snapshot::operator->() const {
+    return tree;
+}
+
+INSTANTIATE_FOR_EACH_TREE(TreePublisher);
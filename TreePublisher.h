@@ -0,0 +1,92 @@
+#ifndef TREEPUBLISHER_H
+#define TREEPUBLISHER_H
+
+#include "AVLTree.h"
+#include "EpochReclaimer.h"
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+// Read-copy-update publishing of whole trees, for indexes that are rebuilt
+// or edited off to the side and then swapped in.
+//
+// The current tree sits behind one atomic pointer. A reader takes a Snapshot
+// (pin the reclaimer, load the pointer) and reads that tree for as long as
+// it holds it, without a lock, while writers publish newer trees. A writer
+// builds a tree (from scratch, or as an O(1) copy-on-write copy of the
+// current one, see update()) and publishes it with one exchange; the tree it
+// replaces is retired and deleted once no snapshot can still see it. Every
+// publish also frees what has become safe since, so an old tree lingers for
+// a couple of publishes at most; synchronize() frees it right away.
+//
+// A published tree is only read, so its snapshots may be read from many
+// threads at once; publish() and update() take turns.
+template <class Tree>
+class TreePublisher {
+public:
+    using KeyType   = typename Tree::KeyType;
+    using ValueType = typename Tree::ValueType;
+
+    // A published tree, kept alive while the snapshot lives. A snapshot must
+    // be destroyed on the thread that took it.
+    class Snapshot {
+    public:
+        Snapshot(Snapshot&& other) noexcept;
+        ~Snapshot();
+
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+        Snapshot& operator=(Snapshot&&) = delete;
+
+        const Tree& operator*() const;
+        const Tree* operator->() const;
+
+    private:
+        friend class TreePublisher;
+        Snapshot(EpochReclaimer* reclaimer, const Tree* tree);
+
+        EpochReclaimer* reclaimer;   // Null once moved from
+        const Tree* tree;
+    };
+
+    // Starts out publishing an empty tree, or 'initial'.
+    TreePublisher();
+    explicit TreePublisher(Tree initial);
+
+    // No snapshot may outlive the publisher.
+    ~TreePublisher();
+
+    TreePublisher(const TreePublisher&) = delete;
+    TreePublisher& operator=(const TreePublisher&) = delete;
+
+    Snapshot snapshot() const;
+
+    // Replaces the current tree with 'tree'.
+    void publish(Tree tree);
+
+    // Publishes a copy of the current tree with 'edit' applied to it. The
+    // copy shares its nodes with the current tree until edited, so this
+    // costs about the path of every write. Updates (and publishes) are
+    // serialized, so none is lost.
+    void update(const std::function<void(Tree&)>& edit);
+
+    // Waits until no reader can still see a tree replaced before the call,
+    // then deletes those trees. Must not be called while holding a snapshot.
+    void synchronize();
+
+    // Trees replaced but not yet deleted.
+    size_t retiredTrees() const;
+
+private:
+    mutable EpochReclaimer reclaimer;
+    std::atomic<const Tree*> current;
+    std::mutex writers;          // Orders publish / update
+
+    void replace(const Tree* next);
+    static void deleteTree(void* tree, void*);
+};
+
+using AVLTreePublisher = TreePublisher<AVLTree>;
+
+#endif
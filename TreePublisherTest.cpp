@@ -0,0 +1,75 @@
+/*
+Tests for TreePublisher: snapshots keep the tree they saw, updates are not
+lost, and replaced trees are deleted.
+ */
+#include "TreePublisher.h"
+#include "TestCheck.h"
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+static void testSnapshots() {
+    AVLTree initial;
+    initial.insert(key(0), 0);
+    TreePublisher<AVLTree> publisher(std::move(initial));
+    {
+        TreePublisher<AVLTree>::Snapshot first = publisher.snapshot();
+        publisher.update([](AVLTree& tree) { tree.insert(key(1), 1); });
+        AVLTree fresh;
+        fresh.insert(key(2), 2);
+        publisher.publish(std::move(fresh));
+
+        CHECK(first->size() == 1);
+        CHECK(first->contains(key(0)));
+        TreePublisher<AVLTree>::Snapshot second = publisher.snapshot();
+        TreePublisher<AVLTree>::Snapshot moved = std::move(second);
+        CHECK(moved->keys() == vector<string>{key(2)});
+        CHECK((*moved).get(key(2)) == optional<size_t>(2));
+        CHECK(publisher.retiredTrees() == 2);
+    }
+    publisher.synchronize();
+    CHECK(publisher.retiredTrees() == 0);
+}
+
+// Writers update concurrently (none lost) while readers check that each
+// snapshot is a consistent tree: key i is present for every i below its size.
+static void testThreads() {
+    TreePublisher<WAVLTree> publisher;
+    atomic<bool> done{false};
+    vector<thread> threads;
+    for (size_t t = 0; t < 2; ++t) {
+        threads.emplace_back([&publisher] {
+            for (size_t i = 0; i < 500; ++i) {
+                publisher.update([](WAVLTree& tree) { tree.insert(key(tree.size()), tree.size()); });
+            }
+        });
+    }
+    for (size_t t = 0; t < 2; ++t) {
+        threads.emplace_back([&publisher, &done] {
+            while (!done.load()) {
+                TreePublisher<WAVLTree>::Snapshot snapshot = publisher.snapshot();
+                size_t size = snapshot->size();
+                CHECK(size == 0 || snapshot->get(key(size - 1)) == optional<size_t>(size - 1));
+                CHECK(!snapshot->contains(key(size)));
+            }
+        });
+    }
+    threads[0].join();
+    threads[1].join();
+    done.store(true);
+    threads[2].join();
+    threads[3].join();
+    CHECK(publisher.snapshot()->size() == 1000);
+    publisher.synchronize();
+    CHECK(publisher.retiredTrees() == 0);
+}
+
+int main() {
+    testSnapshots();
+    testThreads();
+    return testResult();
+}
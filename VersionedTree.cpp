@@ -0,0 +1,327 @@
+/*
+Multi-version map: per-key version chains, timestamped reads and a
+background collector for versions no snapshot can see.
+ */
+
+#include "VersionedTree.h"
+
+// Chains trimmed per hold of the exclusive lock, so writers wait for one
+// batch at most.
+static constexpr size_t CollectBatch = 1024;
+
+template <class Tree>
+VersionedTree<Tree>::VersionedTree(std::chrono::milliseconds gcPeriod)
+    : versions(sizeof(Version), alignof(Version)), versionTotal(0), clock(0),
+      stopping(false), period(gcPeriod), collector([this] { runCollector(); }) {}
+
+template <class Tree>
+VersionedTree<Tree>::~VersionedTree() {
+    {
+        std::lock_guard<std::mutex> guard(collectorLock);
+        stopping = true;
+    }
+    collectorWake.notify_one();
+    collector.join();
+    // Versions hold no resources: they go away with the arena.
+}
+
+template <class Tree>
+void VersionedTree<Tree>::addVersion(const KeyType& key, ValueType value, bool removed) {
+    Timestamp ts = clock.load() + 1;
+
+    size_t index;
+    if (auto found = chains.get(key)) {
+        index = *found;
+    } else if (!freeChains.empty()) {
+        index = freeChains.back();
+        freeChains.pop_back();
+        chains.insert(key, index);
+    } else {
+        index = chainList.size();
+        chainList.push_back({nullptr, false});
+        chains.insert(key, index);
+    }
+
+    Chain& chain = chainList[index];
+    chain.newest = new (versions.allocate()) Version{ts, value, chain.newest, removed};
+    ++versionTotal;
+
+    if (chain.newest->older && !chain.queued) {
+        chain.queued = true;
+        pending.push_back(index);
+    }
+    if (removed) {
+        removedKeys.push_back(key);
+    }
+
+    // Published last: a snapshot at 'ts' must find the whole write applied.
+    clock.store(ts);
+}
+
+template <class Tree>
+const typename VersionedTree<Tree>::Version*
+VersionedTree<Tree>::visible(const Version* newest, Timestamp ts) {
+    const Version* v = newest;
+    while (v && v->ts > ts) {
+        v = v->older;
+    }
+    return v && !v->removed ? v : nullptr;
+}
+
+// Reads at 'horizon' or later see the first version at or before it, or
+// something newer, so everything older goes. A removal below a newer version
+// reads the same as no version at all, so it goes too. A removal at the head
+// stays: dropping it means dropping the key (see collectGarbage).
+template <class Tree>
+bool VersionedTree<Tree>::trim(Chain& chain, Timestamp horizon) {
+    Version** link = &chain.newest;
+    while (*link && (*link)->ts > horizon) {
+        link = &(*link)->older;
+    }
+    if (*link && (link == &chain.newest || !(*link)->removed)) {
+        link = &(*link)->older;
+    }
+
+    Version* drop = *link;
+    *link = nullptr;
+    while (drop) {
+        Version* older = drop->older;
+        versions.release(drop);
+        --versionTotal;
+        drop = older;
+    }
+    return chain.newest && chain.newest->older;
+}
+
+template <class Tree>
+typename VersionedTree<Tree>::Timestamp VersionedTree<Tree>::horizon() const {
+    std::lock_guard<std::mutex> guard(readersLock);
+    return readers.empty() ? clock.load() : *readers.begin();
+}
+
+// 'queued' stays set while a chain index is in 'pending' or in the batch
+// being worked on, so every index is listed at most once. A chain freed while
+// listed keeps the flag; whoever reuses it finds it listed already.
+template <class Tree>
+void VersionedTree<Tree>::collectGarbage() {
+    Timestamp oldest = horizon();
+
+    std::vector<size_t> work;
+    std::vector<KeyType> removedWork;
+    {
+        std::unique_lock<std::shared_mutex> guard(lock);
+        work.swap(pending);
+        removedWork.swap(removedKeys);
+    }
+
+    for (size_t i = 0; i < work.size(); i += CollectBatch) {
+        std::unique_lock<std::shared_mutex> guard(lock);
+        for (size_t j = i; j < std::min(work.size(), i + CollectBatch); ++j) {
+            Chain& chain = chainList[work[j]];
+            if (trim(chain, oldest)) {
+                pending.push_back(work[j]);
+            } else {
+                chain.queued = false;
+            }
+        }
+    }
+
+    // A key whose removal every snapshot sees is dropped with its chain.
+    for (size_t i = 0; i < removedWork.size(); i += CollectBatch) {
+        std::unique_lock<std::shared_mutex> guard(lock);
+        for (size_t j = i; j < std::min(removedWork.size(), i + CollectBatch); ++j) {
+            const KeyType& key = removedWork[j];
+            auto found = chains.get(key);
+            if (!found) {
+                continue;                     // listed twice, already dropped
+            }
+            Chain& chain = chainList[*found];
+            if (!chain.newest->removed) {
+                continue;                     // inserted again since
+            }
+            if (chain.newest->ts > oldest) {
+                removedKeys.push_back(key);   // still visible to a snapshot
+                continue;
+            }
+            for (Version* v = chain.newest; v;) {
+                Version* older = v->older;
+                versions.release(v);
+                --versionTotal;
+                v = older;
+            }
+            chain.newest = nullptr;
+            chains.remove(key);
+            freeChains.push_back(*found);
+        }
+    }
+}
+
+template <class Tree>
+void VersionedTree<Tree>::runCollector() {
+    std::unique_lock<std::mutex> guard(collectorLock);
+    while (!stopping) {
+        collectorWake.wait_for(guard, period);
+        if (stopping) {
+            break;
+        }
+        guard.unlock();
+        collectGarbage();
+        guard.lock();
+    }
+}
+
+template <class Tree>
+bool VersionedTree<Tree>::insert(const KeyType& key, ValueType value) {
+    std::unique_lock<std::shared_mutex> guard(lock);
+    if (!latest.insert(key, value)) {
+        return false;
+    }
+    addVersion(key, value, false);
+    return true;
+}
+
+template <class Tree>
+bool VersionedTree<Tree>::remove(const KeyType& key) {
+    std::unique_lock<std::shared_mutex> guard(lock);
+    if (!latest.remove(key)) {
+        return false;
+    }
+    addVersion(key, 0, true);
+    return true;
+}
+
+template <class Tree>
+bool VersionedTree<Tree>::put(const KeyType& key, ValueType value) {
+    std::unique_lock<std::shared_mutex> guard(lock);
+    bool added = latest.insert(key, value);
+    if (!added) {
+        latest[key] = value;
+    }
+    addVersion(key, value, false);
+    return added;
+}
+
+template <class Tree>
+bool VersionedTree<Tree>::contains(const KeyType& key) const {
+    std::shared_lock<std::shared_mutex> guard(lock);
+    return latest.contains(key);
+}
+
+template <class Tree>
+std::optional<typename VersionedTree<Tree>::ValueType>
+VersionedTree<Tree>::get(const KeyType& key) const {
+    std::shared_lock<std::shared_mutex> guard(lock);
+    return latest.get(key);
+}
+
+template <class Tree>
+std::vector<typename VersionedTree<Tree>::ValueType>
+VersionedTree<Tree>::findRange(const KeyType& lowKey, const KeyType& highKey) const {
+    std::shared_lock<std::shared_mutex> guard(lock);
+    return latest.findRange(lowKey, highKey);
+}
+
+template <class Tree>
+size_t VersionedTree<Tree>::size() const {
+    std::shared_lock<std::shared_mutex> guard(lock);
+    return latest.size();
+}
+
+template <class Tree>
+std::optional<typename VersionedTree<Tree>::ValueType>
+VersionedTree<Tree>::get(const KeyType& key, Timestamp ts) const {
+    std::shared_lock<std::shared_mutex> guard(lock);
+    auto found = chains.get(key);
+    if (!found) {
+        return std::nullopt;
+    }
+    const Version* v = visible(chainList[*found].newest, ts);
+    if (!v) {
+        return std::nullopt;
+    }
+    return v->value;
+}
+
+// The chain tree holds removed keys too; those are skipped here.
+template <class Tree>
+std::vector<typename VersionedTree<Tree>::ValueType>
+VersionedTree<Tree>::findRange(const KeyType& lowKey, const KeyType& highKey,
+                               Timestamp ts) const {
+    std::shared_lock<std::shared_mutex> guard(lock);
+    std::vector<ValueType> out;
+    for (size_t index : chains.findRange(lowKey, highKey)) {
+        if (const Version* v = visible(chainList[index].newest, ts)) {
+            out.push_back(v->value);
+        }
+    }
+    return out;
+}
+
+template <class Tree>
+typename VersionedTree<Tree>::Snapshot VersionedTree<Tree>::snapshot() const {
+    std::lock_guard<std::mutex> guard(readersLock);
+    Timestamp ts = clock.load();
+    readers.insert(ts);
+    return Snapshot(this, ts);
+}
+
+template <class Tree>
+typename VersionedTree<Tree>::Timestamp VersionedTree<Tree>::now() const {
+    return clock.load();
+}
+
+template <class Tree>
+size_t VersionedTree<Tree>::versionCount() const {
+    std::shared_lock<std::shared_mutex> guard(lock);
+    return versionTotal;
+}
+
+// ---------------------------------------------------------------------------
+// Snapshot
+
+template <class Tree>
+VersionedTree<Tree>::Snapshot::Snapshot(const VersionedTree* t, Timestamp at)
+    : tree(t), ts(at) {}
+
+template <class Tree>
+VersionedTree<Tree>::Snapshot::Snapshot(Snapshot&& other) noexcept
+    : tree(other.tree), ts(other.ts) {
+    other.tree = nullptr;
+}
+
+// The moved-from snapshot takes ours over and closes it when destroyed.
+template <class Tree>
+typename VersionedTree<Tree>::Snapshot&
+VersionedTree<Tree>::Snapshot::operator=(Snapshot&& other) noexcept {
+    std::swap(tree, other.tree);
+    std::swap(ts, other.ts);
+    return *this;
+}
+
+template <class Tree>
+VersionedTree<Tree>::Snapshot::~Snapshot() {
+    if (tree) {
+        std::lock_guard<std::mutex> guard(tree->readersLock);
+        tree->readers.erase(tree->readers.find(ts));
+    }
+}
+
+template <class Tree>
+typename VersionedTree<Tree>::Timestamp VersionedTree<Tree>::Snapshot::timestamp() const {
+    return ts;
+}
+
+template <class Tree>
+std::optional<typename VersionedTree<Tree>::ValueType>
+VersionedTree<Tree>::Snapshot::get(const KeyType& key) const {
+    return tree->get(key, ts);
+}
+
+template <class Tree>
+std::vector<typename VersionedTree<Tree>::ValueType>
+VersionedTree<Tree>::Snapshot::findRange(const KeyType& lowKey,
+                                         const KeyType& highKey) const {
+    return tree->findRange(lowKey, highKey, ts);
+}
+
+INSTANTIATE_FOR_EACH_TREE(VersionedTree);
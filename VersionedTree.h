@@ -0,0 +1,159 @@
+#ifndef VERSIONEDTREE_H
+#define VERSIONEDTREE_H
+
+#include "AVLTree.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+// A map with multi-version concurrency control: every write commits a new
+// version at the next timestamp, and a read at timestamp 'ts' sees the
+// newest version committed at or before 'ts'.
+//
+// Each key has a version chain, newest first, that also records removals.
+// 'chains' maps a key to its chain (the tree's value is the chain's index).
+// 'latest' holds only the newest value of each key that is not removed, so
+// get / findRange without a timestamp are the tree's own lookups.
+//
+// A Snapshot pins its timestamp: versions it can still see are kept until it
+// is destroyed. A background thread trims older versions. It only visits
+// chains that got a second version or a removal since they were last
+// trimmed, so it costs time in proportion to the writes.
+//
+// Writes take turns and reads share a lock with each other, whatever thread
+// they come from. A Snapshot may be read from any thread but must be
+// destroyed before the tree.
+template <class Tree>
+class VersionedTree {
+public:
+    using KeyType   = typename Tree::KeyType;
+    using ValueType = typename Tree::ValueType;
+    using Timestamp = uint64_t;
+
+private:
+    // One committed version of a key.
+    struct Version {
+        Timestamp ts;
+        ValueType value;
+        Version*  older;     // Next older version, nullptr at the end
+        bool      removed;   // The key was removed at 'ts'
+    };
+
+    struct Chain {
+        Version* newest;     // nullptr while the chain is free
+        bool     queued;     // Already in 'pending'
+    };
+
+    mutable std::shared_mutex lock;   // Shared for reads, exclusive for writes / trimming
+    Tree latest;
+    Tree chains;
+    std::vector<Chain> chainList;
+    std::vector<size_t> freeChains;
+    NodeArena versions;
+    size_t versionTotal;
+
+    // Chains the collector should look at, and the removed keys whose chain
+    // may be dropped altogether once no snapshot can see the key any more.
+    std::vector<size_t> pending;
+    std::vector<KeyType> removedKeys;
+
+    // Timestamp of the newest committed write.
+    std::atomic<Timestamp> clock;
+
+    // Timestamps of the open snapshots.
+    mutable std::mutex readersLock;
+    mutable std::multiset<Timestamp> readers;
+
+    // Background collector.
+    std::mutex collectorLock;
+    std::condition_variable collectorWake;
+    bool stopping;
+    std::chrono::milliseconds period;
+    std::thread collector;
+
+    // Adds a version of 'key' at the next timestamp (exclusive lock held).
+    void addVersion(const KeyType& key, ValueType value, bool removed);
+
+    // Version visible at 'ts' in the chain starting at 'newest', nullptr if
+    // there is none or the key was removed.
+    static const Version* visible(const Version* newest, Timestamp ts);
+
+    // Frees every version of 'chain' that no read at 'horizon' or later can
+    // see. Returns true if the chain still holds more than one version.
+    bool trim(Chain& chain, Timestamp horizon);
+
+    // Oldest timestamp any open snapshot, or any later read, may use.
+    Timestamp horizon() const;
+
+    void runCollector();
+
+public:
+    // A read view pinned at the timestamp it was opened at.
+    class Snapshot {
+    public:
+        Snapshot(Snapshot&& other) noexcept;
+        Snapshot& operator=(Snapshot&& other) noexcept;
+        ~Snapshot();
+
+        Timestamp timestamp() const;
+        std::optional<ValueType> get(const KeyType& key) const;
+        std::vector<ValueType> findRange(const KeyType& lowKey,
+                                         const KeyType& highKey) const;
+
+    private:
+        friend class VersionedTree;
+        Snapshot(const VersionedTree* tree, Timestamp ts);
+
+        const VersionedTree* tree;
+        Timestamp ts;
+    };
+
+    // The background collector runs every 'gcPeriod'.
+    explicit VersionedTree(std::chrono::milliseconds gcPeriod = std::chrono::milliseconds(10));
+    ~VersionedTree();
+
+    VersionedTree(const VersionedTree&) = delete;
+    VersionedTree& operator=(const VersionedTree&) = delete;
+
+    // Same meaning and results as on the tree itself; a write that changes
+    // something commits a new version.
+    bool insert(const KeyType& key, ValueType value);
+    bool remove(const KeyType& key);
+
+    // Inserts 'key' or commits a new value for it. Returns true if it was new.
+    bool put(const KeyType& key, ValueType value);
+
+    // Latest version (no timestamp): plain lookups in 'latest'.
+    bool contains(const KeyType& key) const;
+    std::optional<ValueType> get(const KeyType& key) const;
+    std::vector<ValueType> findRange(const KeyType& lowKey,
+                                     const KeyType& highKey) const;
+    size_t size() const;
+
+    // Reads at timestamp 'ts'. Exact for any 'ts' at or after the oldest open
+    // snapshot; older versions may already have been trimmed.
+    std::optional<ValueType> get(const KeyType& key, Timestamp ts) const;
+    std::vector<ValueType> findRange(const KeyType& lowKey,
+                                     const KeyType& highKey, Timestamp ts) const;
+
+    // Opens a snapshot at the newest committed timestamp.
+    Snapshot snapshot() const;
+
+    // Timestamp of the newest committed write.
+    Timestamp now() const;
+
+    // Trims old versions right away instead of waiting for the collector.
+    void collectGarbage();
+
+    // Number of versions currently kept (removals included).
+    size_t versionCount() const;
+};
+
+#endif
@@ -0,0 +1,137 @@
+/*
+Tests for VersionedTree: reads at a timestamp, snapshots and trimming.
+ */
+#include "VersionedTree.h"
+#include "TestCheck.h"
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+using Versioned = VersionedTree<AVLTree>;
+
+// Every timestamp reads what the tree held right after that write.
+static void testTimestamps() {
+    Versioned tree(chrono::hours(1));      // Collector only when asked
+    vector<map<string, size_t>> history{{}};
+    mt19937 rng(65);
+    for (size_t i = 0; i < 3000; ++i) {
+        string k = key(rng() % 200);
+        map<string, size_t> next = history.back();
+        bool changed;
+        switch (rng() % 3) {
+        case 0:
+            changed = next.erase(k) == 1;
+            CHECK(tree.remove(k) == changed);
+            break;
+        case 1:
+            changed = next.emplace(k, i).second;
+            CHECK(tree.insert(k, i) == changed);
+            break;
+        default:
+            changed = true;
+            CHECK(tree.put(k, i) == (next.count(k) == 0));
+            next[k] = i;
+            break;
+        }
+        if (changed) {
+            history.push_back(next);
+        }
+        CHECK(tree.now() == history.size() - 1);
+    }
+    CHECK(tree.size() == history.back().size());
+    for (Versioned::Timestamp ts = 0; ts < history.size(); ts += 7) {
+        for (size_t k = 0; k < 200; ++k) {
+            auto found = history[ts].find(key(k));
+            CHECK(tree.get(key(k), ts) ==
+                  (found == history[ts].end() ? nullopt : optional<size_t>(found->second)));
+        }
+        vector<size_t> values;
+        for (const auto& [k, v] : history[ts]) {
+            values.push_back(v);
+        }
+        CHECK(tree.findRange(key(0), key(200), ts) == values);
+    }
+    CHECK(tree.findRange(key(0), key(200)) == tree.findRange(key(0), key(200), tree.now()));
+}
+
+// A snapshot keeps what it can see; closing it lets the versions go.
+static void testSnapshots() {
+    Versioned tree(chrono::hours(1));
+    for (size_t i = 0; i < 100; ++i) {
+        tree.put(key(i), i);
+    }
+    Versioned::Snapshot before = tree.snapshot();
+    for (size_t i = 0; i < 100; ++i) {
+        tree.put(key(i), i + 1000);
+        if (i % 2 == 0) {
+            tree.remove(key(i));
+        }
+    }
+    tree.collectGarbage();
+    CHECK(tree.versionCount() == 250);
+    CHECK(before.get(key(4)) == optional<size_t>(4));
+    CHECK(before.findRange(key(0), key(99)).size() == 100);
+    CHECK(tree.get(key(4)) == nullopt);
+    CHECK(tree.get(key(5)) == optional<size_t>(1005));
+
+    Versioned::Snapshot moved = std::move(before);
+    CHECK(moved.get(key(7)) == optional<size_t>(7));
+    CHECK(moved.timestamp() == 100);
+    {
+        Versioned::Snapshot gone = std::move(moved);
+    }
+    tree.collectGarbage();
+    CHECK(tree.versionCount() == 50);
+    CHECK(tree.get(key(4), tree.now()) == nullopt);
+    CHECK(tree.get(key(5), tree.now()) == optional<size_t>(1005));
+
+    // A removed key whose removal no snapshot can see is forgotten, and the
+    // key can come back.
+    CHECK(tree.insert(key(4), 44));
+    CHECK(tree.get(key(4)) == optional<size_t>(44));
+}
+
+// Writers, snapshot readers and the background collector at once. A
+// snapshot reads the same thing however long it stays open.
+static void testThreads() {
+    Versioned tree(chrono::milliseconds(1));
+    atomic<bool> done{false};
+    vector<thread> threads;
+    for (size_t t = 0; t < 2; ++t) {
+        threads.emplace_back([&tree, t] {
+            for (size_t i = 0; i < 20000; ++i) {
+                tree.put(key((i * 2 + t) % 500), i);
+                if (i % 5 == 0) {
+                    tree.remove(key((i * 3 + t) % 500));
+                }
+            }
+        });
+    }
+    threads.emplace_back([&tree, &done] {
+        while (!done.load()) {
+            Versioned::Snapshot snapshot = tree.snapshot();
+            vector<size_t> first = snapshot.findRange(key(0), key(500));
+            this_thread::yield();
+            CHECK(snapshot.findRange(key(0), key(500)) == first);
+        }
+    });
+    threads[0].join();
+    threads[1].join();
+    done.store(true);
+    threads[2].join();
+    tree.collectGarbage();
+    CHECK(tree.versionCount() <= 500);
+}
+
+int main() {
+    testTimestamps();
+    testSnapshots();
+    testThreads();
+    return testResult();
+}